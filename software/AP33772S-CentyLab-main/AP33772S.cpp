@@ -26,28 +26,32 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "AP33772S.h"
 
-byte AP33772S::readBuf[READ_BUFF_LENGTH] = {0};
-byte AP33772S::writeBuf[WRITE_BUFF_LENGTH] = {0};
-int AP33772S::_voltageAVSbyte = 0;
-int AP33772S::_currentAVSbyte = 0;
-int AP33772S::_indexAVS = 0;
 
 /**
  * @brief Class constuctor
  * @param &wire reference of Wire class. Pass in Wire or Wire1
+ * @param address 7 bits I2C address of the chip
  */
-AP33772S::AP33772S(TwoWire &wire)
+AP33772S::AP33772S(TwoWire &wire, byte address)
 {
     _i2cPort = &wire;
+    _address = address;
+#if defined(PIN_WIRE_SDA) && defined(PIN_WIRE_SCL)
+    if(&wire == &Wire) setBusPins(PIN_WIRE_SDA, PIN_WIRE_SCL);
+#endif
 }
 
 /**
- * @brief Check if power supply is good and fetch the PDO profile
+ * @brief Wait for the chip to report its source capabilities and fetch the PDO profile.
+ *        Polls STATUS every BOOT_POLL ms and reads SRCPDO as soon as NEWPDO is set,
+ *        instead of sleeping for the worst case. A chip that was already running when
+ *        the MCU reset reports no STARTED, its SRCPDO is read right away.
+ * @param timeout_ms budget for the chip to answer and raise NEWPDO, SRCPDO is read
+ *        anyway when it runs out
+ * @return 1 if the source reported at least one PDO, timeline in bootStats()
  */
-void AP33772S::begin()
+bool AP33772S::begin(unsigned long timeout_ms)
 {
-    delay(100);
-  
     /*
     After boot up expect:
     NEWPDO      = 1
@@ -55,29 +59,80 @@ void AP33772S::begin()
     STARTED     = 1
     After read, STATUS reg will reset back to 0
     */
+    applyBusTimeout();
+    startBoot(timeout_ms);
+    while(!bootPoll()) delay(BOOT_POLL);
+    return _boot.pdos > 0;
+}
 
-    // i2c_read(AP33772S_ADDRESS, CMD_STATUS, 1); // CMD: Read Status into read buff
-    // uint8_t temp = readBuf[0] & 0b00000111; //Isolate bit 0 to 2
-    // if(temp == 0b111) // NEWPDO = 1, I2C READY = 1, STARTED = 1;
-    // {
-    //     delay(100); //delay 100ms
-    //     i2c_read(AP33772S_ADDRESS, CMD_SRCPDO, 26);
-    //     Serial.println("Profile list detected: ");
-    // }
+void AP33772S::startBoot(unsigned long timeout_ms)
+{
+    _boot = BOOT_STATS_T();
+    _bootStart = micros();
+    _bootTimeout = timeout_ms * 1000UL;
+}
 
-    //Reread profile at startup
-    i2c_read(AP33772S_ADDRESS, CMD_SRCPDO, 26);
+/**
+ * @brief One step of the boot sequence, one STATUS read and SRCPDO once it is valid
+ * @return 1 when finished, loaded or out of time
+ */
+bool AP33772S::bootPoll()
+{
+    unsigned long elapsed = micros() - _bootStart;
+    byte status;
+    _boot.polls++;
+    bool acked = i2c_read(CMD_STATUS, &status, 1); // NACK while the chip boots
 
-    for (int i = 0; i < 26; i += 2) {
+    if(acked)
+    {
+        bool first = _boot.ackUs == 0;
+        if(first) _boot.ackUs = micros() - _bootStart;
+        if(status & (STARTED_MSK | NEWPDO_MSK)) invalidateConfigCache();
+        handleStatus(status); // Keep the bits for getEvent()
+        _boot.status |= status;
+
+        // NEWPDO: capabilities just arrived. No STARTED at the first answer: the chip
+        // booted before the MCU and SRCPDO is already valid, unless no source is there yet.
+        if(status & NEWPDO_MSK) _boot.pdos = loadPDOs();
+        else if(first && !(status & STARTED_MSK)) _boot.pdos = loadPDOs();
+        if(_boot.pdos > 0)
+        {
+            _boot.pdoUs = micros() - _bootStart;
+            return 1;
+        }
+    }
+
+    if(elapsed < _bootTimeout) return 0;
+    _boot.timedOut = true;
+    _boot.pdos = loadPDOs();
+    if(_boot.pdos > 0) _boot.pdoUs = micros() - _bootStart;
+    return 1;
+}
+
+/**
+ * @brief Read SRCPDO, decode it and populate internal variables
+ * @return number of PDO reported by the source, 0 on a bus error with the table left as it was
+ */
+int AP33772S::loadPDOs()
+{
+    byte buf[SRCPDO_LENGTH];
+    if(!i2c_read(CMD_SRCPDO, buf, SRCPDO_LENGTH)) return 0;
+
+    int count = 0;
+    for (int i = 0; i < SRCPDO_LENGTH; i += 2) {
         // Store the bytes in the array of structs
         int pdoIndex = (i / 2);  // Calculate the PDO index
-        SRC_SPRandEPRpdoArray[pdoIndex].byte0 = readBuf[i];
-        SRC_SPRandEPRpdoArray[pdoIndex].byte1 = readBuf[i + 1];
+        SRC_SPRandEPRpdoArray[pdoIndex].byte0 = buf[i];
+        SRC_SPRandEPRpdoArray[pdoIndex].byte1 = buf[i + 1];
+        if(buf[i] || buf[i + 1]) count++;
         // displayPDOInfo(pdoIndex);
     }
 
     //Populate internal variable
     mapPPSAVSInfo();
+
+    if(_configCache) fillConfigCache();
+    return count;
 }
 
 /**
@@ -113,7 +168,7 @@ void AP33772S::displayPDOInfo(int pdoIndex) {
   if (SRC_SPRandEPRpdoArray[pdoIndex].fixed.type == 0) {  // Fixed PDO
     // Print parsed values
     Serial.print("Fixed PDO: ");
-    Serial.print(SRC_SPRandEPRpdoArray[pdoIndex].fixed.voltage_max * (isEPR ? 200 : 100)); // Voltage in 200mV units for EPR, 100mV for SPR
+    Serial.print(_caps[pdoIndex].max_mV);
     Serial.print("mV ");
     displayCurrentRange(SRC_SPRandEPRpdoArray[pdoIndex].fixed.current_max);  // Assuming displayCurrentRange function is available
   } else {  // PPS or AVS PDO
@@ -124,7 +179,7 @@ void AP33772S::displayPDOInfo(int pdoIndex) {
     } else {
       displaySPRVoltageMin(SRC_SPRandEPRpdoArray[pdoIndex].pps.voltage_min);  // Assuming displayVoltageMin function is available
     }
-    Serial.print(SRC_SPRandEPRpdoArray[pdoIndex].fixed.voltage_max * (isEPR ? 200 : 100)); // Maximum Voltage in 200mV units for EPR, 100mV for SPR
+    Serial.print(_caps[pdoIndex].max_mV);
     Serial.print("mV ");
     displayCurrentRange(SRC_SPRandEPRpdoArray[pdoIndex].fixed.current_max);  // Assuming displayCurrentRange function is available
   }
@@ -132,308 +187,620 @@ void AP33772S::displayPDOInfo(int pdoIndex) {
 }
 
 /**
- * @brief Search through the list of profile and look for PPS, AVS
- * @bug If system has 2 PPS profiles. The index only show the last one. Use displayPDOInfo() to check.
+ * @brief Decode SRCPDO into the capability table. Called by begin(), afterwards every
+ *        request validates against the table without touching the raw bit-fields.
+ *        The table is also sorted by maximum voltage, and every PPS/AVS entry is indexed.
  */
 void AP33772S::mapPPSAVSInfo()
 {
-  for(int i = 1; i<=13; i++)
+  _numPDO = 0;
+  _numPPS = 0;
+  _numAVS = 0;
+  _activeIndex = 0;
+  _lastRDO = 0;
+  _acceptedRDO = 0;
+
+  for(int i = 1; i <= MAX_PDO_ENTRIES; i++)
   {
-    if(i < 8 && SRC_SPRandEPRpdoArray[i-1].pps.type == 1)
+    const SRC_SPRandEPR_PDO_Fields &raw = SRC_SPRandEPRpdoArray[i-1];
+    PDO_CAP_T &cap = _caps[i-1];
+    bool isEPR = i >= 8;
+
+    cap.index = i;
+    cap.kind = PDO_NONE;
+    if(raw.byte0 == 0 && raw.byte1 == 0) continue;
+
+    cap.current_code = raw.fixed.current_max;
+    cap.max_mA = raw.fixed.current_max >= 15 ? 5000 : 1000 + 250 * raw.fixed.current_max; // Lower bound of the range
+    cap.max_mV = raw.fixed.voltage_max * (isEPR ? 200 : 100); // 200mV units for EPR, 100mV for SPR
+
+    if(raw.fixed.type == 0)
+    {
+      cap.kind = PDO_FIXED;
+      cap.min_mV = cap.max_mV;
+    }
+    else if(!isEPR)
     {
-      Serial.println("Found PPS profile");
-      _indexPPSUser = i;
+      cap.kind = PDO_PPS;
+      // 1: 3300mV, 2: 3300mV < VOLTAGE_MIN <= 5000mV, reserved/others: assume worst case 5000mV
+      cap.min_mV = raw.pps.voltage_min == 1 ? 3300 : 5000;
+      _ppsList[_numPPS++] = i;
+      AP33772S_LOGI(LOG_FOUND_PPS, i);
     }
-    else if(i >= 8 && SRC_SPRandEPRpdoArray[i-1].avs.type == 1)
+    else
+    {
+      cap.kind = PDO_AVS;
+      // 1: 15000mV, 2: 15000mV < VOLTAGE_MIN <= 20000mV, reserved/others: assume worst case 20000mV
+      cap.min_mV = raw.avs.voltage_min == 1 ? 15000 : 20000;
+      _avsList[_numAVS++] = i;
+      AP33772S_LOGI(LOG_FOUND_AVS, i);
+    }
+
+    // Insertion sort by maximum voltage, fixed before PPS/AVS at equal voltage
+    byte pos = _numPDO++;
+    while(pos > 0)
     {
-      Serial.println("Found AVS profile");
-      _indexAVSUser = i;
+      const PDO_CAP_T &prev = _caps[_capOrder[pos-1] - 1];
+      if(prev.max_mV < cap.max_mV || (prev.max_mV == cap.max_mV && prev.kind <= cap.kind)) break;
+      _capOrder[pos] = _capOrder[pos-1];
+      pos--;
     }
+    _capOrder[pos] = i;
   }
+
+  // Keep the previous behaviour of reporting the last (highest voltage) PPS/AVS profile
+  _indexPPSUser = _numPPS ? _ppsList[_numPPS-1] : -1;
+  _indexAVSUser = _numAVS ? _avsList[_numAVS-1] : -1;
+  existPPS = _numPPS > 0;
+  existAVS = _numAVS > 0;
 }
 
+/**
+ * @brief Capability table entry of a PDO
+ * @param pdoIndex index 1
+ * @return NULL if the source does not offer this PDO
+ */
+const PDO_CAP_T *AP33772S::getPDOCap(int pdoIndex)
+{
+  if(pdoIndex < 1 || pdoIndex > MAX_PDO_ENTRIES) return NULL;
+  if(_caps[pdoIndex-1].kind == PDO_NONE) return NULL;
+  return &_caps[pdoIndex-1];
+}
 
 /**
- * @brief Request fixed PDO voltage, work for both standard and EPR mode
+ * @brief PDO at the given position of the table sorted by maximum voltage
+ * @param n 0 for the lowest voltage, up to getNumPDO()-1
+ * @return PDO index (index start at 1), -1 if out of range
+ */
+int AP33772S::getPDOByVoltage(int n)
+{
+  if(n < 0 || n >= _numPDO) return -1;
+  return _capOrder[n];
+}
+
+/**
+ * @brief Validate a request against the capability table and encode the RDO
+ * @param kind expected PDO kind at pdoIndex
  * @param pdoIndex index 1
+ * @param target_voltage unit in mV, ignored for fixed PDO
  * @param max_current unit in mA
+ * @return 0 if the PDO cannot satisfy the request
  */
-void AP33772S::setFixPDO(int pdoIndex, int max_current) 
+bool AP33772S::encodeRDO(byte kind, int pdoIndex, int target_voltage, int max_current, RDO_DATA_T &rdoData)
 {
-  // cancelAVSTimer();
+  const PDO_CAP_T *cap = getPDOCap(pdoIndex);
+  if(cap == NULL || cap->kind != kind) return 0;
 
-  RDO_DATA_T rdoData;
+  int current_sel = currentMap(max_current);
+  if(max_current <= 0 || current_sel < 0 || current_sel > cap->current_code)
+  {
+    AP33772S_LOGE(kind == PDO_FIXED ? LOG_FIXED_CURRENT_RANGE :
+                  kind == PDO_PPS ? LOG_PPS_CURRENT_RANGE : LOG_AVS_CURRENT_RANGE, max_current);
+    return 0; // Check if current setting is in range
+  }
 
-  // Max current sanity check
-  if(max_current <= 0) return;
+  rdoData.data = 0;
+  rdoData.REQMSG_Fields.PDO_INDEX = pdoIndex;  // Index 1
+  rdoData.REQMSG_Fields.CURRENT_SEL = current_sel;
+  if(kind == PDO_FIXED) return 1; // Fixed voltage, VOLTAGE_SEL unused
+
+  if(target_voltage < cap->min_mV || target_voltage > cap->max_mV)
+  {
+    AP33772S_LOGE(kind == PDO_PPS ? LOG_PPS_VOLTAGE_RANGE : LOG_AVS_VOLTAGE_RANGE, target_voltage);
+    return 0;
+  }
+  // Output Voltage in 100mV units for PPS, 200mV units for AVS
+  rdoData.REQMSG_Fields.VOLTAGE_SEL = target_voltage / (kind == PDO_PPS ? 100 : 200);
+  return 1;
+}
+
+/**
+ * @brief Request fixed PDO voltage, work for both standard and EPR mode
+ * @param pdoIndex index 1
+ * @param max_current unit in mA
+ * @return 0 if the PDO cannot satisfy the request or the bus failed, see busStatus()
+ */
+bool AP33772S::setFixPDO(int pdoIndex, int max_current) 
+{
+  RDO_DATA_T rdoData;
 
   // For Fix voltage, only need to set PDO_INDEX and CURRENT_SEL
-  // No need to change the selected voltage
   // handle the same in standard as well as EPR
+  if(!encodeRDO(PDO_FIXED, pdoIndex, 0, max_current, rdoData)) return 0;
+  AP33772S_LOGD(LOG_TYPE_FIXED, pdoIndex);
 
-  // PDO index need to be fixed type
-  if(SRC_SPRandEPRpdoArray[pdoIndex-1].fixed.type == 0){
-    // Now that we are in fix PDO mode
-    Serial.println("Type is fixed."); // DEBUG
+  // Note: For profile less than or equal to 3A power, CURRENT_SEL = 9 will not work.
+  return sendRDO(rdoData, PDO_FIXED);
+}
 
-    rdoData.REQMSG_Fields.PDO_INDEX = pdoIndex;  // Index 1
+/**
+ * @brief Request PPS voltage
+ * @param pdoIndex index 1
+ * @param target_voltage unit in mV
+ * @param max_current unit in mA
+ * @return 0 if the PDO cannot satisfy the request or the bus failed, see busStatus()
+ */
+bool AP33772S::setPPSPDO(int pdoIndex, int target_voltage, int max_current) 
+{
+  RDO_DATA_T rdoData;
 
-    // Serial.printf("You entered current: %dmA", max_current); //DEBUG
-    // Serial.println(SRC_SPRandEPRpdoArray[pdoIndex].fixed.current_max); //DEBUG
-    // Serial.println(currentMap(max_current)); //DEBUG
-    if(currentMap(max_current) > SRC_SPRandEPRpdoArray[pdoIndex-1].fixed.current_max) 
-    {
-      Serial.println("Current not in range."); // DEBUG
-      return; // Check if current setting is in range
-    }
+  if(!encodeRDO(PDO_PPS, pdoIndex, target_voltage, max_current, rdoData)) return 0;
+  AP33772S_LOGD(LOG_TYPE_PPS, pdoIndex);
 
-    rdoData.REQMSG_Fields.CURRENT_SEL = currentMap(max_current);
-    // Note: For profile less than or equal to 3A power, CURRENT_SEL = 9 will not work.
-    // rdoData.REQMSG_Fields.CURRENT_SEL = 9; 
-    writeBuf[0] = rdoData.byte0;  // Store the upper 8 bits
-    writeBuf[1] = rdoData.byte1;  // Store the lower 8 bits
-    i2c_write(AP33772S_ADDRESS, CMD_PD_REQMSG, 2);
-  }
-  return;
+  return sendRDO(rdoData, PDO_PPS);
 }
 
 /**
- * @brief Request PPS voltage
+ * @brief Request AVS voltage
  * @param pdoIndex index 1
  * @param target_voltage unit in mV
  * @param max_current unit in mA
- * @bug only work if min PPS voltage is 3.3V
+ * @return 0 if the PDO cannot satisfy the request or the bus failed, see busStatus()
  */
-void AP33772S::setPPSPDO(int pdoIndex, int target_voltage, int max_current) 
+bool AP33772S::setAVSPDO(int pdoIndex, int target_voltage, int max_current) 
 {
-  // cancelAVSTimer();
   RDO_DATA_T rdoData;
-  
-  int voltage_min_decoded;
-  // Sanity check include, check if the value is in EPR range (index < 8) and also AVS mode
-  if(pdoIndex < 8 && SRC_SPRandEPRpdoArray[pdoIndex-1].pps.type == 1)
-  {
-    Serial.println("Type is PPS."); // DEBUG
-    // Now that we are in PPS mode
 
-    rdoData.REQMSG_Fields.PDO_INDEX = pdoIndex;  // Index 1
+  if(!encodeRDO(PDO_AVS, pdoIndex, target_voltage, max_current, rdoData)) return 0;
+  AP33772S_LOGD(LOG_TYPE_AVS, pdoIndex);
 
-    if(currentMap(max_current) > SRC_SPRandEPRpdoArray[pdoIndex-1].pps.current_max) 
-    {
-      Serial.println("PPS Current not in range."); // DEBUG
-      return; // Check if current setting is in range
-    }
+  return sendRDO(rdoData, PDO_AVS);
+}
 
-    //Decode voltage_min
-    if(SRC_SPRandEPRpdoArray[pdoIndex-1].pps.voltage_min > 0) voltage_min_decoded = 3300;
+/**
+ * @brief Write an encoded RDO to PD_REQMSG and track the requested PDO
+ * @param kind PDO_KIND of the requested PDO
+ * @return 0 on a bus error, nothing is tracked then
+ */
+bool AP33772S::sendRDO(RDO_DATA_T rdoData, byte kind)
+{
+  byte buf[2] = {rdoData.byte0, rdoData.byte1}; // Lower 8 bits first
+  if(!i2c_write(CMD_PD_REQMSG, buf, 2)) return 0;
+  _activeIndex = rdoData.REQMSG_Fields.PDO_INDEX;
+  _lastRDO = (rdoData.byte1 << 8) | rdoData.byte0;
+  if(_boot.requestUs == 0 && _boot.pdoUs != 0) _boot.requestUs = micros() - _bootStart;
+  _negoPending = true;
+
+  // PPS/AVS contract must be refreshed by the sink, fixed does not need it
+  if(kind == PDO_FIXED) _keepaliveArmed = false;
+  else armKeepalive(rdoData);
+  return 1;
+}
 
-    if(target_voltage < voltage_min_decoded || 
-          target_voltage > SRC_SPRandEPRpdoArray[pdoIndex-1].pps.voltage_max*100 ) 
-    {
-      Serial.println("PPS Voltage not in range."); // DEBUG
-      return; // Check if current setting is in range
-    }
+/**
+ * @brief Check if a PDO can deliver the voltage and current
+ */
+bool AP33772S::pdoCovers(const PDO_CAP_T &cap, int target_voltage, int max_current)
+{
+  int current_sel = currentMap(max_current);
+  if(max_current <= 0 || current_sel < 0 || current_sel > cap.current_code) return 0;
+  return target_voltage >= cap.min_mV && target_voltage <= cap.max_mV;
+}
+
+/**
+ * @brief Pick the source PDO for a voltage/current, without touching the bus.
+ *        Keeps the PDO requested last if it still covers the target, so a voltage step
+ *        inside a PPS/AVS range does not switch PDO. Otherwise binary search the table
+ *        sorted by maximum voltage and take the first fit: a fixed PDO at exactly the
+ *        target, else the PPS/AVS range with the lowest maximum voltage.
+ * @param target_voltage unit in mV
+ * @param max_current unit in mA
+ * @return PDO index (index start at 1), -1 if no PDO fits
+ */
+int AP33772S::selectPDO(int target_voltage, int max_current)
+{
+  const PDO_CAP_T *active = getPDOCap(_activeIndex);
+  if(active != NULL && pdoCovers(*active, target_voltage, max_current)) return _activeIndex;
 
-    rdoData.REQMSG_Fields.VOLTAGE_SEL = target_voltage/100;  // Output Voltage in 200mV units
-    rdoData.REQMSG_Fields.CURRENT_SEL = currentMap(max_current);
+  // First entry whose maximum voltage reaches the target
+  int lo = 0, hi = _numPDO;
+  while(lo < hi)
+  {
+    int mid = (lo + hi) / 2;
+    if(_caps[_capOrder[mid] - 1].max_mV < target_voltage) lo = mid + 1;
+    else hi = mid;
+  }
 
-    writeBuf[0] = rdoData.byte0;  // Store the upper 8 bits
-    writeBuf[1] = rdoData.byte1;  // Store the lower 8 bits
-    i2c_write(AP33772S_ADDRESS, CMD_PD_REQMSG, 2);
+  int adjustable = -1;
+  for(int n = lo; n < _numPDO; n++)
+  {
+    const PDO_CAP_T &cap = _caps[_capOrder[n] - 1];
+    if(!pdoCovers(cap, target_voltage, max_current)) continue;
+    if(cap.kind == PDO_FIXED) return cap.index; // Exact fixed match needs no keepalive
+    if(adjustable < 0) adjustable = cap.index;
   }
-  return;
+  return adjustable;
 }
 
 /**
- * @brief Request AVS voltage
- * @param pdoIndex index 1
+ * @brief Request a voltage/current and let the library choose the fixed, PPS or AVS PDO
  * @param target_voltage unit in mV
  * @param max_current unit in mA
- * @bug only work if min AVS voltage is 15V, AVS max voltage is not capped at 30V
+ * @return PDO index requested (index start at 1), -1 if no PDO fits or the bus failed
  */
-void AP33772S::setAVSPDO(int pdoIndex, int target_voltage, int max_current) 
+int AP33772S::requestPower(int target_voltage, int max_current)
 {
-  // cancelAVSTimer();
+  int pdoIndex = selectPDO(target_voltage, max_current);
+  if(pdoIndex < 0) return -1;
 
+  byte kind = _caps[pdoIndex-1].kind;
   RDO_DATA_T rdoData;
+  if(!encodeRDO(kind, pdoIndex, target_voltage, max_current, rdoData)) return -1;
+  if(!sendRDO(rdoData, kind)) return -1;
+  return pdoIndex;
+}
 
-  int voltage_min_decoded;
-  // Sanity check include, check if the value is in EPR range (index >= 8) and also AVS mode
-  if(pdoIndex >= 8 && SRC_SPRandEPRpdoArray[pdoIndex-1].avs.type == 1)
-  {
-    Serial.println("Type is AVS."); // DEBUG
-    // Now that we are in AVS mode
-
-    //Decode voltage_min
-    if(SRC_SPRandEPRpdoArray[pdoIndex-1].avs.voltage_min > 0) voltage_min_decoded = 15000;
-
-    rdoData.REQMSG_Fields.PDO_INDEX = pdoIndex;  // Index 1
+/**
+ * @brief PDO requested last (index start at 1), 0 if none since begin()
+ */
+int AP33772S::getActivePDO()
+{
+  return _activeIndex;
+}
 
-    if(currentMap(max_current) > SRC_SPRandEPRpdoArray[pdoIndex-1].avs.current_max) 
-    {
-      Serial.println("AVS Current not in range."); // DEBUG
-      return; // Check if current setting is in range
-    }
+/**
+ * @brief Raw PD_REQMSG value sent last, to store and replay with requestRDO()
+ * @return RDO, lower byte first on the bus. 0 if nothing requested since begin()
+ */
+uint16_t AP33772S::getLastRDO()
+{
+  return _lastRDO;
+}
 
-    //Decode voltage_min
-    if(SRC_SPRandEPRpdoArray[pdoIndex-1].avs.voltage_min > 0) voltage_min_decoded = 15000;
+/**
+ * @brief Raw PD_REQMSG of the last request readMsgResult() reported as MSGRLT_SUCCESS,
+ *        the contract in place. Differs from getLastRDO() while a request is pending or
+ *        after the source rejected one.
+ * @return RDO, 0 if no request was seen accepted since begin()
+ */
+uint16_t AP33772S::getAcceptedRDO()
+{
+  return _acceptedRDO;
+}
 
-    if(target_voltage < voltage_min_decoded || 
-          target_voltage > SRC_SPRandEPRpdoArray[pdoIndex-1].avs.voltage_max*200 ) 
-    {
-      Serial.println("AVS Voltage not in range."); // DEBUG
-      return; // Check if current setting is in range
-    }
+/**
+ * @brief Send a raw RDO from getLastRDO(), checked against the capability table
+ * @param rdo PDO_INDEX, CURRENT_SEL and VOLTAGE_SEL as in PD_REQMSG
+ * @return 0 if the current source has no such PDO, it does not cover the request or the bus failed
+ */
+bool AP33772S::requestRDO(uint16_t rdo)
+{
+  RDO_DATA_T rdoData;
+  rdoData.data = 0;
+  rdoData.byte0 = rdo & 0xff;
+  rdoData.byte1 = rdo >> 8;
 
-    rdoData.REQMSG_Fields.VOLTAGE_SEL = target_voltage/200;  // Output Voltage in 200mV units
-    rdoData.REQMSG_Fields.CURRENT_SEL = currentMap(max_current);
+  const PDO_CAP_T *cap = getPDOCap(rdoData.REQMSG_Fields.PDO_INDEX);
+  if(cap == NULL || rdoData.REQMSG_Fields.CURRENT_SEL > cap->current_code) return 0;
+  if(cap->kind != PDO_FIXED)
+  {
+    int mV = rdoData.REQMSG_Fields.VOLTAGE_SEL * (cap->kind == PDO_PPS ? 100 : 200);
+    if(mV < cap->min_mV || mV > cap->max_mV) return 0;
+  }
+  return sendRDO(rdoData, cap->kind);
+}
 
-    writeBuf[0] = rdoData.byte0;  // Store the upper 8 bits
-    writeBuf[1] = rdoData.byte1;  // Store the lower 8 bits
-    i2c_write(AP33772S_ADDRESS, CMD_PD_REQMSG, 2);
+/**
+ * @brief Encode a request without sending it, for replay with requestRDO()
+ * @param target_voltage unit in mV
+ * @param max_current unit in mA
+ * @param pdoIndex PDO to use if it covers the request, else chosen as by selectPDO()
+ * @return raw RDO as getLastRDO() would report it, 0 if no PDO fits
+ */
+uint16_t AP33772S::encodePower(int target_voltage, int max_current, int pdoIndex)
+{
+  const PDO_CAP_T *cap = getPDOCap(pdoIndex);
+  if(cap == NULL || !pdoCovers(*cap, target_voltage, max_current)) pdoIndex = selectPDO(target_voltage, max_current);
+  if(pdoIndex < 0) return 0;
 
-    _indexAVS = rdoData.REQMSG_Fields.PDO_INDEX;
-    _voltageAVSbyte = rdoData.REQMSG_Fields.VOLTAGE_SEL; 
-    _currentAVSbyte = rdoData.REQMSG_Fields.CURRENT_SEL;
+  RDO_DATA_T rdoData;
+  if(!encodeRDO(_caps[pdoIndex-1].kind, pdoIndex, target_voltage, max_current, rdoData)) return 0;
+  return (rdoData.byte1 << 8) | rdoData.byte0;
+}
 
-    // Required to maintain AVS voltage negotiation.
-    // setupAVSTimer();
+/**
+ * @brief FNV-1a hash of the raw SRCPDO bytes read by begin(), identifies a charger
+ */
+uint32_t AP33772S::pdoHash()
+{
+  byte raw[SRCPDO_LENGTH];
+  getRawPDOs(raw);
+  uint32_t hash = 2166136261UL;
+  for(byte i = 0; i < SRCPDO_LENGTH; i++)
+  {
+    hash ^= raw[i];
+    hash *= 16777619UL;
   }
-  return;
+  return hash;
 }
 
-// void AP33772S::timerISR1()
-// {
-//   // Clear the alarm irq
-//   hw_clear_bits(&timer_hw->intr, 1u << ALARM_NUM1);
-
-//   // Reset the alarm register
-//   timer_hw->alarm[ALARM_NUM1] = timer_hw->timerawl + DELAY1;
-
-//   RDO_DATA_T rdoData;
-//   rdoData.REQMSG_Fields.PDO_INDEX = _indexAVS;
-//   rdoData.REQMSG_Fields.VOLTAGE_SEL = _voltageAVSbyte;
-//   rdoData.REQMSG_Fields.CURRENT_SEL = _currentAVSbyte;
+/**
+ * @brief Copy of the SRCPDO bytes read by begin()
+ * @param raw SRCPDO_LENGTH bytes, in register order
+ */
+void AP33772S::getRawPDOs(byte *raw)
+{
+  for(byte i = 0; i < MAX_PDO_ENTRIES; i++)
+  {
+    raw[2 * i] = SRC_SPRandEPRpdoArray[i].byte0;
+    raw[2 * i + 1] = SRC_SPRandEPRpdoArray[i].byte1;
+  }
+}
 
-//   // Trying to call non static function/variable
-//   // TODO Check scope if keep spawning too many object
-//   writeBuf[0] = rdoData.byte0;  // Store the upper 8 bits
-//   writeBuf[1] = rdoData.byte1;  // Store the lower 8 bits
-//   i2c_write(AP33772S_ADDRESS, CMD_PD_REQMSG, 2);
-// }
+/**
+ * @brief Set how often the last PPS/AVS request is resent by service()/poll().
+ *        Some chargers drop the contract if no request arrives within 1s.
+ * @param period_ms resend period in ms, 0 to disable
+ */
+void AP33772S::setKeepalive(unsigned long period_ms)
+{
+  _keepalivePeriod = period_ms;
+}
 
-// void AP33772S::setupAVSTimer()
-// {
-//   // Set up 0.5s timer using timer1
-//   hw_set_bits(&timer_hw->inte, 1u << ALARM_NUM1);
-//   // Associate an interrupt handler with the ALARM_IRQ
-//   irq_set_exclusive_handler(ALARM_IRQ1, timerISR1);
-//   // Enable the alarm interrupt
-//   irq_set_enabled(ALARM_IRQ1, true);
-//   // Write the lower 32 bits of the target time to the alarm register, arming it.
-//   timer_hw->alarm[ALARM_NUM1] = timer_hw->timerawl + DELAY1;
-// }
+/**
+ * @brief Remember the RDO bytes just sent so the keepalive can resend them verbatim
+ */
+void AP33772S::armKeepalive(RDO_DATA_T rdo)
+{
+  _keepaliveRDO[0] = rdo.byte0;
+  _keepaliveRDO[1] = rdo.byte1;
+  _keepaliveLast = millis();
+  _keepaliveArmed = true;
+}
 
-// void AP33772S::cancelAVSTimer()
-// {
-//   hw_clear_bits(&timer_hw->inte, 1u << ALARM_NUM1); // Disable alarm interrupt
-//   hw_set_bits(&timer_hw->intr, 1u << ALARM_NUM1);   // Clear pending interrupt
-// }
+/**
+ * @brief Resend the stored RDO if the period elapsed. Raw two byte write,
+ *        no validation or logging. A failed resend is tried again on the next call.
+ * @param now current time in ms
+ */
+void AP33772S::serviceKeepalive(unsigned long now)
+{
+  if(!_keepaliveArmed || _keepalivePeriod == 0) return;
+  if(now - _keepaliveLast < _keepalivePeriod) return;
 
+  if(i2c_write(CMD_PD_REQMSG, _keepaliveRDO, 2)) _keepaliveLast = now;
+}
 
 /**
  * @brief Set resistance value of 10K NTC at 25C, 50C, 75C and 100C.
  *          Default is 10000, 4161, 1928, 974Ohm
  * @param TR25, TR50, TR75, TR100 unit in Ohm
- * @attention Blocking function due to long I2C write, min blocking time 15ms
+ * @return 1 if all four registers read back as written, 0 without writing if a value
+ *         does not fit 16 bits
+ * @attention Same as setNTC(NTC_T), blocks 15ms only if the burst write does not verify
  */
-void AP33772S::setNTC(int TR25, int TR50, int TR75, int TR100)
+bool AP33772S::setNTC(int TR25, int TR50, int TR75, int TR100)
 {
-  writeBuf[0] = TR25 & 0xff;
-  writeBuf[1] = (TR25 >> 8) & 0xff;
-  i2c_write(AP33772S_ADDRESS, CMD_TR25, 2);
+  int values[4] = {TR25, TR50, TR75, TR100};
+  for(byte i = 0; i < 4; i++)
+    if(values[i] < 0 || values[i] > 0xffff) return 0;
+  NTC_T ntc = {(uint16_t)TR25, (uint16_t)TR50, (uint16_t)TR75, (uint16_t)TR100};
+  return setNTC(ntc);
+}
+
+/**
+ * @brief Write TR25..TR100 in one 8-byte auto-increment burst and read them back.
+ *        If the chip did not take the burst, falls back to one register at a time
+ *        with 5ms gaps, the sequence setNTC() always used before.
+ * @param &ntc resistances in Ohm, ntcFromBeta()/ntcFromSteinhartHart() build them
+ * @return 1 if all four registers read back as written
+ */
+bool AP33772S::setNTC(const NTC_T &ntc)
+{
+  if(writeNTCBurst(ntc)) return 1;
+
+  if(!writeNTC(CMD_TR25, ntc.tr25)) return 0;
   delay(5);
-  writeBuf[0] = TR50 & 0xff;
-  writeBuf[1] = (TR50 >> 8) & 0xff;
-  i2c_write(AP33772S_ADDRESS, CMD_TR50, 2);
+  if(!writeNTC(CMD_TR50, ntc.tr50)) return 0;
   delay(5);
-  writeBuf[0] = TR75 & 0xff;
-  writeBuf[1] = (TR75 >> 8) & 0xff;
-  i2c_write(AP33772S_ADDRESS, CMD_TR75, 2);
+  if(!writeNTC(CMD_TR75, ntc.tr75)) return 0;
   delay(5);
-  writeBuf[0] = TR100 & 0xff;
-  writeBuf[1] = (TR100 >> 8) & 0xff;
-  i2c_write(AP33772S_ADDRESS, CMD_TR100, 2);
+  if(!writeNTC(CMD_TR100, ntc.tr100)) return 0;
+
+  NTC_T check;
+  return readNTC(check) && memcmp(&check, &ntc, sizeof(NTC_T)) == 0;
+}
+
+/**
+ * @brief Read TR25..TR100 in one burst
+ * @param &ntc receives the resistances in Ohm
+ * @return 0 on a bus error
+ */
+bool AP33772S::readNTC(NTC_T &ntc)
+{
+  byte buf[NTC_LENGTH];
+  if(!i2c_read(CMD_TR25, buf, NTC_LENGTH)) return 0;
+  ntc.tr25 = buf[0] | (buf[1] << 8);
+  ntc.tr50 = buf[2] | (buf[3] << 8);
+  ntc.tr75 = buf[4] | (buf[5] << 8);
+  ntc.tr100 = buf[6] | (buf[7] << 8);
+  return 1;
+}
+
+/**
+ * @brief One burst write of TR25..TR100 followed by one burst read-back
+ * @return 1 if the read-back matches
+ */
+bool AP33772S::writeNTCBurst(const NTC_T &ntc)
+{
+  const uint16_t values[4] = {ntc.tr25, ntc.tr50, ntc.tr75, ntc.tr100};
+  byte buf[NTC_LENGTH];
+  for(byte i = 0; i < 4; i++)
+  {
+    buf[2 * i] = values[i] & 0xff; // R_TR25 .. R_TR100 layout, little endian
+    buf[2 * i + 1] = values[i] >> 8;
+  }
+  if(!i2c_write(CMD_TR25, buf, NTC_LENGTH)) return 0;
+
+  byte check[NTC_LENGTH];
+  return i2c_read(CMD_TR25, check, NTC_LENGTH) && memcmp(buf, check, NTC_LENGTH) == 0;
+}
+
+/**
+ * @brief Write one 16 bits TRxx register
+ * @param cmdAddr CMD_TR25 .. CMD_TR100
+ * @param value resistance in Ohm
+ * @return 0 on a bus error
+ */
+bool AP33772S::writeNTC(byte cmdAddr, int value)
+{
+  byte buf[2] = {(byte)(value & 0xff), (byte)((value >> 8) & 0xff)}; // R_TR25 .. R_TR100 layout
+  return i2c_write(cmdAddr, buf, R_TR25::width);
 }
 
 /**
  * @brief Read NTC temperature
- * @return tempearture in C
+ * @return tempearture in C, -1 on a bus error
  */
 int AP33772S::readTemp()
 {
-    i2c_read(AP33772S_ADDRESS, CMD_TEMP, 1);
-    return readBuf[0]; // I2C read return 1C/LSB
+  return read<R_TEMP>().value;
 }
 
 /**
  * @brief Read VBUS voltage
- * @return voltage in mV
+ * @return voltage in mV, -1 on a bus error
  */
 int AP33772S::readVoltage()
 {
-    i2c_read(AP33772S_ADDRESS, CMD_VOLTAGE, 2);
-    return ((readBuf[1] << 8) | readBuf[0]) * 80; // I2C read return 80mV/LSB
+  return read<R_VOLTAGE>().value;
 }
 
 /**
  * @brief Read VBUS current
- * @return current in mA
+ * @return current in mA, -1 on a bus error
  */
 int AP33772S::readCurrent()
 {
-    i2c_read(AP33772S_ADDRESS, CMD_CURRENT, 1);
-    return readBuf[0] * 24; // I2C read return 24mA/LSB
+  return read<R_CURRENT>().value;
+}
+
+/**
+ * @brief Read VOLTAGE, CURRENT, TEMP, VREQ and IREQ in one auto-increment burst
+ *        starting at CMD_VOLTAGE. One transaction instead of five.
+ * @return decoded snapshot, units as in readVoltage() .. readIREQ(), every field -1 on a bus error
+ */
+TELEMETRY_T AP33772S::readTelemetry()
+{
+    TELEMETRY_T telemetry;
+    if(!readTelemetry(telemetry))
+        telemetry.voltage = telemetry.current = telemetry.temp = telemetry.vreq = telemetry.ireq = -1;
+    return telemetry;
+}
+
+/**
+ * @brief readTelemetry() that leaves the snapshot untouched on a bus error
+ * @param &telemetry receives the decoded snapshot
+ * @return 0 on a bus error
+ */
+bool AP33772S::readTelemetry(TELEMETRY_T &telemetry)
+{
+    byte buf[TELEMETRY_LENGTH];
+    if(!i2c_read(CMD_VOLTAGE, buf, TELEMETRY_LENGTH)) return 0;
+    notifySample(buf);
+    telemetry.voltage = R_VOLTAGE::decode((buf[1] << 8) | buf[0]).value;
+    telemetry.current = R_CURRENT::decode(buf[2]).value;
+    telemetry.temp = R_TEMP::decode(buf[3]).value;
+    telemetry.vreq = R_VREQ::decode((buf[5] << 8) | buf[4]).value;
+    telemetry.ireq = R_IREQ::decode((buf[7] << 8) | buf[6]).value;
+    return 1;
+}
+
+/**
+ * @brief Burst read VOLTAGE, CURRENT and TEMP as raw register values, one transaction
+ * @param &sample receives the raw values, t_us is left untouched, all of it on a bus error
+ * @return 1 if all registers were read
+ */
+bool AP33772S::readSample(SAMPLE_RAW_T &sample)
+{
+    byte buf[SAMPLE_LENGTH];
+    if(!i2c_read(CMD_VOLTAGE, buf, SAMPLE_LENGTH)) return 0;
+    sample.voltage = (buf[1] << 8) | buf[0];
+    sample.current = buf[2];
+    sample.temp = buf[3];
+    notifySample(buf);
+    return 1;
+}
+
+/**
+ * @brief Register an observer for the VOLTAGE/CURRENT/TEMP bursts readSample() and
+ *        readTelemetry() already do, so accounting can ride on them without extra
+ *        bus traffic. One observer, NULL removes it.
+ * @param hook called from the reading context, keep it short
+ * @param context passed back to hook
+ */
+void AP33772S::setSampleHook(AP33772S_SAMPLE_HOOK hook, void *context)
+{
+    _sampleHook = hook;
+    _sampleContext = context;
+}
+
+void AP33772S::notifySample(const byte *buf)
+{
+    if(_sampleHook == NULL) return;
+    SAMPLE_RAW_T sample;
+    sample.t_us = micros();
+    sample.voltage = (buf[1] << 8) | buf[0];
+    sample.current = buf[2];
+    sample.temp = buf[3];
+    _sampleHook(_sampleContext, sample);
 }
 
 /**
  * @brief Read VREQ The latest requested voltage negotiated with the source
- * @return voltage in mV
+ * @return voltage in mV, -1 on a bus error
  */
 int AP33772S::readVREQ()
 {
-    i2c_read(AP33772S_ADDRESS, CMD_VREQ, 1);
-    return readBuf[0] * 50; // I2C read return 50mV/LSB
+  return read<R_VREQ>().value; // 16 bits, 50mV/LSB
 }
 
 /**
- * @brief Read IREQ The latest requested voltage negotiated with the source
- * @return current in mA
+ * @brief Read IREQ The latest requested current negotiated with the source
+ * @return current in mA, -1 on a bus error
  */
 int AP33772S::readIREQ()
 {
-    i2c_read(AP33772S_ADDRESS, CMD_IREQ, 1);
-    return readBuf[0] * 10; // I2C read return 10mA/LSB
+  return read<R_IREQ>().value; // 16 bits, 10mA/LSB
 }
 
 /**
  * @brief Read VSELMIN register. The Minimum Selection Voltage
- * @return voltage in mV
+ * @return voltage in mV, -1 on a bus error
  */
 int AP33772S::readVSELMIN()
 {
-  i2c_read(AP33772S_ADDRESS, CMD_VSELMIN, 1);
-  return readBuf[0] * 200; // I2C read return 200mV/LSB
+  return read<R_VSELMIN>().value;
 }
 
 /**
  * @brief Set VSELMIN register. The Minimum Selection Voltage
- * @param voltage in mV
+ * @param voltage in mV, 200mV/LSB. Out of range values are ignored.
+ * @return 0 if out of range or the bus failed
  */
-void AP33772S::setVSELMIN(int voltage)
+bool AP33772S::setVSELMIN(int voltage)
 {
-  writeBuf[0] = voltage/200; // 200mV/LSB
-  i2c_write(AP33772S_ADDRESS, CMD_VSELMIN, 1);
+  return write<R_VSELMIN>(MILLIVOLT_T(voltage));
 }
 
 /**
@@ -442,96 +809,366 @@ void AP33772S::setVSELMIN(int voltage)
  */
 int AP33772S::readUVPTHR()
 {
-  i2c_read(AP33772S_ADDRESS, CMD_UVPTHR, 1);
-  switch(readBuf[0])
-  {
-    case 1:
-      return 80;
-    case 2:
-      return 75;
-    case 3:
-      return 70;
-  }
-  return -1;
+  return read<R_UVPTHR>().value;
 }
 
 /**
  * @brief Set UVP Threshold, percentage(%) of VREQ
- * @param value percentage. If 80% then value = 80
+ * @param value percentage. If 80% then value = 80. Only 80, 75 and 70 are accepted.
+ * @return 0 if not accepted or the bus failed
  */
-void AP33772S::setUVPTHR(int value)
+bool AP33772S::setUVPTHR(int value)
 {
-  if(value >= 70 && value <= 80)
-  {
-    switch(value)
-    {
-      case 80:
-        writeBuf[0] = 1;
-        break;
-      case 75:
-        writeBuf[0] = 2;
-        break;
-      case 70:
-        writeBuf[0] = 3;
-        break;
-      default:
-        return; // Error
-    }
-  }
-  else return;
+  return write<R_UVPTHR>(PERCENT_T(value));
 }
 
 /**
  * @brief Read OVP Threshold Voltage is the VREQ voltage plus OVPTHR offset voltage (mV)
- * @return voltage in mV
+ * @return voltage in mV, -1 on a bus error
  */
 int AP33772S::readOVPTHR()
 {
-  i2c_read(AP33772S_ADDRESS, CMD_OVPTHR, 1);
-  return readBuf[0] * 80; // I2C read return 80mV/LSB
+  return read<R_OVPTHR>().value;
 }
 
 /**
  * @brief Set OVP Threshold Voltage is the VREQ voltage plus OVPTHR offset voltage (mV)
- * @param voltage in mV
+ * @param voltage in mV, 80mV/LSB. Out of range values are ignored.
+ * @return 0 if out of range or the bus failed
  */
-void AP33772S::setOVPTHR(int value)
+bool AP33772S::setOVPTHR(int value)
 {
-  writeBuf[0] = value/80; //80mV/LSB
-  i2c_write(AP33772S_ADDRESS, CMD_OVPTHR, 1);
+  return write<R_OVPTHR>(MILLIVOLT_T(value));
 }
 
 int AP33772S::readOCPTHR()
 {
-  i2c_read(AP33772S_ADDRESS, CMD_OCPTHR, 1);
-  return readBuf[0] * 50; // I2C read return 50mA/LSB
+  return read<R_OCPTHR>().value; // 50mA/LSB
 }
-void AP33772S::setOCPTHR(int value)
+bool AP33772S::setOCPTHR(int value)
 {
-  writeBuf[0] = value/50; // 50mA/LSB
-  i2c_write(AP33772S_ADDRESS, CMD_OCPTHR, 1);
+  return write<R_OCPTHR>(MILLIAMP_T(value));
 }
 int AP33772S::readOTPTHR()
 {
-  i2c_read(AP33772S_ADDRESS, CMD_OTPTHR, 1);
-  return readBuf[0]; // I2C read return 1C/LSB
+  return read<R_OTPTHR>().value; // 1C/LSB
 }
-void AP33772S::setOTPTHR(int value)
+bool AP33772S::setOTPTHR(int value)
 {
-  writeBuf[0] = value; // 1C/LSB
-  i2c_write(AP33772S_ADDRESS, CMD_OTPTHR, 1);
+  return write<R_OTPTHR>(CELSIUS_T(value));
 }
 int AP33772S::readDRTHR()
 {
-  i2c_read(AP33772S_ADDRESS, CMD_DRTHR, 1);
-  return readBuf[0]; // I2C read return 1C/LSB
+  return read<R_DRTHR>().value; // 1C/LSB
+}
+bool AP33772S::setDRTHR(int value)
+{
+  return write<R_DRTHR>(CELSIUS_T(value));
+}
+
+
+/**
+ * @brief Write VSELMIN..DRTHR in one auto-increment burst and read them back in one burst.
+ *        Nothing is written if any field is out of range, so the chip never runs with
+ *        part of an old and part of a new profile set by separate transactions.
+ * @param &profile thresholds, units as in PROTECTION_PROFILE_T
+ * @return 1 if every register reads back as written
+ */
+bool AP33772S::applyProtection(const PROTECTION_PROFILE_T &profile)
+{
+  if(!R_VSELMIN::valid(profile.vselmin) || !R_UVPTHR::valid(profile.uvp) ||
+     !R_OVPTHR::valid(profile.ovp) || !R_OCPTHR::valid(profile.ocp) ||
+     !R_OTPTHR::valid(profile.otp) || !R_DRTHR::valid(profile.derating)) return 0;
+
+  byte buf[CONFIG_LENGTH];
+  buf[CMD_VSELMIN - CMD_VSELMIN] = R_VSELMIN::encode(MILLIVOLT_T(profile.vselmin));
+  buf[CMD_UVPTHR - CMD_VSELMIN] = R_UVPTHR::encode(PERCENT_T(profile.uvp));
+  buf[CMD_OVPTHR - CMD_VSELMIN] = R_OVPTHR::encode(MILLIVOLT_T(profile.ovp));
+  buf[CMD_OCPTHR - CMD_VSELMIN] = R_OCPTHR::encode(MILLIAMP_T(profile.ocp));
+  buf[CMD_OTPTHR - CMD_VSELMIN] = R_OTPTHR::encode(CELSIUS_T(profile.otp));
+  buf[CMD_DRTHR - CMD_VSELMIN] = R_DRTHR::encode(CELSIUS_T(profile.derating));
+  if(!i2c_write(CMD_VSELMIN, buf, CONFIG_LENGTH))
+  {
+    _configValid = false; // Part of the burst may have landed
+    return 0;
+  }
+
+  // Verify, and leave the cache holding what the chip really has
+  if(!i2c_read(CMD_VSELMIN, _config, CONFIG_LENGTH))
+  {
+    _configValid = false;
+    return 0;
+  }
+  _configValid = true;
+  return memcmp(buf, _config, CONFIG_LENGTH) == 0;
+}
+
+/**
+ * @brief Read VSELMIN..DRTHR in one burst, or from the shadow cache when enabled
+ * @param &profile receives the thresholds
+ * @return 1 if read, 0 on a bus error or an unknown UVPTHR code
+ */
+bool AP33772S::readProtection(PROTECTION_PROFILE_T &profile)
+{
+  if(!_configCache || !_configValid)
+  {
+    if(!i2c_read(CMD_VSELMIN, _config, CONFIG_LENGTH)) return 0;
+    _configValid = _configCache;
+  }
+  profile.vselmin = R_VSELMIN::decode(_config[CMD_VSELMIN - CMD_VSELMIN]).value;
+  profile.uvp = R_UVPTHR::decode(_config[CMD_UVPTHR - CMD_VSELMIN]).value;
+  profile.ovp = R_OVPTHR::decode(_config[CMD_OVPTHR - CMD_VSELMIN]).value;
+  profile.ocp = R_OCPTHR::decode(_config[CMD_OCPTHR - CMD_VSELMIN]).value;
+  profile.otp = R_OTPTHR::decode(_config[CMD_OTPTHR - CMD_VSELMIN]).value;
+  profile.derating = R_DRTHR::decode(_config[CMD_DRTHR - CMD_VSELMIN]).value;
+  return profile.uvp >= 0;
+}
+
+/**
+ * @brief Read PD_MSGRLT, result of the last PD_REQMSG request
+ * @return MSGRLT_BUSY, MSGRLT_SUCCESS, MSGRLT_INVALID, MSGRLT_UNSUPPORTED or MSGRLT_FAIL.
+ *         MSGRLT_BUSY on a bus error, so the caller asks again.
+ */
+byte AP33772S::readMsgResult()
+{
+  byte result;
+  if(!i2c_read(CMD_PD_MSGRLT, &result, 1)) return MSGRLT_BUSY;
+  result &= 0x0f;
+  if(result == MSGRLT_SUCCESS) _acceptedRDO = _lastRDO;
+  if(result == MSGRLT_SUCCESS && _boot.requestUs != 0 && _boot.powerUs == 0)
+    _boot.powerUs = micros() - _bootStart;
+  return result;
+}
+
+/**
+ * @brief Read STATUS register. Reading clears it on the chip.
+ *        STARTED or NEWPDO means the chip restarted negotiation, which drops the config cache.
+ * @return STATUS byte, see AP33772_MASK. 0 on a bus error, check busStatus() to tell.
+ */
+byte AP33772S::readStatus()
+{
+  byte status;
+  if(!i2c_read(CMD_STATUS, &status, 1)) return 0;
+  if(status & (STARTED_MSK | NEWPDO_MSK)) invalidateConfigCache();
+  return status;
+}
+
+/**
+ * @brief Enable interrupt source in CMD_MASK, INT pin goes high when it is raised
+ * @param flag one or more AP33772_MASK bits
+ * @return 0 on a bus error, MASK is not written if it could not be read
+ */
+bool AP33772S::setMask(AP33772_MASK flag)
+{
+  byte mask;
+  if(!i2c_read(CMD_MASK, &mask, 1)) return 0;
+  mask |= flag;
+  return i2c_write(CMD_MASK, &mask, 1);
+}
+
+/**
+ * @brief Disable interrupt source in CMD_MASK
+ * @param flag one or more AP33772_MASK bits
+ * @return 0 on a bus error, MASK is not written if it could not be read
+ */
+bool AP33772S::clearMask(AP33772_MASK flag)
+{
+  byte mask;
+  if(!i2c_read(CMD_MASK, &mask, 1)) return 0;
+  mask &= ~flag;
+  return i2c_write(CMD_MASK, &mask, 1);
+}
+
+/**
+ * @brief Watch the INT pin level from service() when it cannot be wired to an interrupt.
+ *        Costs a digitalRead() per call and no I2C traffic while INT is low.
+ * @param pin Arduino pin connected to INT, INT_PIN_NONE to stop watching
+ */
+void AP33772S::setIntPin(uint8_t pin)
+{
+  _intPin = pin;
+  if(pin != INT_PIN_NONE) pinMode(pin, INPUT);
+}
+
+/**
+ * @brief Call from the INT pin ISR (RISING). Only sets a flag, service() does the I2C.
+ */
+void AP33772S::handleInterrupt()
+{
+  _intPending = true;
+}
+
+/**
+ * @brief Read STATUS once and queue the decoded events. After a request, READY is
+ *        followed by one PD_MSGRLT read to report negotiation success or failure.
+ */
+void AP33772S::serviceEvents()
+{
+  _intPending = false; // Clear first so an edge during the read is not lost
+  byte status = readStatus();
+  if(busStatus() != BUS_OK) _intPending = true; // STATUS unread, INT stays high without a new edge
+  else handleStatus(status);
+}
+
+/**
+ * @brief Turn STATUS bits into events and flags, STATUS is clear-on-read so every
+ *        read of it has to come through here
+ */
+void AP33772S::handleStatus(byte status)
+{
+  if(status & STARTED_MSK) pushEvent(EVENT_STARTED);
+  if(status & NEWPDO_MSK) pushEvent(EVENT_NEWPDO);
+  if(status & UVP_MSK) pushEvent(EVENT_UVP);
+  if(status & OVP_MSK)
+  {
+    event_flag.ovp = 1;
+    pushEvent(EVENT_OVP);
+  }
+  if(status & OCP_MSK)
+  {
+    event_flag.ocp = 1;
+    pushEvent(EVENT_OCP);
+  }
+  if(status & OTP_MSK)
+  {
+    event_flag.otp = 1;
+    pushEvent(EVENT_OTP);
+  }
+  if(status & READY_MSK)
+  {
+    pushEvent(EVENT_READY);
+    if(_negoPending)
+    {
+      byte result = readMsgResult();
+      if(result == MSGRLT_SUCCESS)
+      {
+        event_flag.newNegoSuccess = 1;
+        event_flag.negoSuccess = 1;
+        event_flag.negoFail = 0;
+        pushEvent(EVENT_NEGO_SUCCESS);
+      }
+      else if(result != MSGRLT_BUSY)
+      {
+        event_flag.newNegoFail = 1;
+        event_flag.negoFail = 1;
+        event_flag.negoSuccess = 0;
+        pushEvent(EVENT_NEGO_FAIL);
+      }
+      _negoPending = result == MSGRLT_BUSY;
+    }
+  }
+}
+
+void AP33772S::pushEvent(AP33772S_EVENT event)
+{
+  byte next = (_eventHead + 1) & (EVENT_QUEUE_LENGTH - 1);
+  if(next == _eventTail)
+  {
+    _eventsDropped++;
+    return;
+  }
+  _eventQueue[_eventHead] = event;
+  _eventHead = next; // Publish after the slot is written
+}
+
+/**
+ * @brief Take the oldest queued event. Safe to call from another context than service().
+ * @return 0 if there is no event
+ */
+bool AP33772S::getEvent(AP33772S_EVENT &event)
+{
+  if(_eventTail == _eventHead) return 0;
+  event = (AP33772S_EVENT)_eventQueue[_eventTail];
+  _eventTail = (_eventTail + 1) & (EVENT_QUEUE_LENGTH - 1);
+  return 1;
+}
+
+/**
+ * @brief Accumulated negotiation/protection flags since the last call, then clear them
+ */
+EVENT_FLAG_T AP33772S::getEventFlags()
+{
+  EVENT_FLAG_T flags = event_flag;
+  event_flag.newNegoSuccess = 0;
+  event_flag.newNegoFail = 0;
+  event_flag.ovp = 0;
+  event_flag.ocp = 0;
+  event_flag.otp = 0;
+  return flags;
+}
+
+/**
+ * @brief Number of events lost because getEvent() was not called often enough
+ */
+unsigned int AP33772S::eventsDropped()
+{
+  return _eventsDropped;
+}
+
+/**
+ * @brief Enable shadow cache of VSELMIN..DRTHR. Config reads then cost no I2C traffic
+ *        and set* functions write through. Filled in begin() or on first read.
+ * @param enable true to cache, false to always read from the chip
+ */
+void AP33772S::setConfigCache(bool enable)
+{
+  _configCache = enable;
+  _configValid = false;
+}
+
+/**
+ * @brief Drop the shadow cache, next config read refetches all six registers in one burst
+ */
+void AP33772S::invalidateConfigCache()
+{
+  _configValid = false;
+}
+
+/**
+ * @brief Number of PDO offered by the source
+ */
+int AP33772S::getNumPDO()
+{
+  return _numPDO;
+}
+
+/**
+ * @brief Number of PPS profiles offered by the source
+ */
+int AP33772S::getPPSCount()
+{
+  return _numPPS;
 }
-void AP33772S::setDRTHR(int value)
+
+/**
+ * @brief Number of AVS profiles offered by the source
+ */
+int AP33772S::getAVSCount()
 {
-  writeBuf[0] = value; // 1C/LSB
-  i2c_write(AP33772S_ADDRESS, CMD_DRTHR, 1);
+  return _numAVS;
 }
 
+/**
+ * @brief Get the n-th PPS profile index (index start at 1), in PDO order
+ * @param n 0 to getPPSCount()-1
+ * @return indexPPS, -1 if out of range
+ */
+int AP33772S::getPPSIndex(int n)
+{
+  if(n < 0 || n >= _numPPS) return -1;
+  return _ppsList[n];
+}
+
+/**
+ * @brief Get the n-th AVS profile index (index start at 1), in PDO order
+ * @param n 0 to getAVSCount()-1
+ * @return indexAVS, -1 if out of range
+ */
+int AP33772S::getAVSIndex(int n)
+{
+  if(n < 0 || n >= _numAVS) return -1;
+  return _avsList[n];
+}
 
 /**
  * @brief Get internal PPS profile index (index start at 1)
@@ -593,6 +1230,50 @@ void AP33772S::displayEPRVoltageMin(unsigned int current_max) {
   }
 }
 
+/**
+ * @brief Burst read VSELMIN..DRTHR into the shadow cache
+ * @return 0 on a bus error, the cache stays invalid
+ */
+bool AP33772S::fillConfigCache()
+{
+  _configValid = i2c_read(CMD_VSELMIN, _config, CONFIG_LENGTH);
+  return _configValid;
+}
+
+/**
+ * @brief Read one config register, from the shadow cache when enabled
+ * @param cmdAddr CMD_VSELMIN .. CMD_DRTHR
+ * @param &value receives the raw register value
+ * @return 0 on a bus error
+ */
+bool AP33772S::readConfig(byte cmdAddr, byte &value)
+{
+  if(_configCache)
+  {
+    if(!_configValid && !fillConfigCache()) return 0;
+    value = _config[cmdAddr - CMD_VSELMIN];
+    return 1;
+  }
+  return i2c_read(cmdAddr, &value, 1);
+}
+
+/**
+ * @brief Write one config register and keep the shadow cache in step
+ * @param cmdAddr CMD_VSELMIN .. CMD_DRTHR
+ * @param value raw register value
+ * @return 0 on a bus error, the cache is dropped then
+ */
+bool AP33772S::writeConfig(byte cmdAddr, byte value)
+{
+  if(!i2c_write(cmdAddr, &value, 1))
+  {
+    _configValid = false;
+    return 0;
+  }
+  if(_configValid) _config[cmdAddr - CMD_VSELMIN] = value;
+  return 1;
+}
+
 /**
  * @brief take in current in mA unit
  * @return value from 0 to 15
@@ -610,8 +1291,14 @@ int AP33772S::currentMap(int current)
       return 0;
   }
 
+  // 5A and above is the last code, 4.50A ~ 4.99A shares code 14
+  if (current >= 5000) {
+      return 15;
+  }
+
   // Calculate the result for ranges above 1250
-  return ((current - 1250) / 250) + 1;
+  int result = ((current - 1250) / 250) + 1;
+  return result > 14 ? 14 : result;
 }
 
 void AP33772S::displayCurrentRange(unsigned int current_max) {
@@ -686,19 +1373,22 @@ signed char i=ZeroPadding;
 /**
  * @brief Turn on/off the NMOS switch
  * @param flag 0 or 1 for OFF/ON
- * @return 1 if flag make sense
+ * @return 1 if flag make sense and the chip took it
  * @bug can add code to check Vout voltage to ensure on or off, worry about settle time required for VOUT
  */
 bool AP33772S::setOutput(uint8_t flag){
+    byte value;
     switch(flag){
         case 0:
-            writeBuf[0] = 0b00010001; //turn off
-            i2c_write(AP33772S_ADDRESS, CMD_SYSTEM, 1);
+            value = 0b00010001; //turn off
+            if(!i2c_write(CMD_SYSTEM, &value, 1)) return 0;
+            _output = false;
             return 1;
             break; //Sanity
         case 1:
-            writeBuf[0] = 0b00010010; //turn on
-            i2c_write(AP33772S_ADDRESS, CMD_SYSTEM, 1);
+            value = 0b00010010; //turn on
+            if(!i2c_write(CMD_SYSTEM, &value, 1)) return 0;
+            _output = true;
             return 1;
             break; //Sanity
         default:
@@ -706,41 +1396,342 @@ bool AP33772S::setOutput(uint8_t flag){
     }
 }
 
+/**
+ * @brief Start a non-blocking begin(). Advance it with service()/poll(), one STATUS
+ *        read per BOOT_POLL ms until NEWPDO.
+ * @param timeout_ms as for begin()
+ * @return 0 if another operation is still busy
+ */
+bool AP33772S::beginAsync(unsigned long timeout_ms)
+{
+    if(_opStatus == OP_BUSY) return 0;
+    applyBusTimeout();
+    startOp(OP_BEGIN);
+    startBoot(timeout_ms);
+    _opWakeAt = millis();
+    return 1;
+}
+
+/**
+ * @brief Start a non-blocking setNTC(). The first service() call does the burst write,
+ *        and only if that does not verify are the 5ms gaps between TRxx writes
+ *        served by service()/poll() instead of delay(). Like setNTC(), the fallback
+ *        reads TR25..TR100 back and opStatus() reports OP_ERROR on a mismatch.
+ * @param TR25, TR50, TR75, TR100 unit in Ohm
+ * @return 0 if another operation is still busy or a value does not fit 16 bits
+ */
+bool AP33772S::setNTCAsync(int TR25, int TR50, int TR75, int TR100)
+{
+    if(_opStatus == OP_BUSY) return 0;
+    int values[4] = {TR25, TR50, TR75, TR100};
+    for(byte i = 0; i < 4; i++)
+        if(values[i] < 0 || values[i] > 0xffff) return 0;
+    _opNTC.tr25 = TR25;
+    _opNTC.tr50 = TR50;
+    _opNTC.tr75 = TR75;
+    _opNTC.tr100 = TR100;
+    startOp(OP_NTC);
+    _opWakeAt = millis();
+    return 1;
+}
+
+/**
+ * @brief Start a non-blocking output switch
+ * @param flag 0 or 1 for OFF/ON
+ * @return 0 if another operation is still busy or flag does not make sense
+ */
+bool AP33772S::setOutputAsync(uint8_t flag)
+{
+    if(_opStatus == OP_BUSY || flag > 1) return 0;
+    startOp(OP_OUTPUT);
+    _opOutput = flag;
+    _opWakeAt = millis();
+    return 1;
+}
+
+/**
+ * @brief Status of the last started non-blocking operation
+ * @return OP_IDLE, OP_BUSY, OP_DONE or OP_ERROR
+ */
+AP33772S_OP_STATUS AP33772S::opStatus()
+{
+    return _opStatus;
+}
+
+/**
+ * @brief Advance the non-blocking operation, the PPS/AVS keepalive and pending interrupts.
+ *        Does at most one I2C transaction per task and returns immediately when waiting.
+ * @param now current time in ms, usually millis()
+ */
+void AP33772S::service(unsigned long now)
+{
+    serviceKeepalive(now);
+
+    if(_intPending || (_intPin != INT_PIN_NONE && digitalRead(_intPin) == HIGH)) serviceEvents();
+
+    if(_opStatus != OP_BUSY) return;
+    if((long)(now - _opWakeAt) < 0) return; // Still waiting
+
+    switch(_opKind)
+    {
+        case OP_BEGIN:
+            if(bootPoll()) finishOp(_boot.pdos > 0 ? OP_DONE : OP_ERROR);
+            else _opWakeAt = now + BOOT_POLL;
+            break;
+        case OP_NTC:
+            // Step 0 is the burst, steps 1..4 the per-register fallback, step 5 its read-back
+            if(_opStep == 0 && writeNTCBurst(_opNTC)) finishOp(OP_DONE);
+            else if(_opStep == 5)
+            {
+                NTC_T check;
+                finishOp(readNTC(check) && memcmp(&check, &_opNTC, sizeof(NTC_T)) == 0 ? OP_DONE : OP_ERROR);
+            }
+            else
+            {
+                const uint16_t values[4] = {_opNTC.tr25, _opNTC.tr50, _opNTC.tr75, _opNTC.tr100};
+                if(_opStep > 0 && !writeNTC(CMD_TR25 + _opStep - 1, values[_opStep - 1])) finishOp(OP_ERROR);
+                else
+                {
+                    _opStep++;
+                    _opWakeAt = now + (_opStep == 5 ? 0 : 5); // Read back at once, as setNTC() does
+                }
+            }
+            break;
+        case OP_OUTPUT:
+            finishOp(setOutput(_opOutput) ? OP_DONE : OP_ERROR);
+            break;
+        default:
+            finishOp(OP_ERROR);
+            break;
+    }
+}
+
+/**
+ * @brief service() using millis() as time base
+ */
+void AP33772S::poll()
+{
+    service(millis());
+}
+
+void AP33772S::startOp(byte kind)
+{
+    _opKind = kind;
+    _opStep = 0;
+    _opStatus = OP_BUSY;
+}
+
+void AP33772S::finishOp(AP33772S_OP_STATUS status)
+{
+    _opKind = OP_NONE;
+    _opStatus = status;
+}
+
 //** Need basic I2C function here */
 
-void AP33772S::i2c_read(byte slvAddr, byte cmdAddr, byte len)
+/**
+ * @brief Set the timeout, retries and backoff every transfer runs under. A transfer then
+ *        takes at most busWorstCaseUs(), whatever the bus does.
+ * @param &policy see BUS_POLICY_T, defaults BUS_TIMEOUT_US, BUS_RETRIES and BUS_BACKOFF_US
+ */
+void AP33772S::setBusPolicy(const BUS_POLICY_T &policy)
+{
+    _busPolicy = policy;
+    if(_busPolicy.clockHz) _i2cPort->setClock(_busPolicy.clockHz);
+    applyBusTimeout();
+}
+
+/**
+ * @brief Pins recoverBus() clocks. Known for Wire on cores that define PIN_WIRE_SDA/SCL,
+ *        other buses have no recovery until this is called.
+ * @param sda, scl Arduino pins of the bus, -1 to disable recovery
+ */
+void AP33772S::setBusPins(int sda, int scl)
+{
+    _sdaPin = sda;
+    _sclPin = scl;
+}
+
+/**
+ * @brief Free a bus held by a peripheral stuck mid-byte: up to 9 SCL pulses until SDA is
+ *        released, then a STOP, then the Wire driver is started again (UM10204 3.1.16).
+ *        Runs by itself before a retry after a timeout or bus error.
+ * @return 1 if both lines are high afterwards, 0 if they are not or the pins are unknown
+ */
+bool AP33772S::recoverBus()
 {
-    // clear readBuffer
-    for (byte i = 0; i < READ_BUFF_LENGTH; i++)
+    if(_sdaPin < 0 || _sclPin < 0) return 0;
+    _busHealth.recoveries++;
+    _i2cPort->end();
+
+    // Open drain by hand: drive LOW or let the pull-up take the line HIGH
+    pinMode(_sdaPin, INPUT_PULLUP);
+    pinMode(_sclPin, INPUT_PULLUP);
+    for(byte i = 0; i < 9 && digitalRead(_sdaPin) == LOW; i++)
     {
-        readBuf[i] = 0;
+        digitalWrite(_sclPin, LOW);
+        pinMode(_sclPin, OUTPUT);
+        delayMicroseconds(5);
+        pinMode(_sclPin, INPUT_PULLUP);
+        delayMicroseconds(5);
     }
-    byte i = 0;
-    Wire.beginTransmission(slvAddr); // transmit to device SLAVE_ADDRESS
-    Wire.write(cmdAddr);             // sets the command register
-    Wire.endTransmission();          // stop transmitting
+    // START then STOP, SDA falls and rises while SCL is high
+    digitalWrite(_sdaPin, LOW);
+    pinMode(_sdaPin, OUTPUT);
+    delayMicroseconds(5);
+    pinMode(_sdaPin, INPUT_PULLUP);
+    delayMicroseconds(5);
+    bool released = digitalRead(_sdaPin) == HIGH && digitalRead(_sclPin) == HIGH;
+
+    _i2cPort->begin();
+    if(_busPolicy.clockHz) _i2cPort->setClock(_busPolicy.clockHz);
+    applyBusTimeout();
+    return released;
+}
 
-    Wire.requestFrom(slvAddr, len); // request len bytes from peripheral device
-    if (len <= Wire.available())
-    { // if len bytes were received
-        while (Wire.available())
-        {
-            readBuf[i] = (byte)Wire.read();
-            i++;
-        }
+void AP33772S::resetBusHealth()
+{
+    _busHealth = BUS_HEALTH_T();
+}
+
+/**
+ * @brief Longest a transfer of len bytes can take under the bus policy: every attempt
+ *        timing out on both transactions, the backoff waits and a recovery before each retry.
+ *        Assumes the Wire driver honours the timeout; the clock is taken as 100kHz if unset.
+ * @param len payload bytes
+ * @return bound in us, 0 if timeoutUs is 0 and nothing bounds a transaction
+ */
+unsigned long AP33772S::busWorstCaseUs(byte len)
+{
+    if(_busPolicy.timeoutUs == 0) return 0;
+    uint32_t hz = _busPolicy.clockHz ? _busPolicy.clockHz : 100000UL;
+    unsigned long bits = (2 + 9 * 2) + (2 + 9 * (1 + (unsigned long)len)); // Command write, then the read
+    unsigned long attempt = 2 * _busPolicy.timeoutUs + (bits * 1000000UL + hz - 1) / hz;
+    unsigned long total = attempt;
+    for(byte i = 0; i < _busPolicy.retries; i++)
+    {
+        unsigned long wait = (unsigned long)_busPolicy.backoffUs << (i < 16 ? i : 16);
+        total += attempt + BUS_RECOVERY_US + (wait > BUS_BACKOFF_MAX_US ? BUS_BACKOFF_MAX_US : wait);
+    }
+    return total;
+}
+
+/**
+ * @brief Hand the per transaction timeout to the Wire driver, on cores that have one
+ */
+void AP33772S::applyBusTimeout()
+{
+    if(_busPolicy.timeoutUs == 0) return;
+#if defined(WIRE_HAS_TIMEOUT)
+    _i2cPort->setWireTimeout(_busPolicy.timeoutUs, true);
+#elif defined(ARDUINO_ARCH_ESP32)
+    _i2cPort->setTimeOut((_busPolicy.timeoutUs + 999) / 1000);
+#endif
+}
+
+/**
+ * @brief Read len bytes starting at cmdAddr on this instance's bus and address,
+ *        retried as set by setBusPolicy()
+ * @return 1 if all len bytes were received. On failure dst is left untouched and
+ *         busStatus() tells why.
+ */
+bool AP33772S::i2c_read(byte cmdAddr, byte *dst, byte len)
+{
+    unsigned long start = micros();
+    AP33772S_BUS_STATUS status = readOnce(cmdAddr, dst, len);
+    for (byte attempt = 0; status != BUS_OK && attempt < _busPolicy.retries; attempt++)
+    {
+        retryWait(status, attempt);
+        status = readOnce(cmdAddr, dst, len);
+    }
+    return finishTransfer(cmdAddr, 0, len, status, start);
+}
+
+/**
+ * @brief Write len bytes from src starting at cmdAddr on this instance's bus and address,
+ *        retried as set by setBusPolicy()
+ * @return 1 if the chip acknowledged every byte, busStatus() tells why not
+ */
+bool AP33772S::i2c_write(byte cmdAddr, const byte *src, byte len)
+{
+    unsigned long start = micros();
+    AP33772S_BUS_STATUS status = writeOnce(cmdAddr, src, len);
+    for (byte attempt = 0; status != BUS_OK && attempt < _busPolicy.retries; attempt++)
+    {
+        retryWait(status, attempt);
+        status = writeOnce(cmdAddr, src, len);
     }
+    return finishTransfer(cmdAddr, 1, len, status, start);
 }
 
-void AP33772S::i2c_write(byte slvAddr, byte cmdAddr, byte len)
+/**
+ * @brief One attempt of i2c_read(), dst only written when all len bytes arrived
+ */
+AP33772S_BUS_STATUS AP33772S::readOnce(byte cmdAddr, byte *dst, byte len)
 {
-    Wire.beginTransmission(slvAddr); // transmit to device SLAVE_ADDRESS
-    Wire.write(cmdAddr);             // sets the command register
-    Wire.write(writeBuf, len);       // write data with len
-    Wire.endTransmission();          // stop transmitting
+    _i2cPort->beginTransmission(_address); // transmit to device SLAVE_ADDRESS
+    _i2cPort->write(cmdAddr);              // sets the command register
+    byte err = _i2cPort->endTransmission(); // stop transmitting
+    if (err != BUS_OK) return err <= BUS_TIMEOUT ? (AP33772S_BUS_STATUS)err : BUS_ERROR;
 
-    // clear readBuffer
-    for (byte i = 0; i < WRITE_BUFF_LENGTH; i++)
+    byte n = _i2cPort->requestFrom(_address, len); // request len bytes from peripheral device
+    if (n >= len && _i2cPort->available() >= len)
+    { // if len bytes were received
+        for (byte i = 0; i < len; i++) dst[i] = (byte)_i2cPort->read();
+        while (_i2cPort->available()) _i2cPort->read(); // drop anything extra
+        return BUS_OK;
+    }
+    while (_i2cPort->available()) _i2cPort->read();
+#if defined(WIRE_HAS_TIMEOUT)
+    if (_i2cPort->getWireTimeoutFlag())
     {
-        writeBuf[i] = 0;
+        _i2cPort->clearWireTimeoutFlag();
+        return BUS_TIMEOUT;
     }
-}
\ No newline at end of file
+#endif
+    return BUS_SHORT_READ;
+}
+
+/**
+ * @brief One attempt of i2c_write()
+ */
+AP33772S_BUS_STATUS AP33772S::writeOnce(byte cmdAddr, const byte *src, byte len)
+{
+    _i2cPort->beginTransmission(_address); // transmit to device SLAVE_ADDRESS
+    _i2cPort->write(cmdAddr);              // sets the command register
+    _i2cPort->write(src, len);             // write data with len
+    byte err = _i2cPort->endTransmission(); // stop transmitting
+    return err <= BUS_TIMEOUT ? (AP33772S_BUS_STATUS)err : BUS_ERROR;
+}
+
+/**
+ * @brief Between two attempts: recover a stuck bus, then back off, longer each time
+ */
+void AP33772S::retryWait(AP33772S_BUS_STATUS status, byte attempt)
+{
+    _busHealth.retries++;
+    if (status == BUS_TIMEOUT || status == BUS_ERROR) recoverBus();
+    unsigned long wait = (unsigned long)_busPolicy.backoffUs << (attempt < 16 ? attempt : 16);
+    delayMicroseconds(wait > BUS_BACKOFF_MAX_US ? BUS_BACKOFF_MAX_US : wait);
+}
+
+/**
+ * @brief Account a finished transfer in busHealth() and, when built in, busStats()
+ * @return 1 if it succeeded
+ */
+bool AP33772S::finishTransfer(byte cmdAddr, bool write, byte len, AP33772S_BUS_STATUS status, unsigned long start)
+{
+    unsigned long us = micros() - start;
+    _busHealth.transfers++;
+    _busHealth.last = status;
+    if (status != BUS_OK) _busHealth.failures++;
+    if (us > _busHealth.worstUs) _busHealth.worstUs = us;
+#if AP33772S_BUS_STATS
+    _busStats.record(cmdAddr, write, len, status == BUS_OK, us);
+#else
+    (void)cmdAddr;
+    (void)write;
+    (void)len;
+#endif
+    return status == BUS_OK;
+}
@@ -28,12 +28,13 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "WProgram.h"
 #endif
 
+#include "AP33772S_Log.h"
+#include "AP33772S_BusStats.h"
+
 #define MAX_PDO_ENTRIES 13  // Define the maximum number of PDO entries you expect
 
 #define AP33772S_ADDRESS 0x52
-#define READ_BUFF_LENGTH 128
-#define WRITE_BUFF_LENGTH 6
-#define SRCPDO_LENGTH 28
+#define SRCPDO_LENGTH 26 // MAX_PDO_ENTRIES x 2 bytes
 
 #define CMD_STATUS    0x01 //Reset to 0 after very Read
 #define CMD_MASK      0x02
@@ -53,6 +54,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define CMD_TEMP      0x13
 #define CMD_VREQ      0x14
 #define CMD_IREQ      0x15
+#define TELEMETRY_LENGTH 8 // VOLTAGE(2) CURRENT(1) TEMP(1) VREQ(2) IREQ(2)
+#define SAMPLE_LENGTH    4 // VOLTAGE(2) CURRENT(1) TEMP(1)
 
 
 #define CMD_VSELMIN   0x16 //Minimum Selection Voltage
@@ -61,6 +64,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define CMD_OCPTHR    0x19
 #define CMD_OTPTHR    0x1A
 #define CMD_DRTHR     0x1B
+#define CONFIG_LENGTH 6 // VSELMIN..DRTHR, one byte each
+#define NTC_LENGTH    8 // TR25..TR100, two bytes each
 
 #define CMD_SRCPDO    0x20
 
@@ -68,10 +73,31 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define CMD_PD_CMDMSG 0x32
 #define CMD_PD_MSGRLT 0x33
 
-//Timer for AVS reminder signal
-#define ALARM_NUM1 1 // Timer 1
-#define ALARM_IRQ1 TIMER_IRQ_1
-#define DELAY1 500000 // In usecond , 0.5s
+#include "AP33772S_Registers.h"
+
+// PD_MSGRLT RESPONSE field, bits 3:0
+#define MSGRLT_BUSY        0x00
+#define MSGRLT_SUCCESS     0x01
+#define MSGRLT_INVALID     0x02 // Invalid command or argument
+#define MSGRLT_UNSUPPORTED 0x03
+#define MSGRLT_FAIL        0x04 // Transaction fail, source rejected
+
+#define EVENT_QUEUE_LENGTH 16 // Power of 2
+#define INT_PIN_NONE 0xff
+
+//Default period for PPS/AVS keepalive request
+#define KEEPALIVE_PERIOD 500 // In ms, 0.5s
+
+//Boot sequencing, begin() polls STATUS instead of sleeping
+#define BOOT_TIMEOUT 500 // In ms, budget for the chip to answer and report NEWPDO
+#define BOOT_POLL    2   // In ms, between STATUS reads
+
+//I2C transport, every transfer is bounded by these, see setBusPolicy()
+#define BUS_TIMEOUT_US     10000 // Per transaction, handed to the Wire driver where it has a timeout
+#define BUS_RETRIES        2     // Extra attempts after a failed transfer
+#define BUS_BACKOFF_US     200   // Wait before the first retry, doubled for each next one
+#define BUS_BACKOFF_MAX_US 16000 // Cap of one wait, delayMicroseconds() limit on AVR
+#define BUS_RECOVERY_US    200   // Upper bound of one recoverBus(), 9 SCL pulses and a STOP
 
 typedef enum
 {
@@ -84,6 +110,21 @@ typedef enum
   OTP_MSK       = 1 << 6      // 1000 0000
 } AP33772_MASK;
 
+// Events decoded from STATUS (and PD_MSGRLT after a request) by service()
+typedef enum
+{
+  EVENT_NONE = 0,
+  EVENT_STARTED,
+  EVENT_READY,
+  EVENT_NEWPDO,
+  EVENT_UVP,
+  EVENT_OVP,
+  EVENT_OCP,
+  EVENT_OTP,
+  EVENT_NEGO_SUCCESS,
+  EVENT_NEGO_FAIL
+} AP33772S_EVENT;
+
 typedef struct
 {
   union
@@ -112,6 +153,34 @@ typedef struct
   };
 } EVENT_FLAG_T;
 
+// Kind of a decoded source PDO
+typedef enum
+{
+  PDO_NONE = 0,
+  PDO_FIXED,
+  PDO_PPS,
+  PDO_AVS
+} PDO_KIND;
+
+// Capability table entry, decoded once from SRCPDO by begin()
+typedef struct {
+  byte index;          // PDO index, start at 1
+  byte kind;           // PDO_KIND
+  byte current_code;   // CURRENT_MAX field, compared against CURRENT_SEL
+  uint16_t min_mV;     // Equal to max_mV for fixed PDO
+  uint16_t max_mV;
+  uint16_t max_mA;     // Lower bound of the CURRENT_MAX range
+} PDO_CAP_T;
+
+// Status of the non-blocking operations driven by service()/poll()
+typedef enum
+{
+  OP_IDLE = 0,  // Nothing started yet
+  OP_BUSY,      // Waiting for service() to advance it
+  OP_DONE,
+  OP_ERROR
+} AP33772S_OP_STATUS;
+
 //DONE
 typedef struct {
   union {
@@ -161,82 +230,337 @@ typedef struct {
   };
 } RDO_DATA_T;
 
+// Decoded VOLTAGE..IREQ snapshot, fetched in one burst by readTelemetry()
+typedef struct {
+  int voltage;  // VBUS in mV
+  int current;  // VBUS current in mA
+  int temp;     // NTC temperature in C
+  int vreq;     // Negotiated voltage in mV
+  int ireq;     // Negotiated current in mA
+} TELEMETRY_T;
+
+// VSELMIN..DRTHR as one unit, written in one burst by applyProtection()
+typedef struct {
+  int vselmin;  // Minimum selection voltage in mV, 200mV/LSB
+  int uvp;      // UVP threshold, 80, 75 or 70 % of VREQ
+  int ovp;      // OVP offset above VREQ in mV, 80mV/LSB
+  int ocp;      // OCP threshold in mA, 50mA/LSB
+  int otp;      // OTP threshold in C
+  int derating; // De-rating threshold in C
+} PROTECTION_PROFILE_T;
+
+// TR25..TR100 as one unit, written in one burst by setNTC(), see AP33772S_NTC.h
+typedef struct {
+  uint16_t tr25;  // Ohm at 25C
+  uint16_t tr50;  // Ohm at 50C
+  uint16_t tr75;  // Ohm at 75C
+  uint16_t tr100; // Ohm at 100C
+} NTC_T;
+
+// Undecoded VOLTAGE/CURRENT/TEMP, for capture at rates where the conversion matters
+typedef struct {
+  uint32_t t_us;    // Filled in by the caller
+  uint16_t voltage; // 80mV/LSB
+  byte current;     // 24mA/LSB
+  byte temp;        // 1C/LSB
+} SAMPLE_RAW_T;
+
+// Boot timeline, every time in us from the start of begin()/beginAsync(), 0 if not reached
+typedef struct {
+  unsigned long ackUs;      // First STATUS read the chip answered
+  unsigned long pdoUs;      // SRCPDO read and decoded, requests possible from here
+  unsigned long requestUs;  // First request sent
+  unsigned long powerUs;    // First request reported successful, time to first power
+  unsigned int polls;       // STATUS reads
+  byte status;              // STATUS bits seen while booting
+  byte pdos;                // PDOs reported by the source
+  bool timedOut;            // BOOT_TIMEOUT ran out before NEWPDO, SRCPDO read anyway
+} BOOT_STATS_T;
+
+// I2C transfer result, the Wire endTransmission() codes plus a short read
+typedef enum
+{
+  BUS_OK = 0,
+  BUS_TOO_LONG,   // More data than the Wire buffer holds
+  BUS_NACK_ADDR,  // Chip did not answer, booting or absent
+  BUS_NACK_DATA,  // Chip refused a byte
+  BUS_ERROR,      // Arbitration lost or other bus error
+  BUS_TIMEOUT,    // Wire driver timed out, SCL or SDA held low
+  BUS_SHORT_READ  // Fewer bytes than requested
+} AP33772S_BUS_STATUS;
+
+typedef struct {
+  unsigned long timeoutUs;  // Per transaction, 0 leaves the driver default
+  byte retries;             // Extra attempts after a failed transfer
+  unsigned int backoffUs;   // Wait before the first retry, doubled for each next one
+  uint32_t clockHz;         // Set again after a bus recovery, 0 leaves the driver default
+} BUS_POLICY_T;
+
+typedef struct {
+  unsigned long transfers;  // i2c reads and writes, retries not counted
+  unsigned long retries;
+  unsigned long failures;   // Transfers that failed after every retry
+  unsigned long recoveries; // recoverBus() runs
+  unsigned long worstUs;    // Longest transfer, retries and recoveries included
+  AP33772S_BUS_STATUS last; // Result of the last transfer
+} BUS_HEALTH_T;
+
+// Called with every VOLTAGE/CURRENT/TEMP the library reads in a burst, t_us set to micros()
+typedef void (*AP33772S_SAMPLE_HOOK)(void *context, const SAMPLE_RAW_T &sample);
+
 class AP33772S
 {
 public:
-  AP33772S(TwoWire &wire = Wire);
-  void begin();
+  AP33772S(TwoWire &wire = Wire, byte address = AP33772S_ADDRESS);
+  bool begin(unsigned long timeout_ms = BOOT_TIMEOUT);
+  const BOOT_STATS_T &bootStats() { return _boot; }
   void displayPDOInfo(int pdoIndex);
   void displayProfiles();
   void mapPPSAVSInfo();
-  void setFixPDO(int pdoIndex, int max_current);
-  void setPPSPDO(int pdoIndex, int target_voltage, int max_current);
-  void setAVSPDO(int pdoIndex, int target_voltage, int max_current);
+  bool setFixPDO(int pdoIndex, int max_current);
+  bool setPPSPDO(int pdoIndex, int target_voltage, int max_current);
+  bool setAVSPDO(int pdoIndex, int target_voltage, int max_current);
+  int requestPower(int target_voltage, int max_current);
+  int selectPDO(int target_voltage, int max_current);
+  int getActivePDO();
+  uint16_t getLastRDO();
+  uint16_t getAcceptedRDO();
+  bool requestRDO(uint16_t rdo);
+  uint16_t encodePower(int target_voltage, int max_current, int pdoIndex = 0);
+  uint32_t pdoHash();
+  void getRawPDOs(byte *raw);
   // void setVoltage(int targetVoltage); // Unit in mV
-  void setNTC(int TR25, int TR50, int TR75, int TR100);
+  bool setNTC(int TR25, int TR50, int TR75, int TR100);
+  bool setNTC(const NTC_T &ntc);
+  bool readNTC(NTC_T &ntc);
   bool setOutput(uint8_t flag);
-  // void setMask(AP33772_MASK flag);
-  // void clearMask(AP33772_MASK flag);
+
+  // Non-blocking variants, advanced by service()/poll()
+  bool beginAsync(unsigned long timeout_ms = BOOT_TIMEOUT);
+  bool setNTCAsync(int TR25, int TR50, int TR75, int TR100);
+  bool setOutputAsync(uint8_t flag);
+  AP33772S_OP_STATUS opStatus();
+  void service(unsigned long now);
+  void poll();
+  void setKeepalive(unsigned long period_ms);
+
+  // Event handling, STATUS is read by service() once per interrupt
+  bool setMask(AP33772_MASK flag);
+  bool clearMask(AP33772_MASK flag);
+  void setIntPin(uint8_t pin);
+  void handleInterrupt();
+  bool getEvent(AP33772S_EVENT &event);
+  EVENT_FLAG_T getEventFlags();
+  unsigned int eventsDropped();
 
   // Monitor functions
   int readTemp();
   int readVoltage();
   int readCurrent();
+  TELEMETRY_T readTelemetry();
+  bool readTelemetry(TELEMETRY_T &telemetry);
+  bool readSample(SAMPLE_RAW_T &sample);
+  void setSampleHook(AP33772S_SAMPLE_HOOK hook, void *context = NULL);
+  bool getOutput() { return _output; } // Last setOutput(), no bus access
 
   // Adjustment functions
   int readVREQ();
   int readIREQ();
   int readVSELMIN();
-  void setVSELMIN(int voltage);
+  bool setVSELMIN(int voltage);
   int readUVPTHR();
-  void setUVPTHR(int value);
+  bool setUVPTHR(int value);
   int readOVPTHR();
-  void setOVPTHR(int value);
+  bool setOVPTHR(int value);
   int readOCPTHR();
-  void setOCPTHR(int value);
+  bool setOCPTHR(int value);
   int readOTPTHR();
-  void setOTPTHR(int value);
+  bool setOTPTHR(int value);
   int readDRTHR();
-  void setDRTHR(int value);
+  bool setDRTHR(int value);
+
+  // Register map access, R is one of the R_* types in AP33772S_Registers.h
+  // read() gives -1 on a bus error, write() 0 on a bus error or an out of range value
+  template <typename R> typename R::unit_t read()
+  {
+    uint16_t raw;
+    if(!readRaw<R>(raw)) return typename R::unit_t(-1);
+    return R::decode(raw);
+  }
+  template <typename R> bool write(typename R::unit_t value)
+  {
+    static_assert(R::addr < CMD_VOLTAGE || R::addr > CMD_IREQ, "Register is read only");
+    if(!R::valid(value.value)) return 0;
+    return writeRaw<R>(R::encode(value));
+  }
+  template <typename R, int32_t VALUE> bool write()
+  {
+    static_assert(R::addr < CMD_VOLTAGE || R::addr > CMD_IREQ, "Register is read only");
+    static_assert(R::valid(VALUE), "Value out of range for this register");
+    return writeRaw<R>(R::encode(typename R::unit_t(VALUE)));
+  }
+
+  byte readMsgResult();
+
+  // Protection thresholds as one profile, one burst write plus one burst read-back
+  bool applyProtection(const PROTECTION_PROFILE_T &profile);
+  bool readProtection(PROTECTION_PROFILE_T &profile);
+
+  // Config shadow cache
+  byte readStatus();
+  void setConfigCache(bool enable);
+  void invalidateConfigCache();
+
+  // I2C transport, every transfer retried and bounded as set here
+  void setBusPolicy(const BUS_POLICY_T &policy);
+  const BUS_POLICY_T &busPolicy() { return _busPolicy; }
+  void setBusPins(int sda, int scl);
+  bool recoverBus();
+  AP33772S_BUS_STATUS busStatus() { return _busHealth.last; }
+  const BUS_HEALTH_T &busHealth() { return _busHealth; }
+  void resetBusHealth();
+  unsigned long busWorstCaseUs(byte len);
+
+#if AP33772S_BUS_STATS
+  // Per-register transport counters, see AP33772S_BusStats.h
+  AP33772SBusStats &busStats() { return _busStats; }
+#endif
 
   // Advance function to handle in other lib
 
   int getNumPDO();
   int getPPSIndex();
   int getAVSIndex();
+  int getPPSCount();
+  int getAVSCount();
+  int getPPSIndex(int n);
+  int getAVSIndex(int n);
+  const PDO_CAP_T *getPDOCap(int pdoIndex);
+  int getPDOByVoltage(int n);
+  int currentMap(int current); // mA to CURRENT_SEL code
   
   byte existPPS = 0; // PPS flag for setVoltage()
   byte existAVS = 0; // AVS flag for setVoltage()
 
 private:
-  static void i2c_read(byte slvAddr, byte cmdAddr, byte len);
-  static void i2c_write(byte slvAddr, byte cmdAddr, byte len);
+  bool i2c_read(byte cmdAddr, byte *dst, byte len);
+  bool i2c_write(byte cmdAddr, const byte *src, byte len);
+  AP33772S_BUS_STATUS readOnce(byte cmdAddr, byte *dst, byte len);
+  AP33772S_BUS_STATUS writeOnce(byte cmdAddr, const byte *src, byte len);
+  void retryWait(AP33772S_BUS_STATUS status, byte attempt);
+  bool finishTransfer(byte cmdAddr, bool write, byte len, AP33772S_BUS_STATUS status, unsigned long start);
+  void applyBusTimeout();
   TwoWire *_i2cPort = &Wire;
-  static byte readBuf[READ_BUFF_LENGTH];
-  static byte writeBuf[WRITE_BUFF_LENGTH];
+  byte _address = AP33772S_ADDRESS;
+  BUS_POLICY_T _busPolicy = {BUS_TIMEOUT_US, BUS_RETRIES, BUS_BACKOFF_US, 0};
+  BUS_HEALTH_T _busHealth = {};
+  int _sdaPin = -1; // Bus recovery pins, -1 if unknown
+  int _sclPin = -1;
+#if AP33772S_BUS_STATS
+  AP33772SBusStats _busStats;
+#endif
 
   int _indexPPSUser = -1; // for getPPSIndex();
   int _indexAVSUser = -1; // for getAVSIndex();
 
   EVENT_FLAG_T event_flag = {0};
-  RDO_DATA_T rdoData = {0};
 
-  //Use for timer;
-  static int _voltageAVSbyte;
-  static int _currentAVSbyte;
-  static int _indexAVS;
+  // Single producer (service) / single consumer (getEvent) event queue
+  byte _eventQueue[EVENT_QUEUE_LENGTH] = {0};
+  volatile byte _eventHead = 0;
+  volatile byte _eventTail = 0;
+  unsigned int _eventsDropped = 0;
+  // Observer of burst reads, see setSampleHook()
+  AP33772S_SAMPLE_HOOK _sampleHook = NULL;
+  void *_sampleContext = NULL;
+  void notifySample(const byte *buf);
+  bool _output = false;
+
+  volatile bool _intPending = false;
+  uint8_t _intPin = INT_PIN_NONE;
+  bool _negoPending = false; // Request sent, result not reported yet
+
+  // Boot sequencer shared by begin() and beginAsync()
+  BOOT_STATS_T _boot = {0};
+  unsigned long _bootStart = 0;   // us
+  unsigned long _bootTimeout = 0; // us
+  void startBoot(unsigned long timeout_ms);
+  bool bootPoll();
+  void serviceEvents();
+  void handleStatus(byte status);
+  void pushEvent(AP33772S_EVENT event);
+  RDO_DATA_T rdoData = {0};
 
-  //static void timerISR1();
-  //void setupAVSTimer();
-  //void cancelAVSTimer();
+  // Shadow of VSELMIN..DRTHR, index is cmdAddr - CMD_VSELMIN
+  bool _configCache = false;
+  bool _configValid = false;
+  byte _config[CONFIG_LENGTH] = {0};
+
+  // Non-blocking operation state
+  enum { OP_NONE, OP_BEGIN, OP_NTC, OP_OUTPUT };
+  AP33772S_OP_STATUS _opStatus = OP_IDLE;
+  byte _opKind = OP_NONE;
+  byte _opStep = 0;
+  byte _opOutput = 0;
+  unsigned long _opWakeAt = 0;
+  NTC_T _opNTC = {0};
+
+  // PPS/AVS keepalive, last request pre-encoded
+  byte _keepaliveRDO[2] = {0};
+  bool _keepaliveArmed = false;
+  unsigned long _keepalivePeriod = KEEPALIVE_PERIOD;
+  unsigned long _keepaliveLast = 0;
+  void armKeepalive(RDO_DATA_T rdo);
+  void serviceKeepalive(unsigned long now);
 
   SRC_SPRandEPR_PDO_Fields SRC_SPRandEPRpdoArray[MAX_PDO_ENTRIES] = {0}; 
 
+  // Capability table, index is pdoIndex-1
+  PDO_CAP_T _caps[MAX_PDO_ENTRIES] = {};
+  byte _capOrder[MAX_PDO_ENTRIES] = {0}; // PDO index sorted by max_mV
+  byte _ppsList[MAX_PDO_ENTRIES] = {0};
+  byte _avsList[MAX_PDO_ENTRIES] = {0};
+  byte _numPDO = 0;
+  byte _numPPS = 0;
+  byte _numAVS = 0;
+  byte _activeIndex = 0; // PDO requested last
+  uint16_t _lastRDO = 0;  // Raw PD_REQMSG sent last, 0 if none since begin()
+  uint16_t _acceptedRDO = 0; // Raw PD_REQMSG readMsgResult() saw accepted last, 0 if none since begin()
+
   //Helper functions
   void displaySPRVoltageMin(unsigned int current_max);
   void displayEPRVoltageMin(unsigned int current_max);
   void displayCurrentRange(unsigned int current_max);
-  int currentMap(int current);
+  bool encodeRDO(byte kind, int pdoIndex, int target_voltage, int max_current, RDO_DATA_T &rdoData);
+  bool sendRDO(RDO_DATA_T rdoData, byte kind);
+  bool pdoCovers(const PDO_CAP_T &cap, int target_voltage, int max_current);
+  int loadPDOs();
+  bool writeNTC(byte cmdAddr, int value);
+  bool writeNTCBurst(const NTC_T &ntc);
+  void startOp(byte kind);
+  void finishOp(AP33772S_OP_STATUS status);
+  bool fillConfigCache();
+  bool readConfig(byte cmdAddr, byte &value);
+  bool writeConfig(byte cmdAddr, byte value);
+
+  // Raw register access behind read<R>()/write<R>(), config registers go through the cache
+  template <typename R> bool readRaw(uint16_t &raw)
+  {
+    byte buf[2] = {0, 0};
+    if(R::addr >= CMD_VSELMIN && R::addr <= CMD_DRTHR)
+    {
+      if(!readConfig(R::addr, buf[0])) return 0;
+    }
+    else if(!i2c_read(R::addr, buf, R::width)) return 0;
+    raw = buf[0] | (R::width > 1 ? buf[1] << 8 : 0);
+    return 1;
+  }
+  template <typename R> bool writeRaw(uint16_t raw)
+  {
+    if(R::addr >= CMD_VSELMIN && R::addr <= CMD_DRTHR) return writeConfig(R::addr, raw);
+    byte buf[2] = {(byte)(raw & 0xff), (byte)(raw >> 8)};
+    return i2c_write(R::addr, buf, R::width);
+  }
 
 };
 
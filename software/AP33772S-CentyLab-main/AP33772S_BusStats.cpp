@@ -0,0 +1,152 @@
+/*
+AP33772S_BusStats.cpp - Per-register I2C instrumentation for the AP33772S Arduino Library.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#include "AP33772S.h"
+
+#if AP33772S_BUS_STATS
+
+/**
+ * @brief Account one i2c_read()/i2c_write() call
+ * @param cmdAddr register the call started at
+ * @param write 1 for i2c_write()
+ * @param len payload bytes, command byte not included
+ * @param ok 0 on NACK or short read
+ * @param us call latency
+ */
+void AP33772SBusStats::record(byte cmdAddr, bool write, byte len, bool ok, unsigned long us)
+{
+  BUS_REG_STATS_T &r = _regs[cmdAddr < BUS_STATS_REGS ? cmdAddr : BUS_STATS_REGS];
+  if(write) r.writes++;
+  else r.reads++;
+  if(ok) r.bytes += len;
+  else if(r.errors < 0xffff) r.errors++;
+  r.totalUs += us;
+  if(us > r.maxUs) r.maxUs = us > 0xffff ? 0xffff : us;
+  byte b = bucket(us);
+  if(r.hist[b] < 0xffff) r.hist[b]++;
+}
+
+void AP33772SBusStats::reset()
+{
+  memset(_regs, 0, sizeof(_regs));
+}
+
+/**
+ * @return counters of one register, addresses past the map share one entry
+ */
+const BUS_REG_STATS_T &AP33772SBusStats::reg(byte cmdAddr) const
+{
+  return _regs[cmdAddr < BUS_STATS_REGS ? cmdAddr : BUS_STATS_REGS];
+}
+
+/**
+ * @return every register summed, maxUs is the largest of them
+ */
+BUS_REG_STATS_T AP33772SBusStats::total() const
+{
+  BUS_REG_STATS_T t = {};
+  for(byte i = 0; i <= BUS_STATS_REGS; i++)
+  {
+    const BUS_REG_STATS_T &r = _regs[i];
+    t.reads += r.reads;
+    t.writes += r.writes;
+    t.bytes += r.bytes;
+    t.errors += r.errors;
+    t.totalUs += r.totalUs;
+    if(r.maxUs > t.maxUs) t.maxUs = r.maxUs;
+    for(byte b = 0; b < BUS_STATS_BUCKETS; b++) t.hist[b] += r.hist[b];
+  }
+  return t;
+}
+
+/**
+ * @brief One line per register that saw traffic: name, reads, writes, bytes,
+ * errors, mean and max us, then the histogram buckets
+ */
+void AP33772SBusStats::print(Print &out) const
+{
+  out.println("reg rd wr bytes err avg_us max_us hist");
+  for(byte i = 0; i <= BUS_STATS_REGS; i++)
+  {
+    const BUS_REG_STATS_T &r = _regs[i];
+    uint32_t calls = r.reads + r.writes;
+    if(calls == 0) continue;
+    out.print(name(i));
+    out.print(' ');
+    out.print((unsigned long)r.reads);
+    out.print(' ');
+    out.print((unsigned long)r.writes);
+    out.print(' ');
+    out.print((unsigned long)r.bytes);
+    out.print(' ');
+    out.print((unsigned int)r.errors);
+    out.print(' ');
+    out.print((unsigned long)(r.totalUs / calls));
+    out.print(' ');
+    out.print((unsigned int)r.maxUs);
+    for(byte b = 0; b < BUS_STATS_BUCKETS; b++)
+    {
+      out.print(b ? ',' : ' ');
+      out.print((unsigned int)r.hist[b]);
+    }
+    out.println();
+  }
+}
+
+#endif
+
+/**
+ * @brief Histogram bucket of a latency, each bucket twice as wide as the one before
+ */
+byte AP33772SBusStats::bucket(unsigned long us)
+{
+  byte b = 0;
+  us /= BUS_STATS_BASE_US;
+  while(us && b < BUS_STATS_BUCKETS - 1)
+  {
+    us >>= 1;
+    b++;
+  }
+  return b;
+}
+
+/**
+ * @return register name for reports, "?" for an address not in the map
+ */
+const char *AP33772SBusStats::name(byte cmdAddr)
+{
+  switch(cmdAddr)
+  {
+    case CMD_STATUS:    return "STATUS";
+    case CMD_MASK:      return "MASK";
+    case CMD_OPMODE:    return "OPMODE";
+    case CMD_CONFIG:    return "CONFIG";
+    case CMD_PDCONFIG:  return "PDCONFIG";
+    case CMD_SYSTEM:    return "SYSTEM";
+    case CMD_TR25:      return "TR25";
+    case CMD_TR50:      return "TR50";
+    case CMD_TR75:      return "TR75";
+    case CMD_TR100:     return "TR100";
+    case CMD_VOLTAGE:   return "VOLTAGE";
+    case CMD_CURRENT:   return "CURRENT";
+    case CMD_TEMP:      return "TEMP";
+    case CMD_VREQ:      return "VREQ";
+    case CMD_IREQ:      return "IREQ";
+    case CMD_VSELMIN:   return "VSELMIN";
+    case CMD_UVPTHR:    return "UVPTHR";
+    case CMD_OVPTHR:    return "OVPTHR";
+    case CMD_OCPTHR:    return "OCPTHR";
+    case CMD_OTPTHR:    return "OTPTHR";
+    case CMD_DRTHR:     return "DRTHR";
+    case CMD_SRCPDO:    return "SRCPDO";
+    case CMD_PD_REQMSG: return "PD_REQMSG";
+    case CMD_PD_CMDMSG: return "PD_CMDMSG";
+    case CMD_PD_MSGRLT: return "PD_MSGRLT";
+    default:            return "?";
+  }
+}
@@ -0,0 +1,59 @@
+/*
+AP33772S_BusStats.h - Per-register I2C instrumentation for the AP33772S Arduino Library.
+
+Counts, per command address, the transactions i2c_read()/i2c_write() issue,
+the bytes they move, the ones that failed and how long they took, as a
+histogram of micros() per call. Off by default, the table takes about 2 KB
+of RAM. Enable it with a build flag, -DAP33772S_BUS_STATS=1, then read it
+with busStats() or print it with busStats().print(Serial).
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#ifndef __AP33772S_BUS_STATS__
+#define __AP33772S_BUS_STATS__
+
+#if ARDUINO >= 100
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#ifndef AP33772S_BUS_STATS
+#define AP33772S_BUS_STATS 0
+#endif
+
+#define BUS_STATS_REGS    0x34 // CMD_STATUS .. CMD_PD_MSGRLT
+#define BUS_STATS_BUCKETS 8    // Bucket 0 below 32us, bucket i from 16 << i us, the last from 2048us
+#define BUS_STATS_BASE_US 32
+
+typedef struct
+{
+  uint32_t reads;              // i2c_read() calls, command write plus requestFrom
+  uint32_t writes;             // i2c_write() calls
+  uint32_t bytes;              // Payload moved, command byte not included
+  uint16_t errors;             // NACK or short read
+  uint32_t totalUs;            // Sum of the call latencies
+  uint16_t maxUs;              // Saturates at 65535
+  uint16_t hist[BUS_STATS_BUCKETS];
+} BUS_REG_STATS_T;
+
+class AP33772SBusStats
+{
+public:
+  void record(byte cmdAddr, bool write, byte len, bool ok, unsigned long us);
+  void reset();
+  const BUS_REG_STATS_T &reg(byte cmdAddr) const;
+  BUS_REG_STATS_T total() const;
+  void print(Print &out) const;
+
+  static byte bucket(unsigned long us);
+  static const char *name(byte cmdAddr);
+
+private:
+  BUS_REG_STATS_T _regs[BUS_STATS_REGS + 1] = {}; // Last entry collects addresses past the map
+};
+
+#endif
@@ -0,0 +1,200 @@
+/*
+AP33772S_CapCache.cpp - Persisted source capability cache for the AP33772S Arduino Library.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#include "AP33772S_CapCache.h"
+
+/**
+ * @brief Class constuctor
+ * @param &usbpd the AP33772S whose chargers are remembered
+ * @param &storage backend holding CAPCACHE_SIZE bytes from base
+ * @param base first byte used in the storage
+ */
+AP33772SCapCache::AP33772SCapCache(AP33772S &usbpd, AP33772SStorage &storage, uint16_t base)
+{
+  _pd = &usbpd;
+  _storage = &storage;
+  _base = base;
+}
+
+/**
+ * @brief begin(), then restore(), timed
+ * @return 1 if the charger was known and its setpoint requested again
+ */
+bool AP33772SCapCache::boot()
+{
+  unsigned long start = micros();
+  _pd->begin();
+  _stats.beginUs = micros() - start;
+  bool hit = restore();
+  _stats.bootUs = micros() - start;
+  return hit;
+}
+
+/**
+ * @brief Look up the charger read by begin() and send its stored request
+ * @return 1 on a hit that the current capability table accepts
+ */
+bool AP33772SCapCache::restore()
+{
+  unsigned long start = micros();
+  byte pdo[SRCPDO_LENGTH];
+  _pd->getRawPDOs(pdo);
+  _stats.fingerprint = _pd->pdoHash();
+
+  RECORD_T record;
+  _stats.hit = find(_stats.fingerprint, pdo, record) >= 0 && record.rdo != 0;
+  _stats.lookupUs = micros() - start;
+  if(_stats.hit) _stats.hit = _pd->requestRDO(record.rdo);
+  return _stats.hit;
+}
+
+/**
+ * @brief Remember the contract in place for this charger. The last request counts once
+ *        PD_MSGRLT reports it accepted, read here if nothing read it yet; one that is
+ *        rejected or still pending leaves the previous accepted request in its place.
+ * @return 0 if no request was accepted yet or the storage failed
+ */
+bool AP33772SCapCache::save()
+{
+  RECORD_T record;
+  record.magic = CAPCACHE_MAGIC;
+  record.hash = _pd->pdoHash();
+  if(_pd->getAcceptedRDO() != _pd->getLastRDO()) _pd->readMsgResult();
+  record.rdo = _pd->getAcceptedRDO();
+  _pd->getRawPDOs(record.pdo);
+  if(record.rdo == 0) return 0;
+
+  RECORD_T old;
+  int slot = find(record.hash, record.pdo, old);
+  if(slot >= 0 && old.rdo == record.rdo) return 1; // Already there, no wear
+
+  // Same charger's slot, else an empty one, else the least recently saved
+  uint16_t newest = 0, oldest = 0xffff;
+  int empty = -1, lru = 0;
+  for(byte i = 0; i < CAPCACHE_SLOTS; i++)
+  {
+    if(!load(i, old))
+    {
+      if(empty < 0) empty = i;
+      continue;
+    }
+    if(old.seq >= newest) newest = old.seq;
+    if(old.seq < oldest)
+    {
+      oldest = old.seq;
+      lru = i;
+    }
+  }
+  if(slot < 0) slot = empty >= 0 ? empty : lru;
+  if(newest == 0xffff) newest = renumber(); // Keeps the order, so slot and lru still hold
+  record.seq = newest + 1;
+
+  if(!store(slot, record)) return 0;
+  _stats.saves++;
+  return 1;
+}
+
+/**
+ * @brief Forget every charger
+ */
+void AP33772SCapCache::clear()
+{
+  byte blank = 0xff;
+  for(byte i = 0; i < CAPCACHE_SLOTS; i++) _storage->write(_base + i * CAPCACHE_RECORD, &blank, 1);
+  _storage->commit();
+}
+
+/**
+ * @brief Number the stored slots 1, 2, .. from the least recently saved, before seq wraps
+ * @return the highest number given
+ */
+uint16_t AP33772SCapCache::renumber()
+{
+  RECORD_T record;
+  byte done = 0;
+  uint16_t seq = 0;
+  for(;;)
+  {
+    int oldest = -1;
+    uint16_t lowest = 0xffff;
+    for(byte i = 0; i < CAPCACHE_SLOTS; i++)
+    {
+      if((done & (1 << i)) || !load(i, record)) continue;
+      if(oldest < 0 || record.seq < lowest)
+      {
+        lowest = record.seq;
+        oldest = i;
+      }
+    }
+    if(oldest < 0) return seq;
+    done |= 1 << oldest;
+    load(oldest, record);
+    record.seq = ++seq;
+    store(oldest, record);
+  }
+}
+
+int AP33772SCapCache::find(uint32_t hash, const byte *pdo, RECORD_T &record)
+{
+  for(byte i = 0; i < CAPCACHE_SLOTS; i++)
+  {
+    if(!load(i, record)) continue;
+    if(record.hash == hash && memcmp(record.pdo, pdo, SRCPDO_LENGTH) == 0) return i;
+  }
+  return -1;
+}
+
+/**
+ * @brief Read and check one slot, little endian fields in RECORD_T order
+ * @return 0 if the slot is empty or corrupt
+ */
+bool AP33772SCapCache::load(byte slot, RECORD_T &record)
+{
+  byte buf[CAPCACHE_RECORD];
+  if(_base + (slot + 1) * CAPCACHE_RECORD > _storage->size()) return 0;
+  if(!_storage->read(_base + slot * CAPCACHE_RECORD, buf, CAPCACHE_RECORD)) return 0;
+  if(buf[0] != CAPCACHE_MAGIC) return 0;
+
+  uint32_t check = buf[CAPCACHE_RECORD - 4] | ((uint32_t)buf[CAPCACHE_RECORD - 3] << 8) |
+                   ((uint32_t)buf[CAPCACHE_RECORD - 2] << 16) | ((uint32_t)buf[CAPCACHE_RECORD - 1] << 24);
+  if(check != fnv(buf, CAPCACHE_RECORD - 4)) return 0;
+
+  record.magic = buf[0];
+  record.seq = buf[1] | (buf[2] << 8);
+  record.hash = buf[3] | ((uint32_t)buf[4] << 8) | ((uint32_t)buf[5] << 16) | ((uint32_t)buf[6] << 24);
+  record.rdo = buf[7] | (buf[8] << 8);
+  memcpy(record.pdo, &buf[9], SRCPDO_LENGTH);
+  return 1;
+}
+
+bool AP33772SCapCache::store(byte slot, const RECORD_T &record)
+{
+  byte buf[CAPCACHE_RECORD];
+  buf[0] = record.magic;
+  buf[1] = record.seq & 0xff;
+  buf[2] = record.seq >> 8;
+  for(byte i = 0; i < 4; i++) buf[3 + i] = (record.hash >> (8 * i)) & 0xff;
+  buf[7] = record.rdo & 0xff;
+  buf[8] = record.rdo >> 8;
+  memcpy(&buf[9], record.pdo, SRCPDO_LENGTH);
+  uint32_t check = fnv(buf, CAPCACHE_RECORD - 4);
+  for(byte i = 0; i < 4; i++) buf[CAPCACHE_RECORD - 4 + i] = (check >> (8 * i)) & 0xff;
+
+  if(_base + (slot + 1) * CAPCACHE_RECORD > _storage->size()) return 0;
+  return _storage->write(_base + slot * CAPCACHE_RECORD, buf, CAPCACHE_RECORD) && _storage->commit();
+}
+
+uint32_t AP33772SCapCache::fnv(const byte *data, uint16_t len, uint32_t hash)
+{
+  for(uint16_t i = 0; i < len; i++)
+  {
+    hash ^= data[i];
+    hash *= 16777619UL;
+  }
+  return hash;
+}
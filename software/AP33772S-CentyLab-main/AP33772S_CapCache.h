@@ -0,0 +1,89 @@
+/*
+AP33772S_CapCache.h - Persisted source capability cache for the AP33772S Arduino Library.
+
+Remembers, per charger, the raw SRCPDO bytes and the last request that
+negotiated, keyed by an FNV-1a hash of those bytes. On a charger seen before,
+boot() re-requests the stored setpoint straight after begin(), before any
+application level profile discovery. The raw bytes are kept next to the key
+and compared on a hit, so a hash collision is a miss, not a wrong request.
+They are the capability table in its compact form, begin() decodes them in
+microseconds.
+
+Storage is pluggable through AP33772SStorage: AP33772SEEPROMStorage in
+AP33772S_EEPROM.h on the board, a file on the host (extras/host FileStorage).
+A slot is only rewritten when its content changes, which keeps flash and
+EEPROM wear to one write per new charger or new setpoint, plus one rewrite
+of every slot when the save counter nears its 16-bit limit.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#ifndef __AP33772S_CAPCACHE__
+#define __AP33772S_CAPCACHE__
+
+#include "AP33772S.h"
+
+#define CAPCACHE_SLOTS  4     // Chargers remembered, up to 8, least recently saved goes first
+#define CAPCACHE_MAGIC  0xC5
+#define CAPCACHE_RECORD (1 + 2 + 4 + 2 + SRCPDO_LENGTH + 4) // magic seq hash rdo pdo check
+#define CAPCACHE_SIZE   (CAPCACHE_SLOTS * CAPCACHE_RECORD)
+
+/*
+ * Byte addressed non-volatile storage. Backends may buffer writes until commit().
+ */
+class AP33772SStorage
+{
+public:
+  virtual bool read(uint16_t addr, byte *dst, uint16_t len) = 0;
+  virtual bool write(uint16_t addr, const byte *src, uint16_t len) = 0;
+  virtual bool commit() { return true; }
+  virtual uint16_t size() = 0;
+};
+
+typedef struct
+{
+  bool hit;               // Charger found at the last boot()/restore()
+  uint32_t fingerprint;   // FNV-1a of SRCPDO
+  unsigned long beginUs;  // begin(), SRCPDO read and decode
+  unsigned long lookupUs; // Storage lookup
+  unsigned long bootUs;   // Start of boot() to the cached request written, or to the end on a miss
+  unsigned long saves;    // Slots written
+} CAPCACHE_STATS_T;
+
+class AP33772SCapCache
+{
+public:
+  AP33772SCapCache(AP33772S &usbpd, AP33772SStorage &storage, uint16_t base = 0);
+
+  bool boot();
+  bool restore();
+  bool save();
+  void clear();
+
+  const CAPCACHE_STATS_T &stats() { return _stats; }
+
+private:
+  typedef struct
+  {
+    byte magic;
+    uint16_t seq;         // Higher is more recently saved, renumbered from 1 before it wraps
+    uint32_t hash;
+    uint16_t rdo;
+    byte pdo[SRCPDO_LENGTH];
+  } RECORD_T;
+
+  bool load(byte slot, RECORD_T &record);
+  bool store(byte slot, const RECORD_T &record);
+  int find(uint32_t hash, const byte *pdo, RECORD_T &record);
+  uint16_t renumber();
+  static uint32_t fnv(const byte *data, uint16_t len, uint32_t hash = 2166136261UL);
+
+  AP33772S *_pd;
+  AP33772SStorage *_storage;
+  uint16_t _base;
+  CAPCACHE_STATS_T _stats = {0};
+};
+
+#endif
@@ -0,0 +1,64 @@
+/*
+AP33772S_EEPROM.h - EEPROM backend for AP33772SCapCache.
+
+Header only, so boards without an EEPROM library still build the rest of
+AP33772S. ESP8266, ESP32 and RP2040 emulate EEPROM in flash: begin() sizes
+the emulation and commit() writes it back.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#ifndef __AP33772S_EEPROM__
+#define __AP33772S_EEPROM__
+
+#include <EEPROM.h>
+#include "AP33772S_CapCache.h"
+
+#if defined(ESP8266) || defined(ESP32) || defined(ARDUINO_ARCH_RP2040)
+#define AP33772S_EEPROM_EMULATED
+#endif
+
+class AP33772SEEPROMStorage : public AP33772SStorage
+{
+public:
+  /**
+   * @param size bytes of EEPROM to use, only sizes the flash emulation
+   */
+  void begin(uint16_t size = CAPCACHE_SIZE)
+  {
+#ifdef AP33772S_EEPROM_EMULATED
+    EEPROM.begin(size);
+#else
+    (void)size;
+#endif
+  }
+
+  bool read(uint16_t addr, byte *dst, uint16_t len) override
+  {
+    for(uint16_t i = 0; i < len; i++) dst[i] = EEPROM.read(addr + i);
+    return true;
+  }
+
+  // Unchanged bytes are skipped, an EEPROM cell only wears when it changes
+  bool write(uint16_t addr, const byte *src, uint16_t len) override
+  {
+    for(uint16_t i = 0; i < len; i++)
+      if(EEPROM.read(addr + i) != src[i]) EEPROM.write(addr + i, src[i]);
+    return true;
+  }
+
+  bool commit() override
+  {
+#ifdef AP33772S_EEPROM_EMULATED
+    return EEPROM.commit();
+#else
+    return true;
+#endif
+  }
+
+  uint16_t size() override { return EEPROM.length(); }
+};
+
+#endif
@@ -0,0 +1,149 @@
+/*
+AP33772S_Energy.cpp - Energy and charge accounting for the AP33772S Arduino Library.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#include "AP33772S_Energy.h"
+
+/**
+ * @brief Class constuctor
+ * @param &usbpd the AP33772S whose samples are accounted
+ */
+AP33772SEnergy::AP33772SEnergy(AP33772S &usbpd)
+{
+  _pd = &usbpd;
+}
+
+/**
+ * @brief Start accounting every burst read of the AP33772S, replaces any other sample hook
+ */
+void AP33772SEnergy::attach()
+{
+  _pd->setSampleHook(onSample, this);
+}
+
+/**
+ * @brief Stop accounting, the counters keep their values
+ */
+void AP33772SEnergy::detach()
+{
+  _pd->setSampleHook(NULL);
+  _inSession = false;
+}
+
+/**
+ * @brief Clear the total, the session and the session count
+ */
+void AP33772SEnergy::reset()
+{
+  _session = ACCOUNT_T();
+  _total = ACCOUNT_T();
+  _sessions = 0;
+  _inSession = false;
+}
+
+void AP33772SEnergy::onSample(void *context, const SAMPLE_RAW_T &sample)
+{
+  ((AP33772SEnergy *)context)->add(sample);
+}
+
+/**
+ * @brief Account one sample. Called through the hook, or directly for samples
+ *        read some other way.
+ * @param &sample raw VOLTAGE/CURRENT with t_us set
+ */
+void AP33772SEnergy::add(const SAMPLE_RAW_T &sample)
+{
+  if(!_pd->getOutput())
+  {
+    _inSession = false;
+    return;
+  }
+
+  uint32_t power = (uint32_t)sample.voltage * sample.current;
+  uint32_t current = sample.current;
+
+  if(!_inSession)
+  {
+    // Output went on since the last sample, the session starts here
+    _inSession = true;
+    _sessions++;
+    _session = ACCOUNT_T();
+    accumulate(_session, power, current, 0, false);
+    accumulate(_total, power, current, 0, false);
+  }
+  else
+  {
+    uint32_t dt = sample.t_us - _lastAt;
+    bool gap = dt > ENERGY_MAX_GAP;
+    if(gap) dt = ENERGY_MAX_GAP;
+    accumulate(_session, _lastPower + power, _lastCurrent + current, dt, gap);
+    accumulate(_total, _lastPower + power, _lastCurrent + current, dt, gap);
+  }
+
+  _lastAt = sample.t_us;
+  _lastPower = power;
+  _lastCurrent = current;
+
+  if(power > _session.peak) _session.peak = power;
+  if(power > _total.peak) _total.peak = power;
+}
+
+/**
+ * @brief Add one trapezoid, power and current are the sums of both ends
+ */
+void AP33772SEnergy::accumulate(ACCOUNT_T &account, uint32_t power, uint32_t current, uint32_t dt, bool gap)
+{
+  account.samples++;
+  if(gap) account.gaps++;
+  if(dt == 0) return;
+
+  account.onTimeUs += dt;
+  account.energy += (uint64_t)power * dt;   // Below 2^46 per interval
+  account.charge += (uint64_t)current * dt;
+
+  // Divide only when a whole unit is due, at most once per mWh/mAh
+  if(account.energy >= ENERGY_UNIT_MWH)
+  {
+    account.mWh += (uint32_t)(account.energy / ENERGY_UNIT_MWH);
+    account.energy %= ENERGY_UNIT_MWH;
+  }
+  if(account.charge >= ENERGY_UNIT_MAH)
+  {
+    account.mAh += (uint32_t)(account.charge / ENERGY_UNIT_MAH);
+    account.charge %= ENERGY_UNIT_MAH;
+  }
+}
+
+ENERGY_T AP33772SEnergy::report(const ACCOUNT_T &account)
+{
+  ENERGY_T e;
+  e.energy_mWh = account.mWh;
+  e.energy_uWh = (uint16_t)(account.energy * 1000 / ENERGY_UNIT_MWH);
+  e.charge_mAh = account.mAh;
+  e.charge_uAh = (uint16_t)(account.charge * 1000 / ENERGY_UNIT_MAH);
+  e.peak_mW = account.peak * 48 / 25; // 80mV x 24mA = 1.92mW
+  e.onTimeMs = (uint32_t)(account.onTimeUs / 1000);
+  e.samples = account.samples;
+  e.gaps = account.gaps;
+  return e;
+}
+
+/**
+ * @brief Counters of the running session, or of the last one once the output is off
+ */
+ENERGY_T AP33772SEnergy::session()
+{
+  return report(_session);
+}
+
+/**
+ * @brief Counters over all sessions since reset()
+ */
+ENERGY_T AP33772SEnergy::total()
+{
+  return report(_total);
+}
@@ -0,0 +1,89 @@
+/*
+AP33772S_Energy.h - Energy and charge accounting for the AP33772S Arduino Library.
+
+Integrates VxI and I over time from the VOLTAGE/CURRENT bursts the library
+already reads (readSample() from the sampler or regulator, readTelemetry()
+from SCPI), through AP33772S::setSampleHook(). It adds no bus traffic: the
+accounting is as fine as whatever is sampling.
+
+Integration is trapezoidal on raw register values, in 64-bit accumulators
+that carry whole mWh/mAh into 32-bit counters. 1 mWh is exactly 1875000000
+(80mV x 24mA x 1us) units and 1 mAh exactly 150000000 (24mA x 1us), so
+nothing is rounded before the carry. The counters wrap after 4.29 MWh.
+
+Only time with the output on (setOutput(1)) is counted. Each on period is
+a session, kept apart from the running total.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#ifndef __AP33772S_ENERGY__
+#define __AP33772S_ENERGY__
+
+#include "AP33772S.h"
+
+#define ENERGY_MAX_GAP 1000000UL // us, longer sample intervals are only counted up to this
+
+// Trapezoid sums carry twice the area, so the units are doubled
+#define ENERGY_UNIT_MWH 3750000000ULL // 2 * 3.6e9 mW.us / (80mV * 24mA)
+#define ENERGY_UNIT_MAH 300000000ULL  // 2 * 3.6e9 mA.us / 24mA
+
+typedef struct
+{
+  uint32_t energy_mWh;
+  uint16_t energy_uWh;  // Fraction of a mWh, 0..999
+  uint32_t charge_mAh;
+  uint16_t charge_uAh;  // Fraction of a mAh, 0..999
+  uint32_t peak_mW;
+  uint32_t onTimeMs;
+  uint32_t samples;
+  uint32_t gaps;        // Intervals cut to ENERGY_MAX_GAP
+} ENERGY_T;
+
+class AP33772SEnergy
+{
+public:
+  AP33772SEnergy(AP33772S &usbpd);
+
+  void attach();
+  void detach();
+  void reset();
+  void add(const SAMPLE_RAW_T &sample);
+
+  ENERGY_T session();       // Current session, or the last one while the output is off
+  ENERGY_T total();         // All sessions since reset()
+  unsigned long sessions() { return _sessions; }
+  bool inSession() { return _inSession; }
+
+private:
+  typedef struct
+  {
+    uint64_t energy;        // 80mV x 24mA x 1us x 2, below ENERGY_UNIT_MWH after carry
+    uint64_t charge;        // 24mA x 1us x 2, below ENERGY_UNIT_MAH after carry
+    uint64_t onTimeUs;
+    uint32_t mWh;
+    uint32_t mAh;
+    uint32_t peak;          // 80mV x 24mA
+    uint32_t samples;
+    uint32_t gaps;
+  } ACCOUNT_T;
+
+  static void onSample(void *context, const SAMPLE_RAW_T &sample);
+  static void accumulate(ACCOUNT_T &account, uint32_t power, uint32_t current, uint32_t dt, bool gap);
+  static ENERGY_T report(const ACCOUNT_T &account);
+
+  AP33772S *_pd;
+  ACCOUNT_T _session = {0};
+  ACCOUNT_T _total = {0};
+  unsigned long _sessions = 0;
+  bool _inSession = false;
+
+  // Previous sample in this session
+  uint32_t _lastAt = 0;
+  uint32_t _lastPower = 0;
+  uint32_t _lastCurrent = 0;
+};
+
+#endif
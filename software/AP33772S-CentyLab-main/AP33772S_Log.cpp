@@ -0,0 +1,93 @@
+/*
+AP33772S_Log.cpp - Deferred event logging for the AP33772S Arduino Library.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#include "AP33772S_Log.h"
+
+LOG_EVENT_T AP33772SLog::buf[LOG_BUFF_LENGTH];
+volatile byte AP33772SLog::head = 0;
+volatile byte AP33772SLog::tail = 0;
+unsigned int AP33772SLog::lost = 0;
+
+static const char *const LOG_MESSAGES[LOG_CODE_COUNT] = {
+  "Type is fixed. PDO",
+  "Type is PPS. PDO",
+  "Type is AVS. PDO",
+  "Current not in range. mA",
+  "PPS Current not in range. mA",
+  "PPS Voltage not in range. mV",
+  "AVS Current not in range. mA",
+  "AVS Voltage not in range. mV",
+  "Found PPS profile. PDO",
+  "Found AVS profile. PDO",
+};
+
+/**
+ * @brief Store one event. Drops it and counts the loss when the buffer is full.
+ * @param level AP33772S_LOG_ERROR .. AP33772S_LOG_DEBUG
+ * @param code AP33772S_LOG_CODE
+ * @param arg value the message refers to
+ */
+void AP33772SLog::push(byte level, byte code, int arg)
+{
+  byte next = (head + 1) & (LOG_BUFF_LENGTH - 1);
+  if(next == tail)
+  {
+    lost++;
+    return;
+  }
+  buf[head].code = code;
+  buf[head].level = level;
+  buf[head].arg = arg;
+  head = next;
+}
+
+/**
+ * @brief Take the oldest event out of the buffer
+ * @return 0 if the buffer is empty
+ */
+bool AP33772SLog::pop(LOG_EVENT_T &event)
+{
+  if(tail == head) return 0;
+  event = buf[tail];
+  tail = (tail + 1) & (LOG_BUFF_LENGTH - 1);
+  return 1;
+}
+
+/**
+ * @brief Format pending events, one line each. Call from loop().
+ * @param out Serial or any other Print
+ * @param max upper bound of events printed in this call
+ * @return number of events printed
+ */
+int AP33772SLog::drain(Print &out, int max)
+{
+  LOG_EVENT_T event;
+  int n = 0;
+  while(n < max && pop(event))
+  {
+    out.print("AP33772S: ");
+    out.print(message(event.code));
+    out.print(' ');
+    out.println(event.arg);
+    n++;
+  }
+  return n;
+}
+
+/**
+ * @brief Number of events lost because drain() was not called often enough
+ */
+unsigned int AP33772SLog::dropped()
+{
+  return lost;
+}
+
+const char *AP33772SLog::message(byte code)
+{
+  return code < LOG_CODE_COUNT ? LOG_MESSAGES[code] : "Unknown event";
+}
@@ -0,0 +1,90 @@
+/*
+AP33772S_Log.h - Deferred event logging for the AP33772S Arduino Library.
+
+Library messages are stored as compact event codes in a ring buffer and
+formatted later by drain(), usually from loop(), so no Serial time is spent
+on the negotiation path. Messages above AP33772S_LOG_LEVEL compile to nothing.
+Set the level with a build flag, e.g. -DAP33772S_LOG_LEVEL=3 for debug.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#ifndef __AP33772S_LOG__
+#define __AP33772S_LOG__
+
+#if ARDUINO >= 100
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#define AP33772S_LOG_NONE  0
+#define AP33772S_LOG_ERROR 1 // Rejected requests
+#define AP33772S_LOG_INFO  2 // Profile discovery
+#define AP33772S_LOG_DEBUG 3 // Every request
+
+#ifndef AP33772S_LOG_LEVEL
+#define AP33772S_LOG_LEVEL AP33772S_LOG_ERROR
+#endif
+
+#define LOG_BUFF_LENGTH 32 // Power of 2
+
+typedef enum
+{
+  LOG_TYPE_FIXED = 0,
+  LOG_TYPE_PPS,
+  LOG_TYPE_AVS,
+  LOG_FIXED_CURRENT_RANGE,
+  LOG_PPS_CURRENT_RANGE,
+  LOG_PPS_VOLTAGE_RANGE,
+  LOG_AVS_CURRENT_RANGE,
+  LOG_AVS_VOLTAGE_RANGE,
+  LOG_FOUND_PPS,
+  LOG_FOUND_AVS,
+  LOG_CODE_COUNT
+} AP33772S_LOG_CODE;
+
+typedef struct
+{
+  byte code;   // AP33772S_LOG_CODE
+  byte level;
+  int16_t arg; // Value the message refers to, PDO index or mV/mA
+} LOG_EVENT_T;
+
+class AP33772SLog
+{
+public:
+  static void push(byte level, byte code, int arg);
+  static bool pop(LOG_EVENT_T &event);
+  static int drain(Print &out, int max = LOG_BUFF_LENGTH);
+  static unsigned int dropped();
+  static const char *message(byte code);
+
+private:
+  static LOG_EVENT_T buf[LOG_BUFF_LENGTH];
+  static volatile byte head;
+  static volatile byte tail;
+  static unsigned int lost;
+};
+
+#if AP33772S_LOG_LEVEL >= AP33772S_LOG_ERROR
+#define AP33772S_LOGE(code, arg) AP33772SLog::push(AP33772S_LOG_ERROR, code, arg)
+#else
+#define AP33772S_LOGE(code, arg) do {} while (0)
+#endif
+
+#if AP33772S_LOG_LEVEL >= AP33772S_LOG_INFO
+#define AP33772S_LOGI(code, arg) AP33772SLog::push(AP33772S_LOG_INFO, code, arg)
+#else
+#define AP33772S_LOGI(code, arg) do {} while (0)
+#endif
+
+#if AP33772S_LOG_LEVEL >= AP33772S_LOG_DEBUG
+#define AP33772S_LOGD(code, arg) AP33772SLog::push(AP33772S_LOG_DEBUG, code, arg)
+#else
+#define AP33772S_LOGD(code, arg) do {} while (0)
+#endif
+
+#endif
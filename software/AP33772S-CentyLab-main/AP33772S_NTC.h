@@ -0,0 +1,106 @@
+/*
+AP33772S_NTC.h - NTC calibration for the AP33772S Arduino Library.
+
+Computes the TR25/TR50/TR75/TR100 resistances from a thermistor's Beta or
+Steinhart-Hart coefficients. Everything is constexpr, so with constant
+coefficients the table is folded by the compiler and no floating point math
+reaches the target:
+
+  constexpr NTC_T NCP18XH103 = ntcFromBeta(10000, 3380);
+  usbpd.setNTC(NCP18XH103);
+
+  constexpr NTC_T GENERIC_3950 = ntcFromSteinhartHart(1.009249522e-03, 2.378405444e-04, 2.019202697e-07);
+
+Only single-return constexpr functions are used, so C++11 compilers accept it.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#ifndef __AP33772S_NTC__
+#define __AP33772S_NTC__
+
+#include "AP33772S.h"
+
+#define NTC_KELVIN 273.15
+
+namespace AP33772SNTCMath
+{
+  constexpr double square(double x) { return x * x; }
+
+  // Taylor series, only used for |x| <= 0.5 where 12 terms are exact to double precision
+  constexpr double expSeries(double x, double term, int n)
+  {
+    return n > 12 ? 0 : term + expSeries(x, term * x / n, n + 1);
+  }
+  constexpr double exp(double x)
+  {
+    return (x > 0.5 || x < -0.5) ? square(exp(x / 2)) : expSeries(x, 1, 1);
+  }
+
+  constexpr double cbrtStep(double x, double y, int n)
+  {
+    return n == 0 ? y : cbrtStep(x, y - (y * y * y - x) / (3 * y * y), n - 1);
+  }
+  constexpr double cbrt(double x)
+  {
+    return x < 0 ? -cbrt(-x) : x == 0 ? 0 : cbrtStep(x, x > 1 ? x / 3 : 1, 60);
+  }
+
+  constexpr double sqrtStep(double x, double y, int n)
+  {
+    return n == 0 ? y : sqrtStep(x, (y + x / y) / 2, n - 1);
+  }
+  constexpr double sqrt(double x)
+  {
+    return x <= 0 ? 0 : sqrtStep(x, x > 1 ? x : 1, 60);
+  }
+
+  constexpr uint16_t ohm(double r)
+  {
+    return r < 0 ? 0 : r > 65535 ? 65535 : (uint16_t)(r + 0.5);
+  }
+
+  // R(T) = R25 * exp(B * (1/T - 1/T25))
+  constexpr uint16_t beta(double r25, double b, double celsius)
+  {
+    return ohm(r25 * exp(b * (1 / (celsius + NTC_KELVIN) - 1 / (25 + NTC_KELVIN))));
+  }
+
+  // 1/T = A + B ln(R) + C ln(R)^3, solved for ln(R) with Cardano's formula
+  constexpr double shX(double b, double c, double y)
+  {
+    return sqrt(square(b / (3 * c)) * (b / (3 * c)) + square(y) / 4);
+  }
+  constexpr double shLnR(double b, double c, double y)
+  {
+    return cbrt(shX(b, c, y) - y / 2) - cbrt(shX(b, c, y) + y / 2);
+  }
+  constexpr uint16_t steinhartHart(double a, double b, double c, double celsius)
+  {
+    return ohm(exp(shLnR(b, c, (a - 1 / (celsius + NTC_KELVIN)) / c)));
+  }
+}
+
+/**
+ * @brief NTC table from the Beta model
+ * @param r25 resistance at 25C in Ohm
+ * @param beta B25/85 or B25/50 constant from the thermistor datasheet, in K
+ */
+constexpr NTC_T ntcFromBeta(double r25, double beta)
+{
+  return NTC_T{AP33772SNTCMath::beta(r25, beta, 25), AP33772SNTCMath::beta(r25, beta, 50),
+               AP33772SNTCMath::beta(r25, beta, 75), AP33772SNTCMath::beta(r25, beta, 100)};
+}
+
+/**
+ * @brief NTC table from Steinhart-Hart coefficients, 1/T = A + B ln(R) + C ln(R)^3
+ */
+constexpr NTC_T ntcFromSteinhartHart(double a, double b, double c)
+{
+  return NTC_T{AP33772SNTCMath::steinhartHart(a, b, c, 25), AP33772SNTCMath::steinhartHart(a, b, c, 50),
+               AP33772SNTCMath::steinhartHart(a, b, c, 75), AP33772SNTCMath::steinhartHart(a, b, c, 100)};
+}
+
+#endif
@@ -0,0 +1,167 @@
+/*
+AP33772S_Ramp.cpp - Voltage ramp engine for the AP33772S Arduino Library.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#include "AP33772S_Ramp.h"
+
+/**
+ * @brief Class constuctor
+ * @param &usbpd the AP33772S the ramp drives
+ */
+AP33772SRamp::AP33772SRamp(AP33772S &usbpd)
+{
+  _pd = &usbpd;
+}
+
+/**
+ * @brief Start a ramp. The PDO for every step is picked by requestPower(), which stays
+ *        on the current PPS/AVS PDO while it covers the step.
+ * @param from_mV voltage the output is at now
+ * @param target_mV voltage to ramp to
+ * @param max_current unit in mA, for every step
+ * @param step_mV size of one request, use a multiple of 100mV (PPS) or 200mV (AVS)
+ * @param slew_mV_per_s maximum ramp rate, 0 to go as fast as the source accepts
+ * @return 0 if the arguments make no sense
+ */
+bool AP33772SRamp::start(int from_mV, int target_mV, int max_current, int step_mV, unsigned long slew_mV_per_s)
+{
+  if(step_mV <= 0 || max_current <= 0) return 0;
+
+  unsigned long now = millis();
+  _current = from_mV;
+  _next = from_mV;
+  _target = target_mV;
+  _maxCurrent = max_current;
+  _step = step_mV;
+  _slew = slew_mV_per_s;
+  _steps = 0;
+  _retrying = false;
+  _startAt = now;
+  _nextStepAt = now;
+  _state = _current == _target ? RAMP_DONE : RAMP_STEP;
+  _endAt = now;
+  return 1;
+}
+
+/**
+ * @brief Advance the ramp, at most one I2C transaction per call
+ * @param now current time in ms, usually millis()
+ */
+void AP33772SRamp::service(unsigned long now)
+{
+  switch(_state)
+  {
+    case RAMP_STEP:
+      if((long)(now - _nextStepAt) >= 0) issueStep(now);
+      break;
+
+    case RAMP_WAIT_ACCEPT:
+    {
+      if((long)(now - _nextPollAt) < 0) break;
+      _nextPollAt = now + RAMP_POLL_INTERVAL;
+      byte result = _pd->readMsgResult();
+      if(result == MSGRLT_SUCCESS) _state = RAMP_WAIT_SETTLE;
+      else if(result != MSGRLT_BUSY || now - _stepAt > RAMP_STEP_TIMEOUT) finish(RAMP_ERROR, now);
+      break;
+    }
+
+    case RAMP_WAIT_SETTLE:
+    {
+      if((long)(now - _nextPollAt) < 0) break;
+      _nextPollAt = now + RAMP_POLL_INTERVAL;
+      int mV = _pd->readVoltage(); // -1 on a bus error, asked again at the next poll
+      int diff = mV - _next;
+      if(mV >= 0 && diff <= _tolerance && diff >= -_tolerance)
+      {
+        _current = _next;
+        _steps++;
+        if(_current == _target) finish(RAMP_DONE, now);
+        else _state = RAMP_STEP;
+      }
+      else if(now - _stepAt > RAMP_STEP_TIMEOUT) finish(RAMP_ERROR, now);
+      break;
+    }
+
+    default:
+      break;
+  }
+}
+
+/**
+ * @brief service() using millis() as time base
+ */
+void AP33772SRamp::poll()
+{
+  service(millis());
+}
+
+/**
+ * @brief Abort the ramp, the output stays at the last requested step
+ */
+void AP33772SRamp::stop()
+{
+  if(busy()) finish(RAMP_IDLE, millis());
+}
+
+void AP33772SRamp::issueStep(unsigned long now)
+{
+  if(_target > _current) _next = _current + _step > _target ? _target : _current + _step;
+  else _next = _current - _step < _target ? _target : _current - _step;
+
+  if(_pd->requestPower(_next, _maxCurrent) < 0)
+  {
+    // No PDO covers the step, or the bus failed: then the same step again shortly, for up to RAMP_STEP_TIMEOUT
+    if(_pd->busStatus() == BUS_OK) finish(RAMP_ERROR, now);
+    else if(!_retrying)
+    {
+      _retrying = true;
+      _stepAt = now;
+      _nextStepAt = now + RAMP_POLL_INTERVAL;
+    }
+    else if(now - _stepAt > RAMP_STEP_TIMEOUT) finish(RAMP_ERROR, now);
+    else _nextStepAt = now + RAMP_POLL_INTERVAL;
+    return;
+  }
+
+  _retrying = false;
+  _stepAt = now;
+  _nextPollAt = now + RAMP_POLL_INTERVAL;
+  int delta = _next > _current ? _next - _current : _current - _next;
+  _nextStepAt = _slew ? now + (unsigned long)delta * 1000UL / _slew : now;
+  _state = RAMP_WAIT_ACCEPT;
+}
+
+void AP33772SRamp::finish(AP33772S_RAMP_STATE state, unsigned long now)
+{
+  _state = state;
+  _endAt = now;
+}
+
+AP33772S_RAMP_STATE AP33772SRamp::state()
+{
+  return _state;
+}
+
+bool AP33772SRamp::busy()
+{
+  return _state == RAMP_STEP || _state == RAMP_WAIT_ACCEPT || _state == RAMP_WAIT_SETTLE;
+}
+
+int AP33772SRamp::voltage()
+{
+  return _current;
+}
+
+unsigned int AP33772SRamp::steps()
+{
+  return _steps;
+}
+
+unsigned long AP33772SRamp::elapsed()
+{
+  return (busy() ? millis() : _endAt) - _startAt;
+}
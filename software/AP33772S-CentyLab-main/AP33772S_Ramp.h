@@ -0,0 +1,71 @@
+/*
+AP33772S_Ramp.h - Voltage ramp engine for the AP33772S Arduino Library.
+
+Steps the PPS/AVS output towards a target. Each step is issued as soon as the
+previous one is accepted (PD_MSGRLT) and VBUS has reached it (VOLTAGE),
+optionally limited by a slew rate, instead of waiting a fixed delay.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#ifndef __AP33772S_RAMP__
+#define __AP33772S_RAMP__
+
+#include "AP33772S.h"
+
+#define RAMP_TOLERANCE     240  // mV, VBUS within 3 LSB of the step counts as reached
+#define RAMP_POLL_INTERVAL 2    // ms between MSGRLT/VOLTAGE polls
+#define RAMP_STEP_TIMEOUT  1000 // ms for one step to be accepted and settle
+
+typedef enum
+{
+  RAMP_IDLE = 0,
+  RAMP_STEP,         // Ready to issue next step, or to retry it after a bus error
+  RAMP_WAIT_ACCEPT,  // Polling PD_MSGRLT
+  RAMP_WAIT_SETTLE,  // Polling VOLTAGE
+  RAMP_DONE,
+  RAMP_ERROR
+} AP33772S_RAMP_STATE;
+
+class AP33772SRamp
+{
+public:
+  AP33772SRamp(AP33772S &usbpd);
+
+  bool start(int from_mV, int target_mV, int max_current, int step_mV, unsigned long slew_mV_per_s = 0);
+  void service(unsigned long now);
+  void poll();
+  void stop();
+
+  AP33772S_RAMP_STATE state();
+  bool busy();
+  int voltage();                // Last step reached, mV
+  unsigned int steps();         // Steps completed
+  unsigned long elapsed();      // ms from start() to RAMP_DONE/RAMP_ERROR (or now)
+  void setTolerance(int mV) { _tolerance = mV; }
+
+private:
+  void issueStep(unsigned long now);
+  void finish(AP33772S_RAMP_STATE state, unsigned long now);
+
+  AP33772S *_pd;
+  AP33772S_RAMP_STATE _state = RAMP_IDLE;
+  int _current = 0;     // Voltage reached, mV
+  int _next = 0;        // Voltage requested, mV
+  int _target = 0;
+  int _maxCurrent = 0;
+  int _step = 0;
+  int _tolerance = RAMP_TOLERANCE;
+  unsigned long _slew = 0;
+  unsigned long _startAt = 0;
+  unsigned long _endAt = 0;
+  unsigned long _stepAt = 0;    // When the current step was issued
+  unsigned long _nextPollAt = 0;
+  unsigned long _nextStepAt = 0; // Slew limit
+  unsigned int _steps = 0;
+  bool _retrying = false;       // Request of this step refused by the bus, _stepAt is the first try
+};
+
+#endif
@@ -0,0 +1,106 @@
+/*
+AP33772S_Registers.h - Register map for the AP33772S Arduino Library.
+
+Every data register is described once by a type: command address, width in
+bytes, LSB weight and unit, or the list of values for enumerated registers.
+AP33772S::read<R>() and AP33772S::write<R>() are generated from these, so
+scaling lives in one place and is resolved at compile time. Dividing by a
+constant LSB compiles to a multiply and shift, never a divide instruction.
+
+  int mV = usbpd.read<R_VOLTAGE>().value;
+  usbpd.write<R_OVPTHR>(MILLIVOLT_T(2000));   // Checked at run time
+  usbpd.write<R_OVPTHR, 2000>();              // Checked by the compiler
+  usbpd.write<R_OVPTHR, 30000>();             // Does not build: out of range
+
+Units are distinct types, so a current cannot be written to a voltage register.
+Included by AP33772S.h after the CMD_* addresses.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#ifndef __AP33772S_REGISTERS__
+#define __AP33772S_REGISTERS__
+
+#include <stdint.h>
+
+// Strongly typed units, explicit so a plain int has to say what it is
+struct MILLIVOLT_T { int32_t value; constexpr explicit MILLIVOLT_T(int32_t v) : value(v) {} };
+struct MILLIAMP_T  { int32_t value; constexpr explicit MILLIAMP_T(int32_t v) : value(v) {} };
+struct CELSIUS_T   { int32_t value; constexpr explicit CELSIUS_T(int32_t v) : value(v) {} };
+struct PERCENT_T   { int32_t value; constexpr explicit PERCENT_T(int32_t v) : value(v) {} };
+struct OHM_T       { int32_t value; constexpr explicit OHM_T(int32_t v) : value(v) {} };
+
+constexpr MILLIVOLT_T operator"" _mV(unsigned long long v) { return MILLIVOLT_T((int32_t)v); }
+constexpr MILLIAMP_T operator"" _mA(unsigned long long v) { return MILLIAMP_T((int32_t)v); }
+constexpr CELSIUS_T operator"" _degC(unsigned long long v) { return CELSIUS_T((int32_t)v); }
+
+/*
+ * Linear register: value = raw * LSB, raw in RAW_MIN..RAW_MAX, little endian
+ */
+template <uint8_t ADDR, uint8_t WIDTH, uint16_t LSB, typename UNIT,
+          uint16_t RAW_MIN = 0, uint16_t RAW_MAX = (WIDTH == 1 ? 0xff : 0xffff)>
+struct AP33772SReg
+{
+  typedef UNIT unit_t;
+  enum { addr = ADDR, width = WIDTH, lsb = LSB };
+
+  static constexpr int32_t min() { return (int32_t)RAW_MIN * LSB; }
+  static constexpr int32_t max() { return (int32_t)RAW_MAX * LSB; }
+  static constexpr bool valid(int32_t value) { return value >= min() && value <= max(); }
+  static constexpr UNIT decode(uint16_t raw) { return UNIT((int32_t)raw * LSB); }
+  static constexpr uint16_t encode(UNIT v) { return (uint16_t)(v.value / LSB); }
+};
+
+/*
+ * Enumerated register: raw 1 is the first value, raw 2 the second and so on.
+ * Raw values outside the list decode to -1.
+ */
+template <uint8_t ADDR, typename UNIT, int32_t... VALUES>
+struct AP33772SEnumReg
+{
+  typedef UNIT unit_t;
+  enum { addr = ADDR, width = 1, lsb = 0 };
+
+  static constexpr bool valid(int32_t value) { return find(value, 1, VALUES...) != 0; }
+  static constexpr UNIT decode(uint16_t raw) { return UNIT(at(raw, 1, VALUES...)); }
+  static constexpr uint16_t encode(UNIT v) { return find(v.value, 1, VALUES...); }
+
+private:
+  static constexpr uint16_t find(int32_t, uint16_t) { return 0; }
+  template <typename... REST>
+  static constexpr uint16_t find(int32_t value, uint16_t raw, int32_t first, REST... rest)
+  {
+    return value == first ? raw : find(value, raw + 1, rest...);
+  }
+  static constexpr int32_t at(uint16_t, uint16_t) { return -1; }
+  template <typename... REST>
+  static constexpr int32_t at(uint16_t raw, uint16_t n, int32_t first, REST... rest)
+  {
+    return raw == n ? first : at(raw, n + 1, rest...);
+  }
+};
+
+// NTC resistance table
+typedef AP33772SReg<CMD_TR25,    2, 1,   OHM_T>       R_TR25;
+typedef AP33772SReg<CMD_TR50,    2, 1,   OHM_T>       R_TR50;
+typedef AP33772SReg<CMD_TR75,    2, 1,   OHM_T>       R_TR75;
+typedef AP33772SReg<CMD_TR100,   2, 1,   OHM_T>       R_TR100;
+
+// Measurements, read only
+typedef AP33772SReg<CMD_VOLTAGE, 2, 80,  MILLIVOLT_T> R_VOLTAGE;
+typedef AP33772SReg<CMD_CURRENT, 1, 24,  MILLIAMP_T>  R_CURRENT;
+typedef AP33772SReg<CMD_TEMP,    1, 1,   CELSIUS_T>   R_TEMP;
+typedef AP33772SReg<CMD_VREQ,    2, 50,  MILLIVOLT_T> R_VREQ;
+typedef AP33772SReg<CMD_IREQ,    2, 10,  MILLIAMP_T>  R_IREQ;
+
+// Protection thresholds
+typedef AP33772SReg<CMD_VSELMIN, 1, 200, MILLIVOLT_T> R_VSELMIN;
+typedef AP33772SEnumReg<CMD_UVPTHR, PERCENT_T, 80, 75, 70> R_UVPTHR; // % of VREQ
+typedef AP33772SReg<CMD_OVPTHR,  1, 80,  MILLIVOLT_T> R_OVPTHR;      // Offset above VREQ
+typedef AP33772SReg<CMD_OCPTHR,  1, 50,  MILLIAMP_T>  R_OCPTHR;
+typedef AP33772SReg<CMD_OTPTHR,  1, 1,   CELSIUS_T>   R_OTPTHR;
+typedef AP33772SReg<CMD_DRTHR,   1, 1,   CELSIUS_T>   R_DRTHR;
+
+#endif
@@ -0,0 +1,234 @@
+/*
+AP33772S_Regulator.cpp - Closed-loop CV/CC regulation for the AP33772S Arduino Library.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#include "AP33772S_Regulator.h"
+
+/**
+ * @brief Class constuctor
+ * @param &usbpd the AP33772S to regulate
+ */
+AP33772SRegulator::AP33772SRegulator(AP33772S &usbpd)
+{
+  _pd = &usbpd;
+  updateKiT();
+}
+
+/**
+ * @brief Constant voltage, the measured voltage is held at target plus the load-line drop
+ * @param target_mV voltage wanted at the load
+ * @param max_current current limit asked from the source, mA
+ * @param loadline_mOhm resistance between the VOLTAGE sense point and the load, 0 to regulate at the board
+ * @return 0 if no PPS/AVS PDO covers the target
+ */
+bool AP33772SRegulator::startCV(int target_mV, int max_current, int loadline_mOhm)
+{
+  _loadline = loadline_mOhm;
+  _kp = REG_CV_KP;
+  _ki = REG_CV_KI;
+  _tolerance = REG_CV_TOLERANCE;
+  return start(REG_CV, target_mV, 0x7fff, max_current, target_mV);
+}
+
+/**
+ * @brief Constant current, the request voltage is moved until CURRENT reads target.
+ *        Starts from the bottom of the PPS/AVS range and never goes above max_mV.
+ * @param target_mA load current
+ * @param max_mV compliance voltage
+ * @return 0 if no PPS/AVS PDO can supply the current
+ */
+bool AP33772SRegulator::startCC(int target_mA, int max_mV)
+{
+  _loadline = 0;
+  _kp = REG_CC_KP;
+  _ki = REG_CC_KI;
+  _tolerance = REG_CC_TOLERANCE;
+  int limit = target_mA + target_mA / 4; // Headroom so the source's own limit stays out of the way
+  if(limit > 5000) limit = 5000;
+  return start(REG_CC, target_mA, max_mV, limit, 0);
+}
+
+bool AP33772SRegulator::start(AP33772S_REG_MODE mode, int target, int max_mV, int max_current, int start_mV)
+{
+  // First PPS, then AVS, profile that can carry the current (and the start voltage)
+  const PDO_CAP_T *cap = NULL;
+  for(int n = 0; n < _pd->getPPSCount() + _pd->getAVSCount() && cap == NULL; n++)
+  {
+    int index = n < _pd->getPPSCount() ? _pd->getPPSIndex(n) : _pd->getAVSIndex(n - _pd->getPPSCount());
+    const PDO_CAP_T *c = _pd->getPDOCap(index);
+    if(c == NULL || c->max_mA < max_current) continue;
+    if(start_mV && (start_mV < c->min_mV || start_mV > c->max_mV)) continue;
+    if(!start_mV && c->min_mV > max_mV) continue;
+    cap = c;
+  }
+  if(cap == NULL) return 0;
+
+  _mode = mode;
+  _target = target;
+  _maxCurrent = max_current;
+  _pdoIndex = cap->index;
+  _kind = cap->kind;
+  _min_mV = cap->min_mV;
+  _max_mV = cap->max_mV < max_mV ? cap->max_mV : max_mV;
+  updateKiT();
+
+  _error = 0;
+  _lastError = 0;
+  _requested = 0;
+  _u = (long)(start_mV ? start_mV : _min_mV) << 8;
+  resetStats();
+  request(_u >> 8);
+
+  _nextAt = micros() + _period;
+  return 1;
+}
+
+/**
+ * @brief Stop regulating, the last request stays in place
+ */
+void AP33772SRegulator::stop()
+{
+  _mode = REG_OFF;
+}
+
+/**
+ * @brief Change the target without restarting, settle time is measured from here
+ * @param target mV in CV, mA in CC
+ */
+void AP33772SRegulator::setTarget(int target)
+{
+  _target = target;
+  _targetAt = micros();
+  _inBand = 0;
+  _stats.settled = false;
+  _stats.settleMs = 0;
+}
+
+/**
+ * @brief Controller gains, Q8 fixed point (256 = 1.0)
+ * @param kp_q8 proportional, on the change of error
+ * @param ki_q8 integral, per second
+ */
+void AP33772SRegulator::setGains(long kp_q8, long ki_q8)
+{
+  _kp = kp_q8;
+  _ki = ki_q8;
+  updateKiT();
+}
+
+/**
+ * @brief Loop period. Each loop costs one 4-byte read, and a 3-byte request write
+ *        when the output moves.
+ */
+void AP33772SRegulator::setPeriod(unsigned long period_ms)
+{
+  _period = period_ms * 1000UL;
+  updateKiT();
+}
+
+void AP33772SRegulator::updateKiT()
+{
+  _kiT = _ki * (long)(_period / 1000UL) / 1000; // Once here, not per loop
+}
+
+/**
+ * @brief Run one loop when due
+ * @param now_us current time in us, usually micros()
+ */
+void AP33772SRegulator::service(unsigned long now_us)
+{
+  if(_mode == REG_OFF || (long)(now_us - _nextAt) < 0) return;
+
+  // Interval jitter against the nominal period
+  if(_stats.loops > 0)
+  {
+    unsigned long interval = now_us - _lastAt;
+    unsigned long jitter = interval > _period ? interval - _period : _period - interval;
+    if(jitter > _stats.jitterMaxUs) _stats.jitterMaxUs = jitter;
+    _stats.jitterSumUs += jitter;
+    _stats.elapsedUs = now_us - _firstAt;
+  }
+  else _firstAt = now_us;
+  _lastAt = now_us;
+  _stats.loops++;
+  _nextAt += _period;
+  if((long)(now_us - _nextAt) >= 0) _nextAt = now_us + _period; // Overran, do not burst
+
+  SAMPLE_RAW_T sample;
+  if(!_pd->readSample(sample)) return;
+  _voltage = sample.voltage * 80; // 80mV/LSB
+  _current = sample.current * 24; // 24mA/LSB
+
+  if(_mode == REG_CV) _error = _target + (long)_current * _loadline / 1000 - _voltage;
+  else _error = _target - _current;
+
+  if(_error <= _tolerance && _error >= -_tolerance)
+  {
+    if(!_stats.settled && ++_inBand >= REG_SETTLE_COUNT)
+    {
+      _stats.settled = true;
+      _stats.settleMs = (now_us - _targetAt) / 1000;
+    }
+  }
+  else _inBand = 0;
+
+  // Inside half the tolerance counts as on target, keeps quantization from limit cycling
+  int e = (_error <= _tolerance / 2 && _error >= -_tolerance / 2) ? 0 : _error;
+  long du = _kp * (e - _lastError) + _kiT * e;
+  _lastError = e;
+  if(du > ((long)REG_MAX_STEP << 8)) du = (long)REG_MAX_STEP << 8;
+  if(du < -((long)REG_MAX_STEP << 8)) du = -((long)REG_MAX_STEP << 8);
+
+  // Clamping the accumulated output is the anti-windup
+  _u += du;
+  if(_u > ((long)_max_mV << 8)) _u = (long)_max_mV << 8;
+  if(_u < ((long)_min_mV << 8)) _u = (long)_min_mV << 8;
+
+  request(_u >> 8);
+}
+
+/**
+ * @brief service() using micros() as time base
+ */
+void AP33772SRegulator::poll()
+{
+  service(micros());
+}
+
+/**
+ * @brief Round to the PDO voltage step and send it if it changed
+ */
+void AP33772SRegulator::request(int mV)
+{
+  int step = _kind == PDO_PPS ? 100 : 200;
+  int q = (mV + step / 2) / step * step;
+  if(q > _max_mV) q -= step;
+  if(q < _min_mV) q += step;
+  if(q == _requested) return;
+
+  bool ok = _kind == PDO_PPS ? _pd->setPPSPDO(_pdoIndex, q, _maxCurrent)
+                             : _pd->setAVSPDO(_pdoIndex, q, _maxCurrent);
+  if(!ok) return; // Lost on the bus, sent again by the next loop
+  _requested = q;
+  _stats.requests++;
+}
+
+/**
+ * @brief Loops per second over the time measured so far
+ */
+unsigned long AP33772SRegulator::loopRate()
+{
+  if(_stats.elapsedUs == 0) return 0;
+  return (unsigned long)((_stats.loops - 1) * 1000000ULL / _stats.elapsedUs);
+}
+
+void AP33772SRegulator::resetStats()
+{
+  _stats = REG_STATS_T();
+  _inBand = 0;
+  _targetAt = micros();
+}
@@ -0,0 +1,117 @@
+/*
+AP33772S_Regulator.h - Closed-loop CV/CC regulation for the AP33772S Arduino Library.
+
+Reads VOLTAGE and CURRENT every period and moves the PPS/AVS request with a
+fixed-point PI controller (velocity form, Q8 gains), so the output holds its
+voltage against cable drop (CV, with optional load-line compensation beyond
+the sense point) or holds a load current (CC) for LED and battery loads.
+
+Each loop costs one 4-byte burst read, plus one 3-byte request write when
+the quantized output (100mV PPS, 200mV AVS) changes. Loop rate, interval
+jitter and settling time are kept in REG_STATS_T.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#ifndef __AP33772S_REGULATOR__
+#define __AP33772S_REGULATOR__
+
+#include "AP33772S.h"
+
+#define REG_PERIOD       50   // ms, keep above the source's request-to-settle time
+#define REG_SETTLE_COUNT 3    // Loops inside tolerance before counted as settled
+#define REG_MAX_STEP     1000 // mV, largest change of the request in one loop
+
+// Default gains, Q8 (256 = 1.0). Ki is per second.
+#define REG_CV_KP        64   // 0.25
+#define REG_CV_KI        3072 // 12 /s, 0.6 of the error per 50ms loop
+#define REG_CV_TOLERANCE 160  // mV, 2 LSB of VOLTAGE
+#define REG_CC_KP        0
+#define REG_CC_KI        5120 // 20 mV/mA/s, 1 mV per mA per 50ms loop
+#define REG_CC_TOLERANCE 48   // mA, 2 LSB of CURRENT
+
+typedef enum
+{
+  REG_OFF = 0,
+  REG_CV,
+  REG_CC
+} AP33772S_REG_MODE;
+
+typedef struct
+{
+  unsigned long loops;
+  unsigned long requests;      // Request writes issued
+  unsigned long elapsedUs;     // First to last loop
+  unsigned long jitterMaxUs;   // Largest |interval - period|
+  unsigned long jitterSumUs;   // Sum of |interval - period|, divide by loops - 1 for the mean
+  unsigned long settleMs;      // From start()/setTarget() to settled, 0 while not settled
+  bool settled;
+} REG_STATS_T;
+
+class AP33772SRegulator
+{
+public:
+  AP33772SRegulator(AP33772S &usbpd);
+
+  bool startCV(int target_mV, int max_current, int loadline_mOhm = 0);
+  bool startCC(int target_mA, int max_mV);
+  void stop();
+  void setTarget(int target);
+  void setGains(long kp_q8, long ki_q8);
+  void setPeriod(unsigned long period_ms);
+  void setTolerance(int tolerance) { _tolerance = tolerance; }
+
+  void service(unsigned long now_us);
+  void poll();
+
+  AP33772S_REG_MODE mode() { return _mode; }
+  int output() { return _requested; }   // mV requested
+  int voltage() { return _voltage; }    // Last measured, mV
+  int current() { return _current; }    // Last measured, mA
+  int error() { return _error; }        // mV in CV, mA in CC
+
+  const REG_STATS_T &stats() { return _stats; }
+  unsigned long loopRate();             // Hz
+  void resetStats();
+
+private:
+  bool start(AP33772S_REG_MODE mode, int target, int max_mV, int max_current, int start_mV);
+  void request(int mV);
+  void updateKiT();
+
+  AP33772S *_pd;
+  AP33772S_REG_MODE _mode = REG_OFF;
+  int _target = 0;
+  int _loadline = 0;       // mOhm
+  int _maxCurrent = 0;     // mA in the request
+  int _tolerance = REG_CV_TOLERANCE;
+  long _kp = REG_CV_KP;
+  long _ki = REG_CV_KI;
+  long _kiT = 0;           // Ki * period, Q8
+
+  // Adjustable PDO in use
+  int _pdoIndex = 0;
+  byte _kind = PDO_NONE;
+  int _min_mV = 0;
+  int _max_mV = 0;
+
+  long _u = 0;             // Request, mV Q8
+  int _requested = 0;      // Last request sent, mV
+  int _error = 0;
+  int _lastError = 0;
+  int _voltage = 0;
+  int _current = 0;
+
+  unsigned long _period = REG_PERIOD * 1000UL; // us
+  unsigned long _nextAt = 0;
+  unsigned long _lastAt = 0;
+  unsigned long _firstAt = 0;
+  unsigned long _targetAt = 0;  // us, settle time reference
+  byte _inBand = 0;
+
+  REG_STATS_T _stats = {0};
+};
+
+#endif
@@ -0,0 +1,534 @@
+/*
+AP33772S_SCPI.cpp - SCPI style command interpreter for the AP33772S Arduino Library.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#include <ctype.h>
+
+#include "AP33772S_SCPI.h"
+
+const SCPI_COMMAND_T AP33772SSCPI::COMMANDS[] = {
+  {"VOLTage",               cmdVoltage},
+  {"CURRent",               cmdCurrent},
+  {"OUTPut",                cmdOutput},
+  {"MEASure:VOLTage",       cmdMeasVoltage},
+  {"MEASure:CURRent",       cmdMeasCurrent},
+  {"MEASure:TEMPerature",   cmdMeasTemp},
+  {"MEASure:ALL",           cmdMeasAll},
+  {"SYSTem:PDO:COUNt",      cmdPDOCount},
+  {"SYSTem:PDO",            cmdPDO},
+  {"SYSTem:ERRor",          cmdError},
+  {"*IDN",                  cmdIdn},
+  {"*RST",                  cmdReset},
+};
+
+/**
+ * @brief Class constuctor
+ * @param &usbpd the AP33772S the commands act on
+ * @param &out where answers go, usually Serial
+ */
+AP33772SSCPI::AP33772SSCPI(AP33772S &usbpd, Print &out)
+{
+  _pd = &usbpd;
+  _out = &out;
+}
+
+/**
+ * @brief Add one received character, a line is executed on '\n' or '\r'
+ */
+void AP33772SSCPI::feed(char c)
+{
+  if(c == '\n' || c == '\r')
+  {
+    if(_overrun) pushError(SCPI_ERR_OVERRUN);
+    else if(_len > 0)
+    {
+      _line[_len] = '\0';
+      execute(_line);
+    }
+    _len = 0;
+    _overrun = false;
+  }
+  else if(_len < SCPI_LINE_LENGTH - 1) _line[_len++] = c;
+  else _overrun = true; // Line dropped once it ends
+}
+
+void AP33772SSCPI::feed(const char *str)
+{
+  while(*str) feed(*str++);
+}
+
+/**
+ * @brief Run one line as a batch. The line is modified in place.
+ * @param line commands separated by ';'
+ */
+void AP33772SSCPI::execute(char *line)
+{
+  _batches++;
+  _answered = false;
+  _telemetryValid = false;
+
+  char *cmd = line;
+  while(cmd)
+  {
+    char *next = strchr(cmd, ';');
+    if(next) *next++ = '\0';
+    run(cmd);
+    cmd = next;
+  }
+
+  applySetpoint();
+  if(_answered) _out->println();
+}
+
+/**
+ * @brief Output off, setpoint back to 5V 1A. Errors are kept.
+ */
+void AP33772SSCPI::reset()
+{
+  _pd->setOutput(0);
+  _output = false;
+  _mV = 5000;
+  _mA = 1000;
+  _dirty = true;
+}
+
+void AP33772SSCPI::run(char *cmd)
+{
+  while(isspace(*cmd)) cmd++;
+  if(*cmd == '\0') return;
+  _commands++;
+
+  char *args = cmd;
+  while(*args && !isspace(*args)) args++;
+  if(*args) *args++ = '\0';
+  while(isspace(*args)) args++;
+  char *end = args + strlen(args);
+  while(end > args && isspace(end[-1])) *--end = '\0';
+
+  size_t len = strlen(cmd);
+  bool query = cmd[len-1] == '?';
+  if(query) cmd[len-1] = '\0';
+
+  for(size_t i = 0; i < sizeof(COMMANDS) / sizeof(COMMANDS[0]); i++)
+  {
+    if(matchHeader(COMMANDS[i].header, cmd))
+    {
+      COMMANDS[i].handler(*this, args, query);
+      return;
+    }
+  }
+  pushError(SCPI_ERR_UNDEFINED);
+}
+
+/**
+ * @brief Match a header against a table entry, node by node. Each node may be
+ *        the short form (upper case part) or the long form, in any case.
+ */
+bool AP33772SSCPI::matchHeader(const char *pattern, const char *header)
+{
+  if(*header == ':') header++; // Rooted header
+  while(*pattern)
+  {
+    const char *pend = pattern;
+    while(*pend && *pend != ':') pend++;
+    const char *hend = header;
+    while(*hend && *hend != ':') hend++;
+
+    size_t plen = pend - pattern;
+    size_t hlen = hend - header;
+    size_t slen = 0;
+    while(slen < plen && !islower(pattern[slen])) slen++;
+    if(hlen != plen && hlen != slen) return 0;
+    for(size_t i = 0; i < hlen; i++)
+    {
+      if(toupper(header[i]) != toupper(pattern[i])) return 0;
+    }
+
+    pattern = *pend ? pend + 1 : pend;
+    header = *hend ? hend + 1 : hend;
+  }
+  return *header == '\0';
+}
+
+/**
+ * @brief Parse a decimal number into thousandths, integer math only.
+ *        An m before the unit (mV, mA) means the number is already in thousandths.
+ * @param unit suffix the command takes, 'V' or 'A', 0 for a plain number
+ * @return SCPI_ERR_NONE, SCPI_ERR_SYNTAX if the string is not a number,
+ *         SCPI_ERR_RANGE if it does not fit, SCPI_ERR_SUFFIX for a wrong unit
+ */
+int AP33772SSCPI::parseFixed(const char *str, char unit, long &milli)
+{
+  bool negative = *str == '-';
+  if(*str == '-' || *str == '+') str++;
+  if(!isdigit(*str) && !(*str == '.' && isdigit(str[1]))) return SCPI_ERR_SYNTAX;
+
+  long value = 0;
+  bool overflow = false;
+  while(isdigit(*str))
+  {
+    if(value > SCPI_MAX_INTEGER / 10) overflow = true; // Keep scanning, the rest may still be a syntax error
+    else value = value * 10 + (*str - '0');
+    str++;
+  }
+  if(value > SCPI_MAX_INTEGER) overflow = true;
+  int decimals = 0;
+  if(*str == '.')
+  {
+    str++;
+    while(isdigit(*str))
+    {
+      if(decimals < 3 && !overflow)
+      {
+        value = value * 10 + (*str - '0');
+        decimals++;
+      }
+      str++;
+    }
+  }
+  if(!overflow) for(; decimals < 3; decimals++) value *= 10;
+
+  while(isspace(*str)) str++;
+  bool scaled = false;
+  if((*str == 'm' || *str == 'M') && unit && toupper(str[1]) == unit)
+  {
+    scaled = true;
+    str++;
+  }
+  if(isalpha(*str))
+  {
+    if(!unit || toupper(*str) != unit) return SCPI_ERR_SUFFIX;
+    str++;
+  }
+  if(isalpha(*str)) return SCPI_ERR_SUFFIX;
+  if(*str) return SCPI_ERR_SYNTAX;
+  if(overflow) return SCPI_ERR_RANGE;
+
+  if(scaled) value /= 1000;
+  milli = negative ? -value : value;
+  return SCPI_ERR_NONE;
+}
+
+/**
+ * @brief Send a changed VOLT/CURR setpoint to the source, once per batch. A setpoint no
+ *        PDO covers is dropped for the last applied one, a failed request is sent again.
+ */
+bool AP33772SSCPI::applySetpoint()
+{
+  if(!_dirty) return 1;
+  if(_pd->selectPDO(_mV, _mA) < 0)
+  {
+    pushError(SCPI_ERR_CONFLICT); // No PDO covers it
+    _mV = _appliedMV;
+    _mA = _appliedMA;
+    _dirty = false;
+    return 0;
+  }
+  if(_pd->requestPower(_mV, _mA) < 0)
+  {
+    pushError(SCPI_ERR_HARDWARE); // Still dirty, tried again by the next batch or OUTP ON
+    return 0;
+  }
+  _appliedMV = _mV;
+  _appliedMA = _mA;
+  _dirty = false;
+  return 1;
+}
+
+/**
+ * @brief Telemetry of this batch, one burst read for all MEAS queries
+ * @return NULL after queueing SCPI_ERR_HARDWARE if the read failed
+ */
+const TELEMETRY_T *AP33772SSCPI::telemetry()
+{
+  if(!_telemetryValid)
+  {
+    if(!_pd->readTelemetry(_telemetry))
+    {
+      pushError(SCPI_ERR_HARDWARE);
+      return NULL;
+    }
+    _telemetryValid = true;
+  }
+  return &_telemetry;
+}
+
+void AP33772SSCPI::pushError(int code)
+{
+  if(_errorCount < SCPI_ERROR_LENGTH) _errors[_errorCount++] = code;
+  else _errors[SCPI_ERROR_LENGTH-1] = SCPI_ERR_QUEUE;
+}
+
+int AP33772SSCPI::popError()
+{
+  if(_errorCount == 0) return SCPI_ERR_NONE;
+  int code = _errors[0];
+  for(byte i = 1; i < _errorCount; i++) _errors[i-1] = _errors[i];
+  _errorCount--;
+  return code;
+}
+
+void AP33772SSCPI::beginAnswer()
+{
+  if(_answered) _out->print(';');
+  _answered = true;
+}
+
+void AP33772SSCPI::printFixed(long milli)
+{
+  if(milli < 0)
+  {
+    _out->print('-');
+    milli = -milli;
+  }
+  _out->print(milli / 1000);
+  _out->print('.');
+  int frac = milli % 1000;
+  if(frac < 100) _out->print('0');
+  if(frac < 10) _out->print('0');
+  _out->print(frac);
+}
+
+void AP33772SSCPI::printPDO(const PDO_CAP_T &cap)
+{
+  static const char *const KIND[] = {"NONE", "FIX", "PPS", "AVS"};
+  _out->print(cap.index);
+  _out->print(',');
+  _out->print(KIND[cap.kind]);
+  _out->print(',');
+  printFixed(cap.min_mV);
+  _out->print(',');
+  printFixed(cap.max_mV);
+  _out->print(',');
+  printFixed(cap.max_mA);
+}
+
+void AP33772SSCPI::cmdVoltage(AP33772SSCPI &scpi, char *args, bool query)
+{
+  if(query)
+  {
+    scpi.beginAnswer();
+    scpi.printFixed(scpi._mV);
+    return;
+  }
+  long mV;
+  int error = *args ? parseFixed(args, 'V', mV) : SCPI_ERR_MISSING;
+  if(error) scpi.pushError(error);
+  else if(mV < 3300 || mV > 48000) scpi.pushError(SCPI_ERR_RANGE);
+  else
+  {
+    scpi._mV = mV;
+    scpi._dirty = true;
+  }
+}
+
+void AP33772SSCPI::cmdCurrent(AP33772SSCPI &scpi, char *args, bool query)
+{
+  if(query)
+  {
+    scpi.beginAnswer();
+    scpi.printFixed(scpi._mA);
+    return;
+  }
+  long mA;
+  int error = *args ? parseFixed(args, 'A', mA) : SCPI_ERR_MISSING;
+  if(error) scpi.pushError(error);
+  else if(mA <= 0 || mA > 5000) scpi.pushError(SCPI_ERR_RANGE);
+  else
+  {
+    scpi._mA = mA;
+    scpi._dirty = true;
+  }
+}
+
+void AP33772SSCPI::cmdOutput(AP33772SSCPI &scpi, char *args, bool query)
+{
+  if(query)
+  {
+    scpi.beginAnswer();
+    scpi._out->print(scpi._output ? '1' : '0');
+    return;
+  }
+
+  bool on;
+  if(matchHeader("ON", args) || !strcmp(args, "1")) on = true;
+  else if(matchHeader("OFF", args) || !strcmp(args, "0")) on = false;
+  else
+  {
+    scpi.pushError(*args ? SCPI_ERR_ILLEGAL : SCPI_ERR_MISSING);
+    return;
+  }
+
+  // Switch on at the voltage set earlier in the same batch, not the old one
+  if(on && !scpi.applySetpoint()) return;
+  if(!scpi._pd->setOutput(on))
+  {
+    scpi.pushError(SCPI_ERR_HARDWARE);
+    return;
+  }
+  scpi._output = on;
+}
+
+void AP33772SSCPI::cmdMeasVoltage(AP33772SSCPI &scpi, char *, bool query)
+{
+  if(!query)
+  {
+    scpi.pushError(SCPI_ERR_UNDEFINED);
+    return;
+  }
+  const TELEMETRY_T *t = scpi.telemetry();
+  if(t == NULL) return;
+  scpi.beginAnswer();
+  scpi.printFixed(t->voltage);
+}
+
+void AP33772SSCPI::cmdMeasCurrent(AP33772SSCPI &scpi, char *, bool query)
+{
+  if(!query)
+  {
+    scpi.pushError(SCPI_ERR_UNDEFINED);
+    return;
+  }
+  const TELEMETRY_T *t = scpi.telemetry();
+  if(t == NULL) return;
+  scpi.beginAnswer();
+  scpi.printFixed(t->current);
+}
+
+void AP33772SSCPI::cmdMeasTemp(AP33772SSCPI &scpi, char *, bool query)
+{
+  if(!query)
+  {
+    scpi.pushError(SCPI_ERR_UNDEFINED);
+    return;
+  }
+  const TELEMETRY_T *t = scpi.telemetry();
+  if(t == NULL) return;
+  scpi.beginAnswer();
+  scpi._out->print(t->temp);
+}
+
+void AP33772SSCPI::cmdMeasAll(AP33772SSCPI &scpi, char *, bool query)
+{
+  if(!query)
+  {
+    scpi.pushError(SCPI_ERR_UNDEFINED);
+    return;
+  }
+  const TELEMETRY_T *t = scpi.telemetry();
+  if(t == NULL) return;
+  scpi.beginAnswer();
+  scpi.printFixed(t->voltage);
+  scpi._out->print(',');
+  scpi.printFixed(t->current);
+  scpi._out->print(',');
+  scpi._out->print(t->temp);
+}
+
+void AP33772SSCPI::cmdPDOCount(AP33772SSCPI &scpi, char *, bool query)
+{
+  if(!query)
+  {
+    scpi.pushError(SCPI_ERR_UNDEFINED);
+    return;
+  }
+  scpi.beginAnswer();
+  scpi._out->print(scpi._pd->getNumPDO());
+}
+
+void AP33772SSCPI::cmdPDO(AP33772SSCPI &scpi, char *args, bool query)
+{
+  if(!query)
+  {
+    scpi.pushError(SCPI_ERR_UNDEFINED);
+    return;
+  }
+
+  if(*args)
+  {
+    long n;
+    int error = parseFixed(args, 0, n);
+    if(error || n % 1000)
+    {
+      scpi.pushError(error ? error : SCPI_ERR_SYNTAX);
+      return;
+    }
+    const PDO_CAP_T *cap = scpi._pd->getPDOCap(n / 1000);
+    if(!cap)
+    {
+      scpi.pushError(SCPI_ERR_RANGE);
+      return;
+    }
+    scpi.beginAnswer();
+    scpi.printPDO(*cap);
+    return;
+  }
+
+  scpi.beginAnswer();
+  bool first = true;
+  for(int i = 1; i <= MAX_PDO_ENTRIES; i++)
+  {
+    const PDO_CAP_T *cap = scpi._pd->getPDOCap(i);
+    if(!cap) continue;
+    if(!first) scpi._out->print(',');
+    scpi.printPDO(*cap);
+    first = false;
+  }
+}
+
+void AP33772SSCPI::cmdError(AP33772SSCPI &scpi, char *, bool query)
+{
+  if(!query)
+  {
+    scpi.pushError(SCPI_ERR_UNDEFINED);
+    return;
+  }
+
+  int code = scpi.popError();
+  const char *msg;
+  switch(code)
+  {
+    case SCPI_ERR_NONE:      msg = "No error"; break;
+    case SCPI_ERR_SYNTAX:    msg = "Syntax error"; break;
+    case SCPI_ERR_MISSING:   msg = "Missing parameter"; break;
+    case SCPI_ERR_SUFFIX:    msg = "Invalid suffix"; break;
+    case SCPI_ERR_UNDEFINED: msg = "Undefined header"; break;
+    case SCPI_ERR_CONFLICT:  msg = "Settings conflict"; break;
+    case SCPI_ERR_HARDWARE:  msg = "Hardware error"; break;
+    case SCPI_ERR_RANGE:     msg = "Data out of range"; break;
+    case SCPI_ERR_ILLEGAL:   msg = "Illegal parameter value"; break;
+    case SCPI_ERR_QUEUE:     msg = "Queue overflow"; break;
+    case SCPI_ERR_OVERRUN:   msg = "Input buffer overrun"; break;
+    default:                 msg = "Error"; break;
+  }
+  scpi.beginAnswer();
+  scpi._out->print(code);
+  scpi._out->print(",\"");
+  scpi._out->print(msg);
+  scpi._out->print('"');
+}
+
+void AP33772SSCPI::cmdIdn(AP33772SSCPI &scpi, char *, bool query)
+{
+  if(!query)
+  {
+    scpi.pushError(SCPI_ERR_UNDEFINED);
+    return;
+  }
+  scpi.beginAnswer();
+  scpi._out->print("CentyLab,AP33772S,0,1.0.0");
+}
+
+void AP33772SSCPI::cmdReset(AP33772SSCPI &scpi, char *, bool query)
+{
+  if(query)
+  {
+    scpi.pushError(SCPI_ERR_UNDEFINED);
+    return;
+  }
+  scpi.reset();
+}
@@ -0,0 +1,137 @@
+/*
+AP33772S_SCPI.h - SCPI style command interpreter for the AP33772S Arduino Library.
+
+Turns the board into a bench supply driven over a serial port:
+
+  VOLTage <V>            setpoint, also 12500mV
+  VOLTage?
+  CURRent <A>            current limit, also 2000mA
+  CURRent?
+  OUTPut ON|OFF|1|0
+  OUTPut?
+  MEASure:VOLTage?       V
+  MEASure:CURRent?       A
+  MEASure:TEMPerature?   C
+  MEASure:ALL?           V,A,C
+  SYSTem:PDO:COUNt?
+  SYSTem:PDO? [n]        n,FIX|PPS|AVS,min V,max V,max A (all PDOs without n)
+  SYSTem:ERRor?
+  *IDN?  *RST
+
+Headers match in short (VOLT) or long (VOLTAGE) form, any case. Commands on
+one line separated by ';' run as a batch: query answers come back on a single
+line joined by ';', VOLT/CURR are sent to the source once per batch, and every
+MEAS query in a batch shares one telemetry burst read.
+
+Parsing is done in place in a fixed line buffer, the command table is const.
+No heap is used.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#ifndef __AP33772S_SCPI__
+#define __AP33772S_SCPI__
+
+#include "AP33772S.h"
+
+#define SCPI_LINE_LENGTH  256
+#define SCPI_ERROR_LENGTH 4
+#define SCPI_MAX_INTEGER  2147482L // Largest integer part whose thousandths fit a 32-bit long
+
+// SCPI error codes reported by SYST:ERR?
+#define SCPI_ERR_NONE        0
+#define SCPI_ERR_SYNTAX      -102
+#define SCPI_ERR_MISSING     -109
+#define SCPI_ERR_SUFFIX      -131
+#define SCPI_ERR_UNDEFINED   -113
+#define SCPI_ERR_CONFLICT    -221
+#define SCPI_ERR_RANGE       -222
+#define SCPI_ERR_ILLEGAL     -224
+#define SCPI_ERR_HARDWARE    -240 // I2C transfer failed after every retry
+#define SCPI_ERR_QUEUE       -350
+#define SCPI_ERR_OVERRUN     -363
+
+class AP33772SSCPI;
+
+typedef void (*SCPI_HANDLER)(AP33772SSCPI &scpi, char *args, bool query);
+
+typedef struct
+{
+  const char *header;   // Long form, upper case letters are the short form
+  SCPI_HANDLER handler;
+} SCPI_COMMAND_T;
+
+class AP33772SSCPI
+{
+public:
+  AP33772SSCPI(AP33772S &usbpd, Print &out);
+
+  void feed(char c);
+  void feed(const char *str);
+  void execute(char *line);
+  void reset();
+
+  int voltage() { return _mV; }
+  int current() { return _mA; }
+  bool output() { return _output; }
+  unsigned long commands() { return _commands; }
+  unsigned long batches() { return _batches; }
+
+private:
+  static const SCPI_COMMAND_T COMMANDS[];
+
+  static bool matchHeader(const char *pattern, const char *header);
+  static int parseFixed(const char *str, char unit, long &milli);
+
+  void run(char *cmd);
+  bool applySetpoint();
+  const TELEMETRY_T *telemetry();
+  void pushError(int code);
+  int popError();
+
+  // Response helpers, answers of one batch are joined with ';'
+  void beginAnswer();
+  void printFixed(long milli);
+  void printPDO(const PDO_CAP_T &cap);
+
+  static void cmdVoltage(AP33772SSCPI &scpi, char *args, bool query);
+  static void cmdCurrent(AP33772SSCPI &scpi, char *args, bool query);
+  static void cmdOutput(AP33772SSCPI &scpi, char *args, bool query);
+  static void cmdMeasVoltage(AP33772SSCPI &scpi, char *args, bool query);
+  static void cmdMeasCurrent(AP33772SSCPI &scpi, char *args, bool query);
+  static void cmdMeasTemp(AP33772SSCPI &scpi, char *args, bool query);
+  static void cmdMeasAll(AP33772SSCPI &scpi, char *args, bool query);
+  static void cmdPDOCount(AP33772SSCPI &scpi, char *args, bool query);
+  static void cmdPDO(AP33772SSCPI &scpi, char *args, bool query);
+  static void cmdError(AP33772SSCPI &scpi, char *args, bool query);
+  static void cmdIdn(AP33772SSCPI &scpi, char *args, bool query);
+  static void cmdReset(AP33772SSCPI &scpi, char *args, bool query);
+
+  AP33772S *_pd;
+  Print *_out;
+
+  char _line[SCPI_LINE_LENGTH];
+  unsigned int _len = 0;
+  bool _overrun = false;
+
+  int _mV = 5000;
+  int _mA = 1000;
+  int _appliedMV = 5000;      // Setpoint the source accepted last, restored when a new one fits no PDO
+  int _appliedMA = 1000;
+  bool _output = false;
+  bool _dirty = false;        // Setpoint changed and not sent yet, kept after a failed request
+
+  TELEMETRY_T _telemetry = {0};
+  bool _telemetryValid = false; // Read once per batch
+  bool _answered = false;       // Something already printed in this batch
+
+  int _errors[SCPI_ERROR_LENGTH] = {0};
+  byte _errorCount = 0;
+
+  unsigned long _commands = 0;
+  unsigned long _batches = 0;
+};
+
+#endif
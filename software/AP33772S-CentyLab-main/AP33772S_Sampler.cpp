@@ -0,0 +1,180 @@
+/*
+AP33772S_Sampler.cpp - Telemetry sampler for the AP33772S Arduino Library.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#include "AP33772S_Sampler.h"
+
+static byte *putVarint(byte *p, uint32_t value)
+{
+  while(value >= 0x80)
+  {
+    *p++ = (byte)(value | 0x80);
+    value >>= 7;
+  }
+  *p++ = (byte)value;
+  return p;
+}
+
+static byte *putSigned(byte *p, int32_t value)
+{
+  return putVarint(p, ((uint32_t)value << 1) ^ (uint32_t)(value >> 31)); // Zigzag
+}
+
+/**
+ * @brief Class constuctor
+ * @param &usbpd the AP33772S to sample
+ */
+AP33772SSampler::AP33772SSampler(AP33772S &usbpd)
+{
+  _pd = &usbpd;
+}
+
+/**
+ * @brief Start sampling, first sample is taken on the next service()
+ * @param period_us time between samples. One sample costs a 4-byte burst read,
+ *        about 0.7ms at 100kHz, so periods below that just sample back to back.
+ */
+void AP33772SSampler::start(unsigned long period_us)
+{
+  _period = period_us;
+  _nextAt = micros();
+  _running = true;
+}
+
+void AP33772SSampler::stop()
+{
+  _running = false;
+}
+
+/**
+ * @brief Take a sample when one is due
+ * @param now_us current time in us, usually micros()
+ */
+void AP33772SSampler::service(unsigned long now_us)
+{
+  if(!_running || (long)(now_us - _nextAt) < 0) return;
+
+  // Fall back in step rather than bursting to catch up after a stall
+  _nextAt += _period;
+  if((long)(now_us - _nextAt) >= 0) _nextAt = now_us + _period;
+
+  SAMPLE_RAW_T sample;
+  sample.t_us = now_us;
+  if(_pd->readSample(sample))
+  {
+    _taken++;
+    push(sample);
+  }
+}
+
+/**
+ * @brief service() using micros() as time base
+ */
+void AP33772SSampler::poll()
+{
+  service(micros());
+}
+
+unsigned int AP33772SSampler::available()
+{
+  return (_head - _tail) & (SAMPLE_BUFF_LENGTH - 1);
+}
+
+bool AP33772SSampler::push(const SAMPLE_RAW_T &sample)
+{
+  unsigned int next = (_head + 1) & (SAMPLE_BUFF_LENGTH - 1);
+  if(next == _tail)
+  {
+    _dropped++; // Reader fell behind, keep the older samples contiguous
+    return 0;
+  }
+  _buf[_head] = sample;
+  _head = next;
+  return 1;
+}
+
+bool AP33772SSampler::pop(SAMPLE_RAW_T &sample)
+{
+  if(_tail == _head) return 0;
+  sample = _buf[_tail];
+  _tail = (_tail + 1) & (SAMPLE_BUFF_LENGTH - 1);
+  return 1;
+}
+
+void AP33772SSampler::clear()
+{
+  _tail = _head;
+  _dropped = 0;
+  _taken = 0;
+}
+
+/**
+ * @brief Move up to maxSamples from the ring buffer into one frame and write it out
+ * @param &out usually Serial
+ * @param maxSamples capped at SAMPLE_FRAME_SAMPLES
+ * @return bytes written, 0 if the buffer was empty
+ */
+size_t AP33772SSampler::stream(Print &out, unsigned int maxSamples)
+{
+  if(maxSamples > SAMPLE_FRAME_SAMPLES) maxSamples = SAMPLE_FRAME_SAMPLES;
+
+  SAMPLE_RAW_T prev, cur;
+  if(maxSamples == 0 || !pop(prev)) return 0;
+
+  byte *p = _frame + SAMPLE_FRAME_HEADER;
+  p = putVarint(p, prev.t_us);
+  p = putVarint(p, _period);
+  p = putVarint(p, prev.voltage);
+  p = putVarint(p, prev.current);
+  p = putVarint(p, prev.temp);
+
+  unsigned int count = 1;
+  while(count < maxSamples && pop(cur))
+  {
+    int32_t jitter = (int32_t)(cur.t_us - prev.t_us - _period);
+    int32_t dv = (int32_t)cur.voltage - prev.voltage;
+    int32_t di = (int32_t)cur.current - prev.current;
+    int32_t dt = (int32_t)cur.temp - prev.temp;
+
+    byte *tag = p++;
+    *tag = 0;
+    if(jitter) { *tag |= SAMPLE_TAG_TIME; p = putSigned(p, jitter); }
+    if(dv) { *tag |= SAMPLE_TAG_VOLTAGE; p = putSigned(p, dv); }
+    if(di) { *tag |= SAMPLE_TAG_CURRENT; p = putSigned(p, di); }
+    if(dt) { *tag |= SAMPLE_TAG_TEMP; p = putSigned(p, dt); }
+
+    prev = cur;
+    count++;
+  }
+
+  size_t payload = p - (_frame + SAMPLE_FRAME_HEADER);
+  _frame[0] = SAMPLE_SYNC0;
+  _frame[1] = SAMPLE_SYNC1;
+  _frame[2] = SAMPLE_FRAME_DATA;
+  _frame[3] = count;
+  _frame[4] = payload & 0xff;
+  _frame[5] = payload >> 8;
+
+  uint16_t crc = crc16(_frame + 2, payload + SAMPLE_FRAME_HEADER - 2);
+  *p++ = crc & 0xff;
+  *p++ = crc >> 8;
+
+  return out.write(_frame, p - _frame);
+}
+
+/**
+ * @brief CRC-16/CCITT-FALSE (poly 0x1021), bitwise to stay out of flash
+ */
+uint16_t AP33772SSampler::crc16(const byte *data, size_t len, uint16_t crc)
+{
+  while(len--)
+  {
+    crc ^= (uint16_t)(*data++) << 8;
+    for(int i = 0; i < 8; i++) crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
@@ -0,0 +1,90 @@
+/*
+AP33772S_Sampler.h - Telemetry sampler for the AP33772S Arduino Library.
+
+Captures timestamped raw VOLTAGE/CURRENT/TEMP samples at a fixed period into
+a ring buffer, one 4-byte burst read per sample, and streams them as framed,
+delta-encoded binary for the host to decode (extras/host/tools/sampler.cpp).
+
+Frame layout, all multi-byte fields little endian:
+  A5 5A          sync
+  type           SAMPLE_FRAME_DATA
+  count          samples in the frame, 1..SAMPLE_FRAME_SAMPLES
+  length (2)     payload bytes
+  payload        first sample: varint t_us, varint period_us,
+                               varint voltage, varint current, varint temp
+                 each next sample: tag byte, then for every bit set in tag
+                   SAMPLE_TAG_TIME     zigzag varint, dt - period_us
+                   SAMPLE_TAG_VOLTAGE  zigzag varint, voltage delta
+                   SAMPLE_TAG_CURRENT  zigzag varint, current delta
+                   SAMPLE_TAG_TEMP     zigzag varint, temp delta
+  crc (2)        CRC-16/CCITT-FALSE over type..payload
+
+A sample taken on time with nothing changed costs a single tag byte.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#ifndef __AP33772S_SAMPLER__
+#define __AP33772S_SAMPLER__
+
+#include "AP33772S.h"
+
+#ifndef SAMPLE_BUFF_LENGTH
+#define SAMPLE_BUFF_LENGTH 256 // Power of 2, 8 bytes per sample
+#endif
+
+#define SAMPLE_FRAME_SAMPLES 32
+#define SAMPLE_FRAME_HEADER  6   // sync(2) type count length(2)
+#define SAMPLE_FRAME_BYTES   (SAMPLE_FRAME_HEADER + 17 + (SAMPLE_FRAME_SAMPLES - 1) * 13 + 2)
+
+#define SAMPLE_SYNC0      0xA5
+#define SAMPLE_SYNC1      0x5A
+#define SAMPLE_FRAME_DATA 0x01
+
+#define SAMPLE_TAG_TIME    (1 << 0)
+#define SAMPLE_TAG_VOLTAGE (1 << 1)
+#define SAMPLE_TAG_CURRENT (1 << 2)
+#define SAMPLE_TAG_TEMP    (1 << 3)
+
+class AP33772SSampler
+{
+public:
+  AP33772SSampler(AP33772S &usbpd);
+
+  void start(unsigned long period_us);
+  void stop();
+  bool running() { return _running; }
+  void service(unsigned long now_us);
+  void poll();
+
+  // Ring buffer, sampling side produces, stream()/pop() consume
+  unsigned int available();
+  bool pop(SAMPLE_RAW_T &sample);
+  unsigned long dropped() { return _dropped; }
+  unsigned long taken() { return _taken; }
+  void clear();
+
+  size_t stream(Print &out, unsigned int maxSamples = SAMPLE_FRAME_SAMPLES);
+
+  static uint16_t crc16(const byte *data, size_t len, uint16_t crc = 0xFFFF);
+
+private:
+  bool push(const SAMPLE_RAW_T &sample);
+
+  AP33772S *_pd;
+  SAMPLE_RAW_T _buf[SAMPLE_BUFF_LENGTH];
+  volatile unsigned int _head = 0;
+  volatile unsigned int _tail = 0;
+  unsigned long _dropped = 0;
+  unsigned long _taken = 0;
+
+  bool _running = false;
+  unsigned long _period = 0;  // us
+  unsigned long _nextAt = 0;  // us
+
+  byte _frame[SAMPLE_FRAME_BYTES];
+};
+
+#endif
@@ -0,0 +1,190 @@
+/*
+AP33772S_Sequence.cpp - List mode for the AP33772S Arduino Library.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#include "AP33772S_Sequence.h"
+
+/**
+ * @brief Class constuctor
+ * @param &usbpd the AP33772S to drive
+ */
+AP33772SSequence::AP33772SSequence(AP33772S &usbpd)
+{
+  _pd = &usbpd;
+}
+
+/**
+ * @brief Encode a step table against the source's PDOs, call again after begin() on a new charger
+ * @param steps table, copied, need not outlive the call
+ * @param count up to SEQ_MAX_STEPS
+ * @return 0 if the table is empty or too long, or a step fits no PDO or dwells longer
+ *         than SEQ_MAX_DWELL, see failedStep()
+ */
+bool AP33772SSequence::load(const SEQ_STEP_T *steps, byte count)
+{
+  stop();
+  _count = 0;
+  _failed = -1;
+  if(count == 0 || count > SEQ_MAX_STEPS) return 0;
+
+  int pdoIndex = 0;
+  for(byte n = 0; n < count; n++)
+  {
+    uint16_t rdo = _pd->encodePower(steps[n].mV, steps[n].mA, pdoIndex);
+    if(rdo == 0 || steps[n].dwell_ms > SEQ_MAX_DWELL)
+    {
+      _failed = n;
+      return 0;
+    }
+    _rdo[n] = rdo;
+    _dwell[n] = steps[n].dwell_ms * 1000UL;
+    pdoIndex = rdo >> 12; // Stay on it while the next steps fit
+  }
+  _count = count;
+  return 1;
+}
+
+/**
+ * @brief Write the first step now and run the table
+ * @param loops passes through the table, SEQ_FOREVER to repeat until stop()
+ * @return 0 if nothing is loaded
+ */
+bool AP33772SSequence::start(unsigned int loops)
+{
+  if(_count == 0) return 0;
+  _loops = loops;
+  _loop = 0;
+  _next = 0;
+  _active = -1;
+  resetStats();
+  _startAt = micros();
+  _nextAt = _startAt;
+  _state = SEQ_RUNNING;
+  service(_startAt);
+  return 1;
+}
+
+/**
+ * @brief Stop, the last request stays in place
+ */
+void AP33772SSequence::stop()
+{
+  if(_state == SEQ_RUNNING) finish(SEQ_IDLE, micros());
+}
+
+/**
+ * @brief Watch VOLTAGE or CURRENT while a step dwells
+ * @param trigger quantity and direction, SEQ_TRIG_NONE to turn it off
+ * @param threshold mV or mA
+ * @param action SEQ_NEXT to end the step early, SEQ_STOP to stop the sequence
+ * @param period_ms between reads, each one 4-byte burst
+ */
+void AP33772SSequence::setTrigger(AP33772S_SEQ_TRIGGER trigger, int threshold, AP33772S_SEQ_ACTION action,
+                                  unsigned long period_ms)
+{
+  _trigger = trigger;
+  _threshold = threshold;
+  _action = action;
+  _checkPeriod = period_ms * 1000UL;
+}
+
+/**
+ * @brief Write the step that is due, else read the trigger when due. At most one
+ *        I2C transaction per call, call it as often as the loop allows.
+ * @param now_us current time in us, usually micros()
+ */
+void AP33772SSequence::service(unsigned long now_us)
+{
+  if(_state != SEQ_RUNNING) return;
+  _stats.elapsedUs = now_us - _startAt;
+  if((long)(now_us - _nextAt) >= 0) advance(now_us);
+  else if(_trigger != SEQ_TRIG_NONE && (long)(now_us - _checkAt) >= 0) checkTrigger(now_us);
+}
+
+/**
+ * @brief service() using micros() as time base
+ */
+void AP33772SSequence::poll()
+{
+  service(micros());
+}
+
+void AP33772SSequence::advance(unsigned long now)
+{
+  if(_next == _count) // Dwell of the last step is over
+  {
+    _loop++;
+    _stats.loops++;
+    if(_loops != SEQ_FOREVER && _loop >= _loops)
+    {
+      finish(SEQ_DONE, now);
+      return;
+    }
+    _next = 0;
+  }
+  issue(_next, now);
+}
+
+void AP33772SSequence::issue(byte n, unsigned long now)
+{
+  unsigned long late = now - _nextAt;
+  if(!_pd->requestRDO(_rdo[n]))
+  {
+    _stats.errors++; // Still due, the next call tries again
+    return;
+  }
+
+  _stats.steps++;
+  _stats.lateSumUs += late;
+  if(late > _stats.lateMaxUs) _stats.lateMaxUs = late;
+  _active = n;
+  _next = n + 1;
+
+  // Next step on the timeline, unless this write came after the whole dwell
+  _nextAt += _dwell[n];
+  if((long)(now - _nextAt) >= 0)
+  {
+    _stats.overruns++;
+    _nextAt = now + _dwell[n];
+  }
+  _checkAt = now + _checkPeriod; // First reading after the source had time to move
+}
+
+void AP33772SSequence::checkTrigger(unsigned long now)
+{
+  _checkAt = now + _checkPeriod;
+  SAMPLE_RAW_T sample;
+  if(!_pd->readSample(sample)) return;
+
+  int value;
+  bool hit;
+  switch(_trigger)
+  {
+    case SEQ_TRIG_VOLTAGE_ABOVE: value = sample.voltage * 80; hit = value > _threshold; break;
+    case SEQ_TRIG_VOLTAGE_BELOW: value = sample.voltage * 80; hit = value < _threshold; break;
+    case SEQ_TRIG_CURRENT_ABOVE: value = sample.current * 24; hit = value > _threshold; break;
+    case SEQ_TRIG_CURRENT_BELOW: value = sample.current * 24; hit = value < _threshold; break;
+    default: return;
+  }
+  if(!hit) return;
+
+  _stats.trips++;
+  _tripValue = value;
+  if(_action == SEQ_STOP) finish(SEQ_TRIPPED, now);
+  else _nextAt = now; // The timeline continues from here
+}
+
+void AP33772SSequence::finish(AP33772S_SEQ_STATE state, unsigned long now)
+{
+  _state = state;
+  _stats.elapsedUs = now - _startAt;
+}
+
+void AP33772SSequence::resetStats()
+{
+  _stats = SEQ_STATS_T();
+}
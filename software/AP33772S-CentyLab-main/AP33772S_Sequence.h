@@ -0,0 +1,132 @@
+/*
+AP33772S_Sequence.h - List mode for the AP33772S Arduino Library.
+
+Runs a table of (mV, mA, dwell) steps like the list mode of a bench supply.
+load() encodes every step into its raw RDO once, choosing the PDO as
+requestPower() would and staying on the previous step's PDO while it still
+fits, so running a step is a single 2-byte PD_REQMSG write. Steps are
+scheduled on an absolute timeline from start(), so the time spent between
+service() calls does not accumulate from one step to the next. How late
+each write was against that timeline is kept in SEQ_STATS_T.
+
+An optional trigger reads VOLTAGE/CURRENT during the dwell and, past a
+threshold, ends the step early or stops the sequence.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#ifndef __AP33772S_SEQUENCE__
+#define __AP33772S_SEQUENCE__
+
+#include "AP33772S.h"
+
+#ifndef SEQ_MAX_STEPS
+#define SEQ_MAX_STEPS 32 // 6 bytes of RAM per step
+#endif
+
+#define SEQ_FOREVER        0  // start() loop count
+#define SEQ_TRIGGER_PERIOD 10 // ms between trigger reads, one 4-byte burst each
+#define SEQ_MAX_DWELL      2147483UL // ms, about 35 minutes: a dwell in us must stay below 2^31
+
+typedef struct
+{
+  int mV;
+  int mA;
+  unsigned long dwell_ms; // From this step's scheduled start to the next one, up to SEQ_MAX_DWELL
+} SEQ_STEP_T;
+
+typedef enum
+{
+  SEQ_IDLE = 0,
+  SEQ_RUNNING,
+  SEQ_DONE,
+  SEQ_TRIPPED  // Stopped by the trigger
+} AP33772S_SEQ_STATE;
+
+typedef enum
+{
+  SEQ_TRIG_NONE = 0,
+  SEQ_TRIG_VOLTAGE_ABOVE,
+  SEQ_TRIG_VOLTAGE_BELOW,
+  SEQ_TRIG_CURRENT_ABOVE,
+  SEQ_TRIG_CURRENT_BELOW
+} AP33772S_SEQ_TRIGGER;
+
+typedef enum
+{
+  SEQ_NEXT = 0, // End the dwell, the next step starts now
+  SEQ_STOP      // Stop, the last request stays in place
+} AP33772S_SEQ_ACTION;
+
+typedef struct
+{
+  unsigned long steps;      // Step requests written
+  unsigned long loops;      // Passes through the table completed
+  unsigned long lateMaxUs;  // Largest delay of a write behind its scheduled time
+  unsigned long lateSumUs;  // Divide by steps for the mean
+  unsigned long overruns;   // Writes later than their whole dwell, timeline restarted from there
+  unsigned long errors;     // Writes the bus refused, retried on the next call
+  unsigned long trips;      // Trigger hits
+  unsigned long elapsedUs;  // From start(), to the end once finished
+} SEQ_STATS_T;
+
+class AP33772SSequence
+{
+public:
+  AP33772SSequence(AP33772S &usbpd);
+
+  bool load(const SEQ_STEP_T *steps, byte count);
+  int failedStep() { return _failed; }  // First step load() could not encode, -1 if none
+  bool start(unsigned int loops = 1);
+  void stop();
+  void setTrigger(AP33772S_SEQ_TRIGGER trigger, int threshold, AP33772S_SEQ_ACTION action,
+                  unsigned long period_ms = SEQ_TRIGGER_PERIOD);
+
+  void service(unsigned long now_us);
+  void poll();
+
+  AP33772S_SEQ_STATE state() { return _state; }
+  bool busy() { return _state == SEQ_RUNNING; }
+  int step() { return _active; }        // Step running, -1 before the first write
+  unsigned int loop() { return _loop; } // Passes completed
+  uint16_t rdo(byte step) { return step < _count ? _rdo[step] : 0; }
+  int tripValue() { return _tripValue; } // mV or mA that tripped last
+
+  const SEQ_STATS_T &stats() { return _stats; }
+  void resetStats();
+
+private:
+  void advance(unsigned long now);
+  void issue(byte n, unsigned long now);
+  void checkTrigger(unsigned long now);
+  void finish(AP33772S_SEQ_STATE state, unsigned long now);
+
+  AP33772S *_pd;
+  AP33772S_SEQ_STATE _state = SEQ_IDLE;
+
+  // Pre-encoded table
+  uint16_t _rdo[SEQ_MAX_STEPS];
+  uint32_t _dwell[SEQ_MAX_STEPS]; // us
+  byte _count = 0;
+  int _failed = -1;
+
+  unsigned int _loops = 1;
+  unsigned int _loop = 0;
+  byte _next = 0;          // Step written at _nextAt
+  int _active = -1;
+  unsigned long _startAt = 0;
+  unsigned long _nextAt = 0;
+
+  AP33772S_SEQ_TRIGGER _trigger = SEQ_TRIG_NONE;
+  AP33772S_SEQ_ACTION _action = SEQ_NEXT;
+  int _threshold = 0;
+  unsigned long _checkPeriod = SEQ_TRIGGER_PERIOD * 1000UL; // us
+  unsigned long _checkAt = 0;
+  int _tripValue = 0;
+
+  SEQ_STATS_T _stats = {0};
+};
+
+#endif
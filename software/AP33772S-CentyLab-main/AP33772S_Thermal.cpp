@@ -0,0 +1,185 @@
+/*
+AP33772S_Thermal.cpp - Thermal derating for the AP33772S Arduino Library.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#include "AP33772S_Thermal.h"
+
+/**
+ * @brief Class constuctor
+ * @param &usbpd the AP33772S to derate
+ */
+AP33772SThermal::AP33772SThermal(AP33772S &usbpd)
+{
+  _pd = &usbpd;
+}
+
+/**
+ * @brief Request the nominal power and start derating it
+ * @param target_voltage unit in mV
+ * @param max_current unit in mA
+ * @param mode THERMAL_CURRENT or THERMAL_VOLTAGE
+ * @return 0 if no PDO fits, or THERMAL_VOLTAGE on a fixed PDO
+ */
+bool AP33772SThermal::start(int target_voltage, int max_current, AP33772S_THERMAL_MODE mode)
+{
+  int index = _pd->requestPower(target_voltage, max_current);
+  if(index < 0) return 0;
+  const PDO_CAP_T *cap = _pd->getPDOCap(index);
+  if(cap == NULL || (mode == THERMAL_VOLTAGE && cap->kind == PDO_FIXED)) return 0;
+
+  if(_curveCount == 0)
+  {
+    // Default curve from the chip's own thresholds
+    int drthr = _pd->readDRTHR();
+    int otpthr = _pd->readOTPTHR();
+    if(drthr < 0 || otpthr < 0) return 0;
+    _curve[0].temp = drthr - THERMAL_KNEE;
+    _curve[0].percent = 100;
+    _curve[1].temp = otpthr - THERMAL_MARGIN;
+    _curve[1].percent = THERMAL_MIN_PERCENT;
+    if(_curve[1].temp <= _curve[0].temp) _curve[1].temp = _curve[0].temp + 1;
+    _curveCount = 2;
+  }
+
+  _mode = mode;
+  _target_mV = target_voltage;
+  _target_mA = max_current;
+  _pdoIndex = index;
+  _kind = cap->kind;
+  _min_mV = cap->min_mV;
+  _voltage = target_voltage;
+  _current = max_current;
+  _percent = 100;
+  resetStats();
+
+  _running = true;
+  _nextAt = millis();
+  _lastAt = _nextAt;
+  return 1;
+}
+
+/**
+ * @brief Stop derating and put the nominal request back
+ */
+void AP33772SThermal::stop()
+{
+  if(!_running) return;
+  _running = false;
+  if(_percent < 100) request(_target_mV, _target_mA);
+  _percent = 100;
+}
+
+/**
+ * @brief Replace the derating curve
+ * @param points temperature ascending, percent of the nominal request at each
+ * @param count 1..THERMAL_CURVE_POINTS
+ * @return 0 if the points are not ascending or out of range, the curve is left as it was
+ */
+bool AP33772SThermal::setCurve(const THERMAL_POINT_T *points, byte count)
+{
+  if(count == 0 || count > THERMAL_CURVE_POINTS) return 0;
+  for(byte i = 0; i < count; i++)
+  {
+    if(points[i].percent == 0 || points[i].percent > 100) return 0;
+    if(i > 0 && points[i].temp <= points[i - 1].temp) return 0;
+  }
+  memcpy(_curve, points, count * sizeof(THERMAL_POINT_T));
+  _curveCount = count;
+  return 1;
+}
+
+/**
+ * @brief Curve value at a temperature, flat beyond both ends, linear in between
+ */
+byte AP33772SThermal::percentAt(int temp)
+{
+  if(_curveCount == 0 || temp <= _curve[0].temp) return _curveCount ? _curve[0].percent : 100;
+  for(byte i = 1; i < _curveCount; i++)
+  {
+    if(temp < _curve[i].temp)
+    {
+      const THERMAL_POINT_T &a = _curve[i - 1];
+      const THERMAL_POINT_T &b = _curve[i];
+      return a.percent + ((int)b.percent - a.percent) * (temp - a.temp) / (b.temp - a.temp);
+    }
+  }
+  return _curve[_curveCount - 1].percent;
+}
+
+/**
+ * @brief Read TEMP and move the request along the curve when due
+ * @param now current time in ms, usually millis()
+ */
+void AP33772SThermal::service(unsigned long now)
+{
+  if(!_running || (long)(now - _nextAt) < 0) return;
+  _nextAt = now + _period;
+
+  if(_percent < 100) _stats.deratedMs += now - _lastAt;
+  _lastAt = now;
+
+  int temp = _pd->readTemp();
+  if(temp < 0) return; // Bus error, keep the current step until the next period
+  _temp = temp;
+  if(_temp > _stats.peakTemp) _stats.peakTemp = _temp;
+
+  // Back off at once, give power back only after the hysteresis
+  byte p = percentAt(_temp);
+  if(p > _percent)
+  {
+    p = percentAt(_temp + THERMAL_HYSTERESIS);
+    if(p <= _percent) return;
+  }
+  if(p != _percent) apply(p);
+}
+
+/**
+ * @brief service() using millis() as time base
+ */
+void AP33772SThermal::poll()
+{
+  service(millis());
+}
+
+void AP33772SThermal::apply(byte percent)
+{
+  int mV = _target_mV;
+  int mA = _target_mA;
+  if(_mode == THERMAL_CURRENT) mA = (long)_target_mA * percent / 100;
+  else
+  {
+    int step = _kind == PDO_PPS ? 100 : 200;
+    mV = (long)_target_mV * percent / 100 / step * step;
+    if(mV < _min_mV) mV = _min_mV;
+  }
+
+  // Only a whole CURRENT_SEL code or voltage step is worth a renegotiation.
+  // A request the bus lost leaves the step where it was, the next period tries again.
+  if(mV != _voltage || _pd->currentMap(mA) != _pd->currentMap(_current))
+    if(!request(mV, mA)) return;
+  _percent = percent;
+  if(percent < _stats.minPercent) _stats.minPercent = percent;
+}
+
+bool AP33772SThermal::request(int mV, int mA)
+{
+  bool ok;
+  if(_kind == PDO_FIXED) ok = _pd->setFixPDO(_pdoIndex, mA);
+  else if(_kind == PDO_PPS) ok = _pd->setPPSPDO(_pdoIndex, mV, mA);
+  else ok = _pd->setAVSPDO(_pdoIndex, mV, mA);
+  if(!ok) return 0;
+  _voltage = mV;
+  _current = mA;
+  _stats.requests++;
+  return 1;
+}
+
+void AP33772SThermal::resetStats()
+{
+  _stats = THERMAL_STATS_T();
+  _stats.minPercent = 100;
+}
@@ -0,0 +1,107 @@
+/*
+AP33772S_Thermal.h - Thermal derating for the AP33772S Arduino Library.
+
+Reads TEMP once per period and scales the request along a temperature curve,
+so a board heating under a sustained load settles at reduced power instead
+of tripping OTP and cycling the output. The default curve runs from 100% at
+DRTHR - THERMAL_KNEE down to THERMAL_MIN_PERCENT at OTPTHR - THERMAL_MARGIN,
+read from the chip at start(). setCurve() replaces it.
+
+THERMAL_CURRENT lowers CURRENT_SEL on the same PDO, for loads the source
+current-limits (PPS) or that follow the contract. THERMAL_VOLTAGE lowers the
+PPS/AVS voltage, for resistive loads where the current follows the voltage.
+
+Each period costs one 1-byte read, plus one request write when the derated
+request changes by a whole CURRENT_SEL or voltage step.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#ifndef __AP33772S_THERMAL__
+#define __AP33772S_THERMAL__
+
+#include "AP33772S.h"
+
+#define THERMAL_PERIOD       500 // ms
+#define THERMAL_KNEE         10  // C below DRTHR where the default curve starts
+#define THERMAL_MARGIN       5   // C below OTPTHR where the default curve bottoms out
+#define THERMAL_MIN_PERCENT  25
+#define THERMAL_HYSTERESIS   2   // C the temperature must fall before power comes back
+#define THERMAL_CURVE_POINTS 6
+
+typedef enum
+{
+  THERMAL_CURRENT = 0,
+  THERMAL_VOLTAGE
+} AP33772S_THERMAL_MODE;
+
+typedef struct
+{
+  int temp;        // C
+  byte percent;    // Of the nominal current or voltage
+} THERMAL_POINT_T;
+
+typedef struct
+{
+  int peakTemp;             // C
+  byte minPercent;
+  unsigned long requests;   // Derated requests written
+  unsigned long deratedMs;  // Time spent below 100%
+} THERMAL_STATS_T;
+
+class AP33772SThermal
+{
+public:
+  AP33772SThermal(AP33772S &usbpd);
+
+  bool start(int target_voltage, int max_current, AP33772S_THERMAL_MODE mode = THERMAL_CURRENT);
+  void stop();
+  bool setCurve(const THERMAL_POINT_T *points, byte count);
+  void setPeriod(unsigned long period_ms) { _period = period_ms; }
+
+  void service(unsigned long now);
+  void poll();
+
+  bool running() { return _running; }
+  int temp() { return _temp; }           // Last reading, C
+  byte percent() { return _percent; }    // Applied now
+  byte percentAt(int temp);              // From the curve
+  int current() { return _current; }     // mA requested now
+  int voltage() { return _voltage; }     // mV requested now
+
+  const THERMAL_STATS_T &stats() { return _stats; }
+  void resetStats();
+
+private:
+  void apply(byte percent);
+  bool request(int mV, int mA);
+
+  AP33772S *_pd;
+  AP33772S_THERMAL_MODE _mode = THERMAL_CURRENT;
+  bool _running = false;
+
+  THERMAL_POINT_T _curve[THERMAL_CURVE_POINTS];
+  byte _curveCount = 0;   // 0 until setCurve(), then start() keeps it
+
+  // Nominal request and the PDO it landed on
+  int _target_mV = 0;
+  int _target_mA = 0;
+  int _pdoIndex = 0;
+  byte _kind = PDO_NONE;
+  int _min_mV = 0;
+
+  int _temp = 0;
+  byte _percent = 100;
+  int _voltage = 0;
+  int _current = 0;
+
+  unsigned long _period = THERMAL_PERIOD;
+  unsigned long _nextAt = 0;
+  unsigned long _lastAt = 0;
+
+  THERMAL_STATS_T _stats = {0};
+};
+
+#endif
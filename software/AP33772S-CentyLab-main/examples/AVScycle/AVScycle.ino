@@ -9,8 +9,8 @@ void setup() {
   Wire.begin();
 
   Serial.begin(115200);
-  delay(1000); //Ensure everything got enough time to bootup
-  usbpd.begin();
+  usbpd.begin(); // Waits for the chip to report its source, up to BOOT_TIMEOUT
+  AP33772SLog::drain(Serial); // Errors only; build with -DAP33772S_LOG_LEVEL=2 to see profile discovery
 }
 
 void loop() {
@@ -0,0 +1,36 @@
+#include <Arduino.h>
+#include <AP33772S.h>
+#include <AP33772S_CapCache.h>
+#include <AP33772S_EEPROM.h>
+
+// Remembers the setpoint per charger in EEPROM. On a charger seen before, the
+// setpoint is requested again inside boot(), before any profile discovery.
+
+AP33772S usbpd;
+AP33772SEEPROMStorage storage;
+AP33772SCapCache cache(usbpd, storage);
+
+void setup() {
+  Wire.begin();
+  Serial.begin(115200);
+  storage.begin();
+
+  if (cache.boot()) {
+    Serial.print("Known charger, setpoint restored in ");
+  } else {
+    // First time on this charger: discover and pick a setpoint, then remember it
+    usbpd.displayProfiles();
+    usbpd.requestPower(12000, 3000);
+    delay(100);
+    if (usbpd.readMsgResult() == MSGRLT_SUCCESS) cache.save();
+    Serial.print("New charger, boot took ");
+  }
+  Serial.print(cache.stats().bootUs);
+  Serial.print("us, fingerprint ");
+  Serial.println(cache.stats().fingerprint, HEX);
+  usbpd.setOutput(1);
+}
+
+void loop() {
+  usbpd.poll();
+}
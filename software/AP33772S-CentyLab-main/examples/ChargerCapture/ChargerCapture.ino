@@ -0,0 +1,125 @@
+#include <Arduino.h>
+#include <AP33772S.h>
+
+// Records how the connected charger behaves and prints it as a charger profile
+// for the host build (extras/host/profiles). Power the board from the charger
+// with the MCU already running, so boot and caps are timed from power on.
+// Takes up to a minute with a PPS/AVS source, the keepalive test waits for the
+// source to drop the contract. Leave the output unloaded.
+
+#define ACCEPT_REQUESTS 16
+#define LAPSE_LIMIT     30000 // ms to wait for the source to drop a PPS/AVS contract
+
+AP33772S usbpd;
+
+// Request and wait for PD_MSGRLT, -1 if rejected or no answer in a second
+long timeRequest(int mV, int mA) {
+  unsigned long start = millis();
+  if (usbpd.requestPower(mV, mA) < 0) return -1;
+  while (millis() - start < 1000) {
+    byte result = usbpd.readMsgResult();
+    if (result == MSGRLT_SUCCESS) return millis() - start;
+    if (result != MSGRLT_BUSY) return -1;
+    delay(1);
+  }
+  return -1;
+}
+
+// ms for VBUS to come within 240mV of the target
+unsigned long settleTime(int mV) {
+  unsigned long start = millis();
+  while (millis() - start < 2000 && abs(usbpd.readVoltage() - mV) > 240) delay(1);
+  return millis() - start;
+}
+
+void printPDOs() {
+  for (int i = 1; i <= MAX_PDO_ENTRIES; i++) {
+    const PDO_CAP_T *cap = usbpd.getPDOCap(i);
+    if (cap == NULL) continue;
+    if (cap->kind == PDO_FIXED) {
+      Serial.print("fixed ");
+    } else {
+      Serial.print(cap->kind == PDO_PPS ? "pps " : "avs ");
+      Serial.print(cap->min_mV);
+      Serial.print(' ');
+    }
+    Serial.print(cap->max_mV);
+    Serial.print(' ');
+    Serial.print(cap->max_mA);
+    Serial.println(i > 7 && cap->kind == PDO_FIXED ? " epr" : "");
+  }
+}
+
+void setup() {
+  Wire.begin();
+  Serial.begin(115200);
+  usbpd.begin();
+  const BOOT_STATS_T &boot = usbpd.bootStats();
+
+  Serial.println("# Recorded with examples/ChargerCapture");
+  Serial.println("name Unnamed charger");
+  Serial.print("boot ");
+  Serial.println(boot.ackUs / 1000);
+  Serial.print("caps ");
+  Serial.println(boot.pdoUs / 1000);
+
+  // Slew: 5V to the highest fixed SPR voltage, from accept to VBUS settled
+  int high = 5000;
+  for (int i = 1; i <= 7; i++) {
+    const PDO_CAP_T *cap = usbpd.getPDOCap(i);
+    if (cap != NULL && cap->kind == PDO_FIXED && cap->max_mV > high) high = cap->max_mV;
+  }
+  timeRequest(5000, 1000);
+  settleTime(5000);
+  timeRequest(high, 1000);
+  unsigned long slewMs = settleTime(high);
+  Serial.print("slew ");
+  Serial.println(slewMs ? (high - 5000) / slewMs : 0);
+
+  // Accept times, alternating between two fixed voltages
+  long accept[ACCEPT_REQUESTS];
+  for (int i = 0; i < ACCEPT_REQUESTS; i++) {
+    int mV = i % 2 ? 5000 : 9000;
+    accept[i] = timeRequest(mV, 1000);
+    settleTime(mV);
+    delay(200);
+  }
+
+  // Keepalive: hold a programmable contract without one until the source gives up
+  int index = usbpd.getPPSIndex() > 0 ? usbpd.getPPSIndex() : usbpd.getAVSIndex();
+  unsigned long lapse = 0, dropout = 0;
+  const PDO_CAP_T *cap = usbpd.getPDOCap(index);
+  if (cap != NULL) {
+    int mV = cap->kind == PDO_PPS ? 11000 : 18000;
+    usbpd.setKeepalive(0);
+    timeRequest(mV, 1000);
+    settleTime(mV);
+    unsigned long start = millis();
+    while (millis() - start < LAPSE_LIMIT && usbpd.readVoltage() > mV - 1000) delay(1);
+    if (millis() - start < LAPSE_LIMIT) {
+      lapse = millis() - start;
+      unsigned long off = millis();
+      while (millis() - off < 5000 && usbpd.readVoltage() < 4500) delay(1);
+      dropout = millis() - off;
+      if (dropout < 5) dropout = 0; // Straight to 5V
+    }
+    usbpd.setKeepalive(KEEPALIVE_PERIOD);
+  }
+  Serial.print("keepalive ");
+  Serial.println(lapse);
+  Serial.print("dropout ");
+  Serial.println(dropout);
+
+  Serial.print("accept");
+  for (int i = 0; i < ACCEPT_REQUESTS; i++) {
+    if (accept[i] < 0) continue;
+    Serial.print(' ');
+    Serial.print(accept[i]);
+  }
+  Serial.println();
+  printPDOs();
+}
+
+void loop() {
+  usbpd.poll();
+}
@@ -0,0 +1,55 @@
+#include <Arduino.h>
+#include <AP33772S.h>
+#include <AP33772S_Energy.h>
+
+// Meters energy and charge delivered while the output is on. The accounting rides on
+// the readSample() the sketch does anyway, so it costs no extra I2C traffic.
+// Also works with AP33772SSampler or AP33772SRegulator doing the reads.
+
+#define SESSION_MS 60000
+
+AP33772S usbpd;
+AP33772SEnergy energy(usbpd);
+unsigned long lastSample = 0;
+unsigned long lastPrint = 0;
+unsigned long startedAt = 0;
+
+void setup() {
+  Wire.begin();
+  Serial.begin(115200);
+  usbpd.begin();
+  usbpd.requestPower(12000, 3000);
+
+  energy.attach();
+  usbpd.setOutput(1);
+  startedAt = millis();
+}
+
+void loop() {
+  usbpd.poll();
+
+  if (millis() - lastSample >= 10) {
+    lastSample = millis();
+    SAMPLE_RAW_T sample;
+    usbpd.readSample(sample);
+  }
+
+  if (millis() - lastPrint >= 1000) {
+    lastPrint = millis();
+    ENERGY_T e = energy.session();
+    Serial.print("Session ");
+    Serial.print(energy.sessions());
+    Serial.print(": ");
+    Serial.print(e.energy_mWh);
+    Serial.print(" mWh, ");
+    Serial.print(e.charge_mAh);
+    Serial.print(" mAh, peak ");
+    Serial.print(e.peak_mW);
+    Serial.print(" mW, on ");
+    Serial.print(e.onTimeMs / 1000);
+    Serial.println(" s");
+  }
+
+  // Each time the output is switched on a new session starts, total() keeps the sum
+  if (usbpd.getOutput() && millis() - startedAt >= SESSION_MS) usbpd.setOutput(0);
+}
@@ -0,0 +1,50 @@
+#include <Arduino.h>
+#include <AP33772S.h>
+
+#define INT_PIN 2 // AP33772S INT, high while an unmasked STATUS bit is set
+
+AP33772S usbpd;
+
+void onInt() {
+  usbpd.handleInterrupt(); // Flag only, the I2C read happens in poll()
+}
+
+void setup() {
+  Wire.begin();
+  Serial.begin(115200);
+  usbpd.begin();
+
+  usbpd.setMask((AP33772_MASK)(READY_MSK | NEWPDO_MSK | OVP_MSK | OCP_MSK | OTP_MSK));
+  attachInterrupt(digitalPinToInterrupt(INT_PIN), onInt, RISING);
+
+  usbpd.requestPower(9000, 2000);
+}
+
+void loop() {
+  usbpd.poll();
+
+  AP33772S_EVENT event;
+  while (usbpd.getEvent(event)) {
+    switch (event) {
+      case EVENT_NEGO_SUCCESS:
+        Serial.print("Contract accepted, PDO ");
+        Serial.println(usbpd.getActivePDO());
+        usbpd.setOutput(1);
+        break;
+      case EVENT_NEGO_FAIL:
+        Serial.println("Request rejected");
+        break;
+      case EVENT_NEWPDO:
+        Serial.println("Source capabilities changed");
+        break;
+      case EVENT_OVP:
+      case EVENT_OCP:
+      case EVENT_OTP:
+        Serial.println("Protection tripped, output off");
+        usbpd.setOutput(0);
+        break;
+      default:
+        break;
+    }
+  }
+}
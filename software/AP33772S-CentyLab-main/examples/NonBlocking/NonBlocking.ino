@@ -0,0 +1,38 @@
+#include <Arduino.h>
+#include <AP33772S.h>
+
+AP33772S usbpd;
+
+unsigned long lastPrint = 0;
+
+void setup() {
+  Wire.begin();
+  Serial.begin(115200);
+
+  // Start-up, NTC programming and output switching run from loop() through poll(),
+  // nothing here blocks.
+  usbpd.beginAsync();
+}
+
+void loop() {
+  static byte stage = 0;
+  usbpd.poll();
+
+  if (usbpd.opStatus() == OP_DONE && stage < 2) {
+    if (stage == 0) usbpd.setNTCAsync(10000, 4161, 1928, 974);
+    else if (stage == 1) usbpd.setOutputAsync(1);
+    stage++;
+  }
+  else if (usbpd.opStatus() == OP_ERROR) {
+    Serial.println("Operation failed");
+    usbpd.beginAsync(); // Retry from the start
+    stage = 0;
+  }
+
+  // Other work keeps running while operations are in flight
+  if (millis() - lastPrint >= 500) {
+    lastPrint = millis();
+    Serial.print("Busy: ");
+    Serial.println(usbpd.opStatus() == OP_BUSY);
+  }
+}
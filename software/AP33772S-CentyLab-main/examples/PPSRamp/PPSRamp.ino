@@ -0,0 +1,37 @@
+#include <Arduino.h>
+#include <AP33772S.h>
+#include <AP33772S_Ramp.h>
+
+AP33772S usbpd;
+AP33772SRamp ramp(usbpd);
+
+int target = 20000;
+
+void setup() {
+  Wire.begin();
+
+  Serial.begin(115200);
+  usbpd.begin(); // Waits for the chip to report its source, up to BOOT_TIMEOUT
+
+  usbpd.requestPower(3300, 3000);
+  usbpd.setOutput(1);
+  // 1V steps, each issued as soon as the source accepted and reached the previous one
+  ramp.start(3300, target, 3000, 1000);
+}
+
+void loop() {
+  usbpd.poll(); // Keepalive
+  ramp.poll();
+
+  if (!ramp.busy()) {
+    Serial.print(ramp.state() == RAMP_DONE ? "Reached " : "Ramp failed at ");
+    Serial.print(ramp.voltage());
+    Serial.print("mV in ");
+    Serial.print(ramp.elapsed());
+    Serial.println("ms");
+
+    // Sweep back and forth
+    target = target == 20000 ? 3300 : 20000;
+    ramp.start(ramp.voltage(), target, 3000, 1000);
+  }
+}
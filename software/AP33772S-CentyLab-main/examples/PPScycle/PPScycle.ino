@@ -8,8 +8,7 @@ void setup() {
   // put your setup code here, to run once:
   Wire.begin();
 
-  delay(1000); //Ensure everything got enough time to bootup
-  usbpd.begin();
+  usbpd.begin(); // Waits for the chip to report its source, up to BOOT_TIMEOUT
 }
 
 void loop() {
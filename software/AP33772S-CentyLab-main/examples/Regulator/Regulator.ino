@@ -0,0 +1,41 @@
+#include <Arduino.h>
+#include <AP33772S.h>
+#include <AP33772S_Regulator.h>
+
+// Hold 12V at the board against cable drop. For an LED or battery load use
+// reg.startCC(1500, 20000) instead: 1.5A, never above 20V.
+
+AP33772S usbpd;
+AP33772SRegulator reg(usbpd);
+
+unsigned long lastPrint = 0;
+
+void setup() {
+  Wire.begin();
+  Serial.begin(115200);
+  usbpd.begin();
+  usbpd.setOutput(1);
+
+  if (!reg.startCV(12000, 3000)) Serial.println("No PPS/AVS profile for 12V 3A");
+}
+
+void loop() {
+  usbpd.poll(); // Keepalive
+  reg.poll();
+
+  if (millis() - lastPrint >= 1000) {
+    lastPrint = millis();
+    const REG_STATS_T &st = reg.stats();
+    Serial.print(reg.voltage());
+    Serial.print(" mV ");
+    Serial.print(reg.current());
+    Serial.print(" mA, request ");
+    Serial.print(reg.output());
+    Serial.print(" mV, ");
+    Serial.print(reg.loopRate());
+    Serial.print(" Hz, jitter max ");
+    Serial.print(st.jitterMaxUs);
+    Serial.print(" us, settled ");
+    Serial.println(st.settled ? (long)st.settleMs : -1);
+  }
+}
@@ -0,0 +1,26 @@
+#include <Arduino.h>
+#include <AP33772S.h>
+#include <AP33772S_Sampler.h>
+
+// Streams VOLTAGE/CURRENT/TEMP at 1kHz as binary frames. Capture the port to a file
+// and decode it on the PC with extras/host: build/sampler capture.bin > capture.csv
+
+AP33772S usbpd;
+AP33772SSampler sampler(usbpd);
+
+void setup() {
+  Wire.begin();
+  Wire.setClock(400000); // One sample is a 4-byte burst read, ~0.2ms at 400kHz
+  Serial.begin(921600);
+  usbpd.begin();
+  usbpd.requestPower(20000, 3000);
+  usbpd.setOutput(1);
+
+  sampler.start(1000);
+}
+
+void loop() {
+  usbpd.poll();
+  sampler.poll();
+  if (sampler.available() >= SAMPLE_FRAME_SAMPLES) sampler.stream(Serial);
+}
@@ -0,0 +1,50 @@
+#include <Arduino.h>
+#include <AP33772S.h>
+#include <AP33772S_Sequence.h>
+
+AP33772S usbpd;
+AP33772SSequence sequence(usbpd);
+
+// Stress profile: mV, mA, dwell in ms. Needs a PPS charger up to 20V.
+const SEQ_STEP_T profile[] = {
+  {5000, 3000, 500},
+  {12000, 3000, 1000},
+  {20000, 3000, 500},
+  {9000, 3000, 800},
+  {3300, 3000, 400},
+};
+
+void setup() {
+  Wire.begin();
+  Serial.begin(115200);
+  usbpd.begin();
+
+  // Every step is encoded here, running it is one PD_REQMSG write
+  if (!sequence.load(profile, sizeof(profile) / sizeof(profile[0]))) {
+    Serial.print("No PDO for step ");
+    Serial.println(sequence.failedStep());
+    return;
+  }
+  // Stop if the load ever draws more than 2.5A
+  sequence.setTrigger(SEQ_TRIG_CURRENT_ABOVE, 2500, SEQ_STOP);
+  usbpd.setOutput(1);
+  sequence.start(10); // 10 passes, SEQ_FOREVER to repeat until stop()
+}
+
+void loop() {
+  sequence.poll();
+  usbpd.poll();
+
+  static bool reported = false;
+  if (!sequence.busy() && !reported && sequence.state() != SEQ_IDLE) {
+    const SEQ_STATS_T &st = sequence.stats();
+    Serial.print(sequence.state() == SEQ_DONE ? "Done, " : "Tripped, ");
+    Serial.print(st.steps);
+    Serial.print(" steps, late by ");
+    Serial.print(st.steps ? st.lateSumUs / st.steps : 0);
+    Serial.print("us on average, ");
+    Serial.print(st.lateMaxUs);
+    Serial.println("us at most");
+    reported = true;
+  }
+}
@@ -1,38 +1,26 @@
 #include <Arduino.h>
 #include <AP33772S.h>
+#include <AP33772S_SCPI.h>
 
-// put function declarations here:
+// Bench supply over the serial port, one SCPI command or a ';' batch per line:
+//   SYST:PDO?           print profiles
+//   VOLT 12;CURR 2      set 12V 2A
+//   OUTP ON / OUTP OFF  switch the output
+//   MEAS:ALL?           voltage, current, temperature
 AP33772S usbpd;
+AP33772SSCPI scpi(usbpd, Serial);
 
 void setup() {
-  // put your setup code here, to run once:
   Wire.begin();
 
   Serial.begin(115200);
-  delay(1000); //Ensure everything got enough time to bootup
-  usbpd.begin();
+  usbpd.begin(); // Waits for the chip to report its source, up to BOOT_TIMEOUT
+  AP33772SLog::drain(Serial); // Errors only; build with -DAP33772S_LOG_LEVEL=2 to see profile discovery
 }
 
 void loop() {
-  if (Serial.available() > 0) {
-    char receivedChar = Serial.read();  // Read the incoming character
-    if (receivedChar == 'p') 	  // Print out profile
-      usbpd.displayProfiles();	  
-    else if (receivedChar == 'o'){ // On
-      Serial.println("Output is ON");
-      usbpd.setOutput(1);
-    }
-    else if(receivedChar == 'f'){ // Off
-      Serial.println("Output is OFF");
-      usbpd.setOutput(0);
-    }
-    else if(receivedChar == 't'){ // Print temperature
-      Serial.print("Board temperature: ");
-      Serial.print(usbpd.readTemp());
-      Serial.println(" C");
-    }
-    else
-      Serial.println("Command not found");
-  }
+  while (Serial.available() > 0)
+    scpi.feed(Serial.read());
+  usbpd.poll(); // PPS/AVS keepalive
+  AP33772SLog::drain(Serial);
 }
-
@@ -0,0 +1,45 @@
+#include <Arduino.h>
+#include <AP33772S.h>
+#include <AP33772S_Thermal.h>
+
+// Holds a 24V 5A AVS load and lowers CURRENT_SEL as the board heats, so it keeps
+// delivering reduced power instead of tripping OTP. The default curve goes from 100%
+// at DRTHR - 10C down to 25% at OTPTHR - 5C. A custom curve is set below.
+
+AP33772S usbpd;
+AP33772SThermal thermal(usbpd);
+
+const THERMAL_POINT_T CURVE[] = {
+  {85, 100},
+  {95, 75},
+  {110, 40},
+};
+
+unsigned long lastPrint = 0;
+
+void setup() {
+  Wire.begin();
+  Serial.begin(115200);
+  usbpd.begin();
+  usbpd.setDRTHR(95);
+  usbpd.setOTPTHR(120);
+
+  thermal.setCurve(CURVE, sizeof(CURVE) / sizeof(CURVE[0]));
+  if (!thermal.start(24000, 5000, THERMAL_CURRENT)) Serial.println("No PDO for 24V 5A");
+  usbpd.setOutput(1);
+}
+
+void loop() {
+  usbpd.poll();
+  thermal.poll();
+
+  if (millis() - lastPrint >= 1000) {
+    lastPrint = millis();
+    Serial.print(thermal.temp());
+    Serial.print("C ");
+    Serial.print(thermal.percent());
+    Serial.print("% ");
+    Serial.print(thermal.current());
+    Serial.println("mA");
+  }
+}
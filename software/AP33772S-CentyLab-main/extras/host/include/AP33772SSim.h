@@ -0,0 +1,162 @@
+/*
+AP33772SSim.h - Simulated AP33772S register file for the host build.
+
+Models the command registers the library touches (STATUS, MASK, SYSTEM,
+TR25-TR100, VOLTAGE/CURRENT/TEMP, VREQ/IREQ, the threshold registers,
+SRCPDO, PD_REQMSG and PD_MSGRLT), a configurable source PDO list and the
+delays a real charger takes to boot and to accept a request. A trace of
+per-request accept times can replace the fixed negotiation delay, replayed
+in order, so a charger profile (see ChargerProfile.h) answers in turn.
+
+INT follows STATUS & MASK on the pin given to setIntPin(), and the chip
+state advances with the virtual clock so INT rises on time.
+
+Reads and writes auto-increment across registers in address order, each
+register contributing its own width, so a burst starting at VOLTAGE returns
+VOLTAGE, CURRENT, TEMP, VREQ and IREQ back to back.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#ifndef __AP33772S_SIM__
+#define __AP33772S_SIM__
+
+#include "Arduino.h"
+#include "Wire.h"
+
+#define SIM_MAX_PDO   13
+#define SIM_SPR_SLOTS 7
+#define SIM_REG_WIDTH 26
+#define SIM_MAX_TRACE 32
+
+// PD_MSGRLT response codes
+#define SIM_MSGRLT_BUSY        0
+#define SIM_MSGRLT_SUCCESS     1
+#define SIM_MSGRLT_INVALID     2
+#define SIM_MSGRLT_UNSUPPORTED 3
+#define SIM_MSGRLT_FAIL        4
+
+typedef enum
+{
+  SIM_PDO_FIXED = 0,
+  SIM_PDO_PPS,
+  SIM_PDO_AVS
+} SIM_PDO_KIND;
+
+typedef struct
+{
+  SIM_PDO_KIND kind;
+  int min_mV;   // Ignored for fixed PDO
+  int max_mV;   // Fixed voltage for fixed PDO
+  int max_mA;
+  bool epr;     // Place in the EPR slots (8-13). AVS is always EPR.
+} SIM_PDO_T;
+
+typedef struct
+{
+  unsigned long bootMs;         // Device NACKs until this long after powerOn()
+  unsigned long capsMs;         // SRCPDO valid and NEWPDO raised this long after powerOn()
+  unsigned long negotiationMs;  // PD_REQMSG write to PD_MSGRLT result
+  unsigned long slewMvPerMs;    // Source VBUS transition rate once a request is accepted
+  unsigned long keepaliveMs;    // PPS/AVS contract drops without a new request (0 = never)
+  unsigned long accessUs;       // Extra clock stretching charged on every transaction
+  unsigned long dropoutMs;      // VBUS off this long after a lapsed contract before 5V returns
+} SIM_TIMING_T;
+
+class AP33772SSim : public HostI2CDevice
+{
+public:
+  AP33772SSim();
+
+  // Configuration
+  void setSourcePDOs(const SIM_PDO_T *pdos, int count);
+  void setTiming(const SIM_TIMING_T &timing) { _timing = timing; }
+  const SIM_TIMING_T &timing() const { return _timing; }
+  void setAcceptTrace(const uint16_t *ms, int count);
+  void setTemperature(int celsius) { _temperature = celsius; }
+  void setLoadCurrent(int mA) { _loadMa = mA; _loadMilliOhm = 0; }
+  void setLoadResistance(long milliOhm) { _loadMilliOhm = milliOhm; _loadMa = 0; }
+  void setCableResistance(long milliOhm) { _cableMilliOhm = milliOhm; }
+  void raiseStatus(uint8_t bits) { _reg[0x01][0] |= bits; driveInt(); }
+  void setIntPin(uint8_t pin);
+
+  // Power cycle the simulated chip at the current virtual time
+  void powerOn();
+  void update();
+
+  // Inspection
+  int vbus() const { return _vbus; }
+  int contractPDO() const { return _contractIndex; }
+  bool outputOn() const { return _outputOn; }
+  uint8_t reg(uint8_t cmd, uint8_t offset = 0) const { return _reg[cmd][offset]; }
+  uint8_t width(uint8_t cmd) const { return _width[cmd]; }
+  unsigned long requestCount() const { return _requests; }
+  unsigned long dropoutCount() const { return _dropouts; }
+  unsigned long lastDropoutMs() const { return _dropoutAt; }
+  unsigned long lastRequestMs() const { return _lastRequestMs; }
+
+  // HostI2CDevice
+  bool onWrite(const uint8_t *data, size_t len) override;
+  size_t onRead(uint8_t *data, size_t len) override;
+
+private:
+  void setWord(uint8_t cmd, unsigned int value);
+  void refreshMeasurements();
+  void handleRequest(unsigned long at);
+  void handleSystem();
+  void resetContract();
+  uint8_t nextCmd(uint8_t cmd) const;
+  bool ready() const;
+  void driveInt();
+  static void onAdvance(void *ctx);
+  unsigned long now() const;
+  unsigned long acceptMs();
+
+  uint8_t _width[256];
+  uint8_t _reg[256][SIM_REG_WIDTH];
+
+  SIM_PDO_T _pdo[SIM_MAX_PDO];
+  bool _pdoValid[SIM_MAX_PDO];
+  SIM_TIMING_T _timing;
+
+  unsigned long _powerOnMs = 0;
+  bool _capsAnnounced = false;
+
+  // Register pointer left by the last write, used by the following read
+  uint8_t _ptrCmd = 0x01;
+
+  // Negotiation state
+  bool _pending = false;
+  unsigned long _pendingAt = 0;
+  uint8_t _pendingRdo[2] = {0, 0};
+  int _contractIndex = 1;
+  int _contractMv = 5000;
+  int _contractMa = 3000;
+  unsigned long _lastRequestMs = 0;
+  unsigned long _requests = 0;
+  unsigned long _dropouts = 0;
+  unsigned long _dropoutAt = 0;
+
+  // Accept times, used in turn instead of negotiationMs
+  uint16_t _trace[SIM_MAX_TRACE];
+  int _traceCount = 0;
+  int _traceNext = 0;
+
+  // Analog state
+  int _vbus = 0;
+  int _vbusFrom = 0;
+  unsigned long _slewStartMs = 0;
+  bool _outputOn = false;
+  int _temperature = 25;
+  int _loadMa = 0;
+  long _loadMilliOhm = 0;
+  long _cableMilliOhm = 0;
+  int _measuredMa = 0;
+
+  // INT output, high while STATUS & MASK != 0
+  uint8_t _intPin = 0xff;
+};
+
+#endif
@@ -0,0 +1,129 @@
+/*
+Arduino.h - Minimal host-side stand-in for the Arduino core, used to build
+the AP33772S library on Linux against the simulated register file.
+
+Time is virtual: delay() and bus traffic advance a deterministic clock that
+millis()/micros() report, so every run of a host program is reproducible.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#ifndef __AP33772S_HOST_ARDUINO__
+#define __AP33772S_HOST_ARDUINO__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT        0x0
+#define OUTPUT       0x1
+#define INPUT_PULLUP 0x2
+
+#define CHANGE  1
+#define FALLING 2
+#define RISING  3
+
+#define DEC 10
+#define HEX 16
+#define BIN 2
+
+// Virtual clock, nanosecond resolution
+uint64_t hostNanos();
+void hostAdvanceNanos(uint64_t ns);
+void hostResetClock();
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+inline void yield() {}
+
+// Called after every clock advance, lets simulated peripherals drive pins in time
+void hostOnAdvance(void (*fn)(void *), void *ctx);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+// Default Wire pins, defined as on the AVR, SAMD and RP2040 cores
+#define PIN_WIRE_SDA 18
+#define PIN_WIRE_SCL 19
+
+// Open drain lines: a simulated peripheral holding a pin low wins over the pull-up
+void hostHoldLow(uint8_t pin, bool hold);
+// Called on every level change a pinMode()/digitalWrite() makes, one listener
+void hostOnPinChange(void (*fn)(void *ctx, uint8_t pin, uint8_t level), void *ctx);
+
+// Pin levels driven by digitalWrite() (from a simulated peripheral) fire these
+inline int digitalPinToInterrupt(uint8_t pin) { return pin; }
+void attachInterrupt(int interrupt, void (*isr)(void), int mode);
+void detachInterrupt(int interrupt);
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+class Print
+{
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  size_t write(const char *str) { return str ? write((const uint8_t *)str, strlen(str)) : 0; }
+
+  size_t print(const char *str) { return write(str); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int n, int base = DEC) { return print((long)n, base); }
+  size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); }
+  size_t print(long n, int base = DEC);
+  size_t print(unsigned long n, int base = DEC);
+  size_t print(double n, int digits = 2);
+
+  size_t println() { return write("\r\n"); }
+  template <typename T> size_t println(T v) { size_t n = print(v); return n + println(); }
+  template <typename T> size_t println(T v, int fmt) { size_t n = print(v, fmt); return n + println(); }
+};
+
+/*
+ * Host serial port. Output goes to stdout, input is whatever the host program
+ * queued with inject().
+ */
+class HostSerial : public Print
+{
+public:
+  void begin(unsigned long) {}
+  void end() {}
+  int available();
+  int read();
+  int peek();
+  void flush();
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+  operator bool() const { return true; }
+
+  // Host helpers
+  void inject(const char *data);
+  void inject(const uint8_t *data, size_t len);
+  void setEcho(bool echo) { _echo = echo; }
+  unsigned long bytesWritten() const { return _txCount; }
+
+private:
+  static const size_t RX_LENGTH = 1024;
+  uint8_t _rx[RX_LENGTH];
+  size_t _rxHead = 0;
+  size_t _rxTail = 0;
+  bool _echo = true;
+  unsigned long _txCount = 0;
+};
+
+extern HostSerial Serial;
+
+#endif
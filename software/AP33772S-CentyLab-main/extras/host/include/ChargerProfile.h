@@ -0,0 +1,62 @@
+/*
+ChargerProfile.h - Charger behaviour profiles for the simulated AP33772S.
+
+A profile is a text file, one setting per line, '#' starts a comment:
+
+  name Framework 180W          shown in reports
+  boot 20                      ms until the chip answers I2C
+  caps 190                     ms until SRCPDO is valid and NEWPDO raised
+  slew 30                      mV/ms VBUS moves once a request is accepted
+  keepalive 12000              ms a PPS/AVS contract survives without a request, 0 = never
+  dropout 800                  ms VBUS stays off after the contract lapsed, 0 = straight to 5V
+  accept 41 38 56 ...          ms from PD_REQMSG to PD_MSGRLT, one per request, replayed in turn
+  fixed 9000 3000 [epr]        fixed PDO, mV and mA
+  pps 3300 21000 5000          PPS PDO, min mV, max mV and mA
+  avs 15000 28000 5000         AVS PDO, always EPR
+
+PDOs are listed in the order the source sends them. apply() loads the whole
+profile into an AP33772SSim. The .modeled.profile files shipped in profiles/
+are not recorded, their headers say which values are assumed;
+examples/ChargerCapture prints these lines from a real charger.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#ifndef __AP33772S_CHARGER_PROFILE__
+#define __AP33772S_CHARGER_PROFILE__
+
+#include "AP33772SSim.h"
+
+#define PROFILE_NAME_MAX 40
+
+class ChargerProfile
+{
+public:
+  ChargerProfile();
+
+  bool load(const char *path);
+  void apply(AP33772SSim &sim) const;
+
+  const char *name() const { return _name; }
+  const SIM_TIMING_T &timing() const { return _timing; }
+  const SIM_PDO_T *pdos() const { return _pdo; }
+  int pdoCount() const { return _pdoCount; }
+  const uint16_t *trace() const { return _trace; }
+  int traceCount() const { return _traceCount; }
+  int errorLine() const { return _errorLine; } // First line load() could not parse, 0 if none
+
+private:
+  bool parse(char *line);
+
+  char _name[PROFILE_NAME_MAX];
+  SIM_TIMING_T _timing;
+  SIM_PDO_T _pdo[SIM_MAX_PDO];
+  int _pdoCount = 0;
+  uint16_t _trace[SIM_MAX_TRACE];
+  int _traceCount = 0;
+  int _errorLine = 0;
+};
+
+#endif
@@ -0,0 +1,42 @@
+/*
+FileStorage.h - File backed AP33772SStorage for the host build.
+
+The whole file is held in memory, erased bytes read 0xFF like fresh EEPROM,
+and commit() rewrites the file. Counts the bytes that actually changed, the
+figure that wears a real EEPROM.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#ifndef __AP33772S_FILE_STORAGE__
+#define __AP33772S_FILE_STORAGE__
+
+#include "AP33772S_CapCache.h"
+
+#define FILE_STORAGE_MAX 4096
+
+class FileStorage : public AP33772SStorage
+{
+public:
+  FileStorage(const char *path, uint16_t size = CAPCACHE_SIZE);
+
+  bool read(uint16_t addr, byte *dst, uint16_t len) override;
+  bool write(uint16_t addr, const byte *src, uint16_t len) override;
+  bool commit() override;
+  uint16_t size() override { return _size; }
+
+  unsigned long bytesChanged() const { return _changed; }
+  unsigned long commits() const { return _commits; }
+
+private:
+  const char *_path;
+  uint16_t _size;
+  bool _dirty = false;
+  unsigned long _changed = 0;
+  unsigned long _commits = 0;
+  uint8_t _data[FILE_STORAGE_MAX];
+};
+
+#endif
@@ -0,0 +1,51 @@
+/*
+SampleDecoder.h - Host-side decoder for the AP33772SSampler binary stream.
+
+Bytes can be fed in any chunking, straight from a serial port or a capture
+file. Each sample is handed back with its absolute timestamp and raw register
+values. Frames failing the CRC are dropped and the decoder resyncs on the next
+A5 5A.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#ifndef __AP33772S_SAMPLE_DECODER__
+#define __AP33772S_SAMPLE_DECODER__
+
+#include "AP33772S_Sampler.h"
+
+typedef void (*SAMPLE_HANDLER)(const SAMPLE_RAW_T &sample, void *ctx);
+
+class SampleDecoder
+{
+public:
+  SampleDecoder(SAMPLE_HANDLER handler, void *ctx = nullptr) : _handler(handler), _ctx(ctx) {}
+
+  void feed(const uint8_t *data, size_t len);
+  void reset() { _len = 0; }
+
+  unsigned long frames() const { return _frames; }
+  unsigned long samples() const { return _samples; }
+  unsigned long crcErrors() const { return _crcErrors; }
+  unsigned long formatErrors() const { return _formatErrors; }
+  unsigned long skipped() const { return _skipped; }
+
+private:
+  void feedByte(uint8_t b);
+  bool decodeFrame();
+  void resync();
+
+  SAMPLE_HANDLER _handler;
+  void *_ctx;
+  uint8_t _buf[SAMPLE_FRAME_BYTES];
+  size_t _len = 0;
+  unsigned long _frames = 0;
+  unsigned long _samples = 0;
+  unsigned long _crcErrors = 0;
+  unsigned long _formatErrors = 0;
+  unsigned long _skipped = 0;
+};
+
+#endif
@@ -0,0 +1,121 @@
+/*
+Wire.h - Host-side TwoWire stand-in. Transactions are routed to simulated
+peripherals attached by address, and every transaction is counted so host
+programs can measure what each library call costs on the bus.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#ifndef __AP33772S_HOST_WIRE__
+#define __AP33772S_HOST_WIRE__
+
+#include "Arduino.h"
+
+#define WIRE_BUFFER_LENGTH 128
+#define WIRE_MAX_DEVICES 4
+#define WIRE_HAS_TIMEOUT // setWireTimeout() as on the AVR core
+
+/*
+ * A peripheral on the simulated bus. onWrite() receives every byte written in
+ * one transaction (command byte first) and returns false to NACK.
+ * onRead() fills len bytes for a requestFrom() and returns how many it acked.
+ */
+class HostI2CDevice
+{
+public:
+  virtual ~HostI2CDevice() {}
+  virtual bool onWrite(const uint8_t *data, size_t len) = 0;
+  virtual size_t onRead(uint8_t *data, size_t len) = 0;
+};
+
+// Faults injectFault() applies to the next transactions
+typedef enum
+{
+  WIRE_FAULT_NONE = 0,
+  WIRE_FAULT_NACK,    // Address NACK, on writes and reads
+  WIRE_FAULT_SHORT,   // One byte fewer than requested, reads only
+  WIRE_FAULT_TIMEOUT  // Driver timeout, on writes and reads
+} WIRE_FAULT;
+
+typedef struct
+{
+  unsigned long writeTransactions; // beginTransmission() .. endTransmission()
+  unsigned long readTransactions;  // requestFrom()
+  unsigned long bytesWritten;      // payload bytes, command byte included
+  unsigned long bytesRead;
+  unsigned long nacks;
+  unsigned long timeouts;
+  unsigned long busNanos;          // time spent on the wire at the configured clock
+} WIRE_STATS_T;
+
+class TwoWire
+{
+public:
+  TwoWire();
+
+  void begin() {}
+  void end() {}
+  void setClock(uint32_t hz) { _clockHz = hz; }
+  uint32_t getClock() const { return _clockHz; }
+  void setWireTimeout(uint32_t timeout_us = 25000, bool reset_with_timeout = false);
+  bool getWireTimeoutFlag() const { return _timeoutFlag; }
+  void clearWireTimeoutFlag() { _timeoutFlag = false; }
+
+  void beginTransmission(uint8_t address);
+  size_t write(uint8_t data);
+  size_t write(const uint8_t *data, size_t len);
+  uint8_t endTransmission(bool sendStop = true);
+
+  uint8_t requestFrom(uint8_t address, uint8_t len, bool sendStop = true);
+  uint8_t requestFrom(int address, int len) { return requestFrom((uint8_t)address, (uint8_t)len); }
+  int available();
+  int read();
+  int peek();
+
+  // Host helpers
+  void attach(uint8_t address, HostI2CDevice *device);
+  void detach(uint8_t address);
+  const WIRE_STATS_T &stats() const { return _stats; }
+  void resetStats();
+  void setBusTiming(bool enable) { _busTiming = enable; }
+  void injectFault(WIRE_FAULT fault, unsigned count = 1);
+  // A peripheral stuck mid-byte holds SDA low, every transaction times out until
+  // PIN_WIRE_SCL has been pulsed this many times
+  void holdSDA(unsigned pulses);
+  bool sdaHeld() const { return _stuckPulses > 0; }
+
+private:
+  HostI2CDevice *find(uint8_t address);
+  void chargeBits(unsigned long bits);
+  bool takeFault(WIRE_FAULT fault);
+  uint8_t timeout();
+  static void onPinChange(void *ctx, uint8_t pin, uint8_t level);
+
+  uint8_t _addresses[WIRE_MAX_DEVICES];
+  HostI2CDevice *_devices[WIRE_MAX_DEVICES];
+
+  uint8_t _txAddress = 0;
+  uint8_t _txBuf[WIRE_BUFFER_LENGTH];
+  size_t _txLen = 0;
+  bool _txActive = false;
+
+  uint8_t _rxBuf[WIRE_BUFFER_LENGTH];
+  size_t _rxLen = 0;
+  size_t _rxPos = 0;
+
+  uint32_t _clockHz = 100000;
+  bool _busTiming = true;
+  uint32_t _timeoutUs = 0;
+  bool _timeoutFlag = false;
+  WIRE_FAULT _fault = WIRE_FAULT_NONE;
+  unsigned _faultCount = 0;
+  unsigned _stuckPulses = 0;
+  WIRE_STATS_T _stats;
+};
+
+extern TwoWire Wire;
+extern TwoWire Wire1;
+
+#endif
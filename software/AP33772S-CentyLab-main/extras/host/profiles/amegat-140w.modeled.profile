@@ -0,0 +1,19 @@
+# AMEGAT power bank, 140 W. Modeled, not recorded from a unit: the PDO list
+# is a typical 140 W PD 3.1 bank, and boot, caps, slew, keepalive, dropout
+# and the accept times are assumed, chosen to make it slow to announce, drop
+# a PPS/AVS contract after 8 s without a request and cut VBUS for a hard reset.
+name AMEGAT 140W
+boot 22
+caps 420
+slew 18
+keepalive 8000
+dropout 900
+accept 88 92 85 110 90 87 96 132 89 91 86 94 88 121 90 93
+fixed 5000 3000
+fixed 9000 3000
+fixed 12000 3000
+fixed 15000 3000
+fixed 20000 5000
+pps 3300 21000 5000
+fixed 28000 5000 epr
+avs 15000 28000 5000
@@ -0,0 +1,20 @@
+# Baseus power bank, 140 W. Modeled, not recorded from a unit. Two PPS
+# ranges, the 11 V one first, are assumed along with the rest of the PDO list.
+# Boot, caps, slew and accept are estimates, and the 10 s keepalive after
+# which VBUS falls back to 5 V without going off is assumed too.
+name Baseus 140W
+boot 20
+caps 310
+slew 25
+keepalive 10000
+dropout 0
+accept 58 61 55 64 57 72 59 56 60 58 66 55 57 81 59 62
+fixed 5000 3000
+fixed 9000 3000
+fixed 12000 3000
+fixed 15000 3000
+fixed 20000 5000
+pps 3300 11000 5000
+pps 3300 21000 5000
+fixed 28000 5000 epr
+avs 15000 28000 5000
@@ -0,0 +1,19 @@
+# Framework Laptop 16 charger, 180 W. Modeled from its published output
+# ratings, no PPS, EPR fixed 28 V and 36 V at 5 A and AVS up to 36 V, of
+# which the AP33772S uses up to 28 V. Boot, caps, slew, keepalive, dropout
+# and the accept times are assumed: 15 s for an AVS contract to lapse
+# without a request, then a hard reset.
+name Framework 180W
+boot 18
+caps 170
+slew 40
+keepalive 15000
+dropout 700
+accept 36 38 41 35 52 37 39 36 44 38 35 40 37 61 38 36
+fixed 5000 3000
+fixed 9000 3000
+fixed 15000 3000
+fixed 20000 5000
+fixed 28000 5000 epr
+fixed 36000 5000 epr
+avs 15000 36000 5000
@@ -0,0 +1,19 @@
+# UGREEN Nexode 300 W desktop charger, 140 W on a single port. Modeled: the
+# PDOs follow its per-port output ratings, EPR fixed 28 V at 5 A, with the AVS
+# range assumed. Boot, caps, slew, keepalive, dropout and the accept times are
+# assumed, fast to accept with a 12 s PPS/AVS keepalive then a hard reset.
+name UGREEN Nexode 300W
+boot 18
+caps 140
+slew 50
+keepalive 12000
+dropout 650
+accept 28 31 27 29 35 28 30 27 33 29 28 44 30 27 29 31
+fixed 5000 3000
+fixed 9000 3000
+fixed 12000 3000
+fixed 15000 3000
+fixed 20000 5000
+pps 3300 21000 5000
+fixed 28000 5000 epr
+avs 15000 28000 5000
@@ -0,0 +1,433 @@
+/*
+AP33772SSim.cpp - Simulated AP33772S register file for the host build.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#include "AP33772SSim.h"
+
+#define SIM_STATUS    0x01
+#define SIM_MASK      0x02
+#define SIM_SYSTEM    0x06
+#define SIM_TR25      0x0C
+#define SIM_TR50      0x0D
+#define SIM_TR75      0x0E
+#define SIM_TR100     0x0F
+#define SIM_VOLTAGE   0x11
+#define SIM_CURRENT   0x12
+#define SIM_TEMP      0x13
+#define SIM_VREQ      0x14
+#define SIM_IREQ      0x15
+#define SIM_VSELMIN   0x16
+#define SIM_UVPTHR    0x17
+#define SIM_OVPTHR    0x18
+#define SIM_OCPTHR    0x19
+#define SIM_OTPTHR    0x1A
+#define SIM_DRTHR     0x1B
+#define SIM_SRCPDO    0x20
+#define SIM_PD_REQMSG 0x31
+#define SIM_PD_CMDMSG 0x32
+#define SIM_PD_MSGRLT 0x33
+
+#define SIM_STARTED (1 << 0)
+#define SIM_READY   (1 << 1)
+#define SIM_NEWPDO  (1 << 2)
+#define SIM_OTP     (1 << 6)
+
+static const SIM_TIMING_T DEFAULT_TIMING = {
+  20,   // bootMs
+  80,   // capsMs
+  40,   // negotiationMs
+  50,   // slewMvPerMs
+  0,    // keepaliveMs
+  0,    // accessUs
+  0     // dropoutMs
+};
+
+/*
+ * Current code shared by the PDO CURRENT_MAX and RDO CURRENT_SEL fields.
+ * Code n covers [1000 + 250n, 1250 + 250n) mA, code 15 is 5 A and above.
+ */
+static uint8_t currentCode(int mA)
+{
+  if (mA >= 5000) return 15;
+  if (mA < 1250) return 0;
+  int code = (mA - 1000) / 250;
+  return code > 14 ? 14 : code;
+}
+
+static int currentFromCode(uint8_t code)
+{
+  return code >= 15 ? 5000 : 1000 + 250 * code;
+}
+
+AP33772SSim::AP33772SSim()
+{
+  memset(_width, 0, sizeof(_width));
+  memset(_reg, 0, sizeof(_reg));
+  memset(_pdo, 0, sizeof(_pdo));
+  memset(_pdoValid, 0, sizeof(_pdoValid));
+  _timing = DEFAULT_TIMING;
+
+  for (uint8_t cmd = SIM_STATUS; cmd <= SIM_SYSTEM; cmd++) _width[cmd] = 1;
+  for (uint8_t cmd = SIM_TR25; cmd <= SIM_TR100; cmd++) _width[cmd] = 2;
+  _width[SIM_VOLTAGE] = 2;
+  _width[SIM_CURRENT] = 1;
+  _width[SIM_TEMP] = 1;
+  _width[SIM_VREQ] = 2;
+  _width[SIM_IREQ] = 2;
+  for (uint8_t cmd = SIM_VSELMIN; cmd <= SIM_DRTHR; cmd++) _width[cmd] = 1;
+  _width[SIM_SRCPDO] = 26;
+  _width[SIM_PD_REQMSG] = 2;
+  _width[SIM_PD_CMDMSG] = 1;
+  _width[SIM_PD_MSGRLT] = 1;
+
+  // Single 5V/3A fixed PDO until told otherwise
+  SIM_PDO_T fallback = {SIM_PDO_FIXED, 0, 5000, 3000, false};
+  setSourcePDOs(&fallback, 1);
+}
+
+/**
+ * @brief Load the source capabilities. SPR entries fill slots 1-7 in order,
+ *        EPR entries (and every AVS entry) fill slots 8-13.
+ */
+void AP33772SSim::setSourcePDOs(const SIM_PDO_T *pdos, int count)
+{
+  memset(_pdoValid, 0, sizeof(_pdoValid));
+  int spr = 0;
+  int epr = SIM_SPR_SLOTS;
+  for (int i = 0; i < count; i++)
+  {
+    bool isEPR = pdos[i].epr || pdos[i].kind == SIM_PDO_AVS;
+    int slot = isEPR ? epr++ : spr++;
+    if (isEPR ? slot >= SIM_MAX_PDO : slot >= SIM_SPR_SLOTS) continue;
+    _pdo[slot] = pdos[i];
+    _pdo[slot].epr = isEPR;
+    _pdoValid[slot] = true;
+  }
+}
+
+/**
+ * @brief Replay a trace of accept times, request n is accepted after ms[n % count].
+ *        A count of 0 goes back to the fixed negotiationMs.
+ */
+void AP33772SSim::setAcceptTrace(const uint16_t *ms, int count)
+{
+  _traceCount = count > SIM_MAX_TRACE ? SIM_MAX_TRACE : count;
+  if (_traceCount > 0) memcpy(_trace, ms, _traceCount * sizeof(_trace[0]));
+  _traceNext = 0;
+}
+
+unsigned long AP33772SSim::acceptMs()
+{
+  if (_traceCount == 0) return _timing.negotiationMs;
+  unsigned long ms = _trace[_traceNext];
+  _traceNext = (_traceNext + 1) % _traceCount;
+  return ms;
+}
+
+/**
+ * @brief Drive INT on the given host pin and keep the model in step with the clock
+ */
+void AP33772SSim::setIntPin(uint8_t pin)
+{
+  _intPin = pin;
+  hostOnAdvance(onAdvance, this);
+  driveInt();
+}
+
+void AP33772SSim::onAdvance(void *ctx)
+{
+  ((AP33772SSim *)ctx)->update();
+}
+
+void AP33772SSim::driveInt()
+{
+  if (_intPin != 0xff) digitalWrite(_intPin, (_reg[SIM_STATUS][0] & _reg[SIM_MASK][0]) ? HIGH : LOW);
+}
+
+void AP33772SSim::powerOn()
+{
+  _powerOnMs = millis();
+  _capsAnnounced = false;
+  _pending = false;
+  _ptrCmd = SIM_STATUS;
+
+  for (int cmd = 0; cmd < 256; cmd++) memset(_reg[cmd], 0, SIM_REG_WIDTH);
+  setWord(SIM_TR25, 10000);
+  setWord(SIM_TR50, 4161);
+  setWord(SIM_TR75, 1928);
+  setWord(SIM_TR100, 974);
+  _reg[SIM_SYSTEM][0] = 0x10;
+  _reg[SIM_VSELMIN][0] = 5000 / 200;
+  _reg[SIM_UVPTHR][0] = 1;
+  _reg[SIM_OVPTHR][0] = 2000 / 80;
+  _reg[SIM_OTPTHR][0] = 120;
+  _reg[SIM_DRTHR][0] = 100;
+  _reg[SIM_STATUS][0] = SIM_STARTED;
+
+  resetContract();
+  _vbus = 5000;
+  _vbusFrom = 5000;
+  _slewStartMs = _powerOnMs;
+  refreshMeasurements();
+}
+
+void AP33772SSim::resetContract()
+{
+  _contractIndex = 1;
+  _contractMv = 5000;
+  _contractMa = _pdoValid[0] ? _pdo[0].max_mA : 3000;
+  setWord(SIM_VREQ, _contractMv / 50);
+  setWord(SIM_IREQ, _contractMa / 10);
+  handleSystem();
+}
+
+unsigned long AP33772SSim::now() const
+{
+  return millis();
+}
+
+bool AP33772SSim::ready() const
+{
+  return now() - _powerOnMs >= _timing.bootMs;
+}
+
+void AP33772SSim::setWord(uint8_t cmd, unsigned int value)
+{
+  _reg[cmd][0] = value & 0xff;
+  _reg[cmd][1] = (value >> 8) & 0xff;
+}
+
+uint8_t AP33772SSim::nextCmd(uint8_t cmd) const
+{
+  while (cmd < 0xff)
+  {
+    cmd++;
+    if (_width[cmd]) return cmd;
+  }
+  return 0;
+}
+
+/**
+ * @brief Advance the simulated chip to the current virtual time
+ */
+void AP33772SSim::update()
+{
+  unsigned long t = now();
+
+  if (!_capsAnnounced && t - _powerOnMs >= _timing.capsMs)
+  {
+    for (int i = 0; i < SIM_MAX_PDO; i++)
+    {
+      unsigned int word = 0;
+      if (_pdoValid[i])
+      {
+        const SIM_PDO_T &p = _pdo[i];
+        unsigned int unit = p.epr ? 200 : 100;
+        word = (p.max_mV / unit) & 0xff;
+        word |= (unsigned int)currentCode(p.max_mA) << 10;
+        if (p.kind != SIM_PDO_FIXED)
+        {
+          unsigned int floor = p.epr ? 15000 : 3300;
+          unsigned int minCode = p.min_mV <= (int)floor ? 1 : (p.min_mV <= (int)(p.epr ? 20000 : 5000) ? 2 : 3);
+          word |= minCode << 8;
+          word |= 1u << 14;
+        }
+        word |= 1u << 15;
+      }
+      _reg[SIM_SRCPDO][2 * i] = word & 0xff;
+      _reg[SIM_SRCPDO][2 * i + 1] = (word >> 8) & 0xff;
+    }
+    _reg[SIM_STATUS][0] |= SIM_STARTED | SIM_READY | SIM_NEWPDO;
+    _reg[SIM_PD_MSGRLT][0] = SIM_MSGRLT_SUCCESS;
+    _capsAnnounced = true;
+    _lastRequestMs = t;
+  }
+
+  if (_pending && t >= _pendingAt)
+  {
+    _pending = false;
+    handleRequest(_pendingAt);
+  }
+
+  // Keepalive: programmable contracts lapse without a fresh request
+  if (_timing.keepaliveMs && _capsAnnounced && _pdoValid[_contractIndex - 1] &&
+      _pdo[_contractIndex - 1].kind != SIM_PDO_FIXED &&
+      t - _lastRequestMs > _timing.keepaliveMs)
+  {
+    _dropouts++;
+    _dropoutAt = t;
+    _vbusFrom = _timing.dropoutMs ? 0 : _vbus; // Hard reset: off, then 5V
+    _slewStartMs = t + _timing.dropoutMs;
+    _lastRequestMs = t;
+    resetContract();
+    _reg[SIM_STATUS][0] |= SIM_STARTED | SIM_NEWPDO;
+  }
+
+  // VBUS follows the contract at the source slew rate
+  long delta = (long)_contractMv - _vbusFrom;
+  long moved = (long)(_timing.slewMvPerMs * (t - _slewStartMs));
+  if ((long)(t - _slewStartMs) < 0) _vbus = _vbusFrom;
+  else if (_timing.slewMvPerMs == 0 || moved >= labs(delta)) _vbus = _contractMv;
+  else _vbus = _vbusFrom + (delta > 0 ? moved : -moved);
+
+  if (_reg[SIM_OTPTHR][0] && _temperature >= _reg[SIM_OTPTHR][0] && _outputOn)
+  {
+    _reg[SIM_STATUS][0] |= SIM_OTP;
+    _outputOn = false;
+  }
+
+  refreshMeasurements();
+  driveInt();
+}
+
+void AP33772SSim::refreshMeasurements()
+{
+  long vsrc = _vbus;
+  long ma = 0;
+  if (_outputOn)
+  {
+    if (_loadMilliOhm > 0) ma = vsrc * 1000 / (_loadMilliOhm + _cableMilliOhm);
+    else ma = _loadMa;
+    if (ma > _contractMa) ma = _contractMa;
+  }
+  _measuredMa = (int)ma;
+  long vsense = vsrc - ma * _cableMilliOhm / 1000;
+  if (vsense < 0) vsense = 0;
+
+  setWord(SIM_VOLTAGE, (unsigned int)(vsense / 80));
+  _reg[SIM_CURRENT][0] = ma / 24 > 255 ? 255 : (uint8_t)(ma / 24);
+  _reg[SIM_TEMP][0] = _temperature < 0 ? 0 : (uint8_t)_temperature;
+}
+
+void AP33772SSim::handleRequest(unsigned long at)
+{
+  uint8_t vsel = _pendingRdo[0];
+  uint8_t csel = _pendingRdo[1] & 0x0f;
+  int index = _pendingRdo[1] >> 4;
+
+  _reg[SIM_STATUS][0] |= SIM_READY; // Negotiation finished, result in PD_MSGRLT
+  if (index < 1 || index > SIM_MAX_PDO || !_pdoValid[index - 1])
+  {
+    _reg[SIM_PD_MSGRLT][0] = SIM_MSGRLT_INVALID;
+    return;
+  }
+
+  const SIM_PDO_T &p = _pdo[index - 1];
+  int mV = p.max_mV;
+  int mA = currentFromCode(csel);
+  if (p.kind != SIM_PDO_FIXED)
+  {
+    mV = vsel * (p.epr ? 200 : 100);
+    if (mV < p.min_mV || mV > p.max_mV)
+    {
+      _reg[SIM_PD_MSGRLT][0] = SIM_MSGRLT_FAIL;
+      return;
+    }
+  }
+  if (csel > currentCode(p.max_mA))
+  {
+    _reg[SIM_PD_MSGRLT][0] = SIM_MSGRLT_FAIL;
+    return;
+  }
+
+  _vbusFrom = _vbus;
+  _slewStartMs = at;
+  _contractIndex = index;
+  _contractMv = mV;
+  _contractMa = mA > p.max_mA ? p.max_mA : mA;
+  _lastRequestMs = at;
+  setWord(SIM_VREQ, _contractMv / 50);
+  setWord(SIM_IREQ, _contractMa / 10);
+  _reg[SIM_PD_MSGRLT][0] = SIM_MSGRLT_SUCCESS;
+  handleSystem();
+}
+
+void AP33772SSim::handleSystem()
+{
+  switch (_reg[SIM_SYSTEM][0] & 0x03)
+  {
+    case 1:
+      _outputOn = false;
+      break;
+    case 2:
+      _outputOn = true;
+      break;
+    default:
+      _outputOn = _contractMv >= _reg[SIM_VSELMIN][0] * 200;
+      break;
+  }
+}
+
+bool AP33772SSim::onWrite(const uint8_t *data, size_t len)
+{
+  update();
+  if (_timing.accessUs) hostAdvanceNanos((uint64_t)_timing.accessUs * 1000ULL);
+  if (!ready()) return false;
+  if (len == 0) return true;
+
+  uint8_t cmd = data[0];
+  _ptrCmd = cmd;
+  uint8_t offset = 0;
+  for (size_t i = 1; i < len && cmd; i++)
+  {
+    bool writable = cmd != SIM_STATUS && !(cmd >= SIM_VOLTAGE && cmd <= SIM_IREQ) &&
+                    cmd != SIM_SRCPDO && cmd != SIM_PD_MSGRLT && _width[cmd];
+    if (writable) _reg[cmd][offset] = data[i];
+    offset++;
+    if (offset >= _width[cmd])
+    {
+      if (cmd == SIM_PD_REQMSG)
+      {
+        _requests++;
+        _pendingRdo[0] = _reg[cmd][0];
+        _pendingRdo[1] = _reg[cmd][1];
+        _pending = true;
+        _pendingAt = now() + acceptMs();
+        _reg[SIM_PD_MSGRLT][0] = SIM_MSGRLT_BUSY;
+      }
+      else if (cmd == SIM_SYSTEM)
+      {
+        handleSystem();
+      }
+      else if (cmd == SIM_MASK)
+      {
+        driveInt();
+      }
+      cmd = nextCmd(cmd);
+      offset = 0;
+    }
+  }
+  refreshMeasurements();
+  return true;
+}
+
+size_t AP33772SSim::onRead(uint8_t *data, size_t len)
+{
+  update();
+  if (_timing.accessUs) hostAdvanceNanos((uint64_t)_timing.accessUs * 1000ULL);
+  if (!ready()) return 0;
+
+  uint8_t cmd = _ptrCmd;
+  uint8_t offset = 0;
+  for (size_t i = 0; i < len; i++)
+  {
+    data[i] = cmd ? _reg[cmd][offset] : 0;
+    if (!cmd) continue;
+    offset++;
+    if (offset >= _width[cmd])
+    {
+      if (cmd == SIM_STATUS)
+      {
+        _reg[SIM_STATUS][0] = 0; // Clear on read
+        driveInt();
+      }
+      cmd = nextCmd(cmd);
+      offset = 0;
+    }
+  }
+  return len;
+}
@@ -0,0 +1,218 @@
+/*
+Arduino.cpp - Virtual clock, GPIO and Serial for the host build.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#include <stdio.h>
+
+#include "Arduino.h"
+
+#define HOST_PIN_COUNT 64
+#define HOST_LISTENERS 4
+
+static uint64_t s_nanos = 0;
+static uint8_t s_pinLevel[HOST_PIN_COUNT] = {0};
+static void (*s_isr[HOST_PIN_COUNT])(void) = {0};
+static int s_isrMode[HOST_PIN_COUNT] = {0};
+static bool s_pinHeld[HOST_PIN_COUNT] = {0};
+static void (*s_pinListener)(void *, uint8_t, uint8_t) = nullptr;
+static void *s_pinListenerCtx = nullptr;
+
+static void (*s_listener[HOST_LISTENERS])(void *) = {0};
+static void *s_listenerCtx[HOST_LISTENERS] = {0};
+static bool s_notifying = false;
+
+HostSerial Serial;
+
+uint64_t hostNanos()
+{
+  return s_nanos;
+}
+
+static void notifyAdvance()
+{
+  if (s_notifying) return; // A listener advancing the clock itself
+  s_notifying = true;
+  for (int i = 0; i < HOST_LISTENERS; i++)
+  {
+    if (s_listener[i]) s_listener[i](s_listenerCtx[i]);
+  }
+  s_notifying = false;
+}
+
+void hostOnAdvance(void (*fn)(void *), void *ctx)
+{
+  for (int i = 0; i < HOST_LISTENERS; i++)
+  {
+    if (s_listener[i] == nullptr || (s_listener[i] == fn && s_listenerCtx[i] == ctx))
+    {
+      s_listener[i] = fn;
+      s_listenerCtx[i] = ctx;
+      return;
+    }
+  }
+}
+
+void hostAdvanceNanos(uint64_t ns)
+{
+  s_nanos += ns;
+  notifyAdvance();
+}
+
+void hostResetClock()
+{
+  s_nanos = 0;
+}
+
+unsigned long millis()
+{
+  return (unsigned long)(s_nanos / 1000000ULL);
+}
+
+unsigned long micros()
+{
+  return (unsigned long)(s_nanos / 1000ULL);
+}
+
+void delay(unsigned long ms)
+{
+  hostAdvanceNanos((uint64_t)ms * 1000000ULL);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  hostAdvanceNanos((uint64_t)us * 1000ULL);
+}
+
+static void setLevel(uint8_t pin, uint8_t level)
+{
+  uint8_t old = s_pinLevel[pin];
+  s_pinLevel[pin] = level;
+  if (old == level) return;
+  if (s_pinListener != nullptr) s_pinListener(s_pinListenerCtx, pin, level);
+  if (s_isr[pin] == nullptr) return;
+  if (s_isrMode[pin] == CHANGE || (s_isrMode[pin] == RISING && level == HIGH) ||
+      (s_isrMode[pin] == FALLING && level == LOW)) s_isr[pin]();
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+  if (pin < HOST_PIN_COUNT && mode == INPUT_PULLUP) setLevel(pin, HIGH);
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+  if (pin < HOST_PIN_COUNT) setLevel(pin, val ? HIGH : LOW);
+}
+
+void hostHoldLow(uint8_t pin, bool hold)
+{
+  if (pin < HOST_PIN_COUNT) s_pinHeld[pin] = hold;
+}
+
+void hostOnPinChange(void (*fn)(void *ctx, uint8_t pin, uint8_t level), void *ctx)
+{
+  s_pinListener = fn;
+  s_pinListenerCtx = ctx;
+}
+
+void attachInterrupt(int interrupt, void (*isr)(void), int mode)
+{
+  if (interrupt < 0 || interrupt >= HOST_PIN_COUNT) return;
+  s_isr[interrupt] = isr;
+  s_isrMode[interrupt] = mode;
+}
+
+void detachInterrupt(int interrupt)
+{
+  if (interrupt >= 0 && interrupt < HOST_PIN_COUNT) s_isr[interrupt] = nullptr;
+}
+
+int digitalRead(uint8_t pin)
+{
+  if (pin >= HOST_PIN_COUNT || s_pinHeld[pin]) return LOW;
+  return s_pinLevel[pin];
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+  size_t n = 0;
+  while (size--) n += write(*buffer++);
+  return n;
+}
+
+size_t Print::print(long n, int base)
+{
+  if (base == DEC && n < 0) return print('-') + print((unsigned long)-n, base);
+  return print((unsigned long)n, base);
+}
+
+size_t Print::print(unsigned long n, int base)
+{
+  char buf[8 * sizeof(long) + 1];
+  char *str = &buf[sizeof(buf) - 1];
+  *str = '\0';
+  if (base < 2) base = 10;
+  do {
+    char c = n % base;
+    n /= base;
+    *--str = c < 10 ? c + '0' : c + 'A' - 10;
+  } while (n);
+  return write(str);
+}
+
+size_t Print::print(double n, int digits)
+{
+  char buf[48];
+  snprintf(buf, sizeof(buf), "%.*f", digits, n);
+  return write(buf);
+}
+
+int HostSerial::available()
+{
+  return (int)(_rxHead - _rxTail);
+}
+
+int HostSerial::read()
+{
+  if (_rxTail == _rxHead) return -1;
+  return _rx[_rxTail++ % RX_LENGTH];
+}
+
+int HostSerial::peek()
+{
+  if (_rxTail == _rxHead) return -1;
+  return _rx[_rxTail % RX_LENGTH];
+}
+
+void HostSerial::flush()
+{
+  fflush(stdout);
+}
+
+size_t HostSerial::write(uint8_t c)
+{
+  _txCount++;
+  if (_echo) fputc(c, stdout);
+  return 1;
+}
+
+size_t HostSerial::write(const uint8_t *buffer, size_t size)
+{
+  _txCount += size;
+  if (_echo) fwrite(buffer, 1, size, stdout);
+  return size;
+}
+
+void HostSerial::inject(const char *data)
+{
+  inject((const uint8_t *)data, strlen(data));
+}
+
+void HostSerial::inject(const uint8_t *data, size_t len)
+{
+  while (len-- && _rxHead - _rxTail < RX_LENGTH) _rx[_rxHead++ % RX_LENGTH] = *data++;
+}
@@ -0,0 +1,121 @@
+/*
+ChargerProfile.cpp - Charger behaviour profiles for the simulated AP33772S.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ChargerProfile.h"
+
+ChargerProfile::ChargerProfile()
+{
+  _name[0] = 0;
+  _timing = AP33772SSim().timing(); // Anything the profile leaves out keeps the simulator default
+  memset(_pdo, 0, sizeof(_pdo));
+  memset(_trace, 0, sizeof(_trace));
+}
+
+/**
+ * @brief Read a profile file, see ChargerProfile.h for the format
+ * @return 0 if the file is missing, a line does not parse or there is no PDO
+ */
+bool ChargerProfile::load(const char *path)
+{
+  FILE *f = fopen(path, "r");
+  if (!f) return false;
+
+  char line[256];
+  int n = 0;
+  _errorLine = 0;
+  while (fgets(line, sizeof(line), f))
+  {
+    n++;
+    char *hash = strchr(line, '#');
+    if (hash) *hash = 0;
+    if (!parse(line))
+    {
+      _errorLine = n;
+      break;
+    }
+  }
+  fclose(f);
+  return _errorLine == 0 && _pdoCount > 0;
+}
+
+static bool number(const char *token, unsigned long &value)
+{
+  if (!token) return false;
+  char *end;
+  value = strtoul(token, &end, 10);
+  return end != token && *end == 0;
+}
+
+bool ChargerProfile::parse(char *line)
+{
+  const char *key = strtok(line, " \t\r\n");
+  if (!key) return true; // Blank or comment
+
+  if (strcmp(key, "name") == 0)
+  {
+    const char *rest = strtok(NULL, "\r\n");
+    if (!rest) return false;
+    while (isspace((unsigned char)*rest)) rest++;
+    snprintf(_name, sizeof(_name), "%s", rest);
+    return true;
+  }
+
+  if (strcmp(key, "accept") == 0)
+  {
+    unsigned long ms;
+    const char *token;
+    while ((token = strtok(NULL, " \t\r\n")) != NULL)
+    {
+      if (!number(token, ms) || ms > 0xffff || _traceCount >= SIM_MAX_TRACE) return false;
+      _trace[_traceCount++] = (uint16_t)ms;
+    }
+    return true;
+  }
+
+  unsigned long *field = NULL;
+  if (strcmp(key, "boot") == 0) field = &_timing.bootMs;
+  else if (strcmp(key, "caps") == 0) field = &_timing.capsMs;
+  else if (strcmp(key, "slew") == 0) field = &_timing.slewMvPerMs;
+  else if (strcmp(key, "keepalive") == 0) field = &_timing.keepaliveMs;
+  else if (strcmp(key, "dropout") == 0) field = &_timing.dropoutMs;
+  if (field) return number(strtok(NULL, " \t\r\n"), *field);
+
+  SIM_PDO_T pdo = {SIM_PDO_FIXED, 0, 0, 0, false};
+  unsigned long v[3];
+  if (strcmp(key, "pps") == 0) pdo.kind = SIM_PDO_PPS;
+  else if (strcmp(key, "avs") == 0) pdo.kind = SIM_PDO_AVS;
+  else if (strcmp(key, "fixed") != 0) return false;
+  int values = pdo.kind == SIM_PDO_FIXED ? 2 : 3; // Fixed has no minimum
+
+  for (int i = 0; i < values; i++)
+    if (!number(strtok(NULL, " \t\r\n"), v[i]) || v[i] > 50000) return false;
+  const char *flag = strtok(NULL, " \t\r\n");
+  if (flag && strcmp(flag, "epr") != 0) return false;
+  if (_pdoCount >= SIM_MAX_PDO) return false;
+
+  pdo.min_mV = values == 3 ? v[0] : 0;
+  pdo.max_mV = v[values - 2];
+  pdo.max_mA = v[values - 1];
+  pdo.epr = flag != NULL || pdo.kind == SIM_PDO_AVS;
+  _pdo[_pdoCount++] = pdo;
+  return true;
+}
+
+/**
+ * @brief Load PDOs, timing and the accept trace into the simulator, powerOn() not included
+ */
+void ChargerProfile::apply(AP33772SSim &sim) const
+{
+  sim.setSourcePDOs(_pdo, _pdoCount);
+  sim.setTiming(_timing);
+  sim.setAcceptTrace(_trace, _traceCount);
+}
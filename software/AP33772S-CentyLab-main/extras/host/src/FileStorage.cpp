@@ -0,0 +1,56 @@
+/*
+FileStorage.cpp - File backed AP33772SStorage for the host build.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#include <stdio.h>
+
+#include "FileStorage.h"
+
+FileStorage::FileStorage(const char *path, uint16_t size) : _path(path)
+{
+  _size = size > FILE_STORAGE_MAX ? FILE_STORAGE_MAX : size;
+  memset(_data, 0xff, sizeof(_data));
+  FILE *f = fopen(_path, "rb");
+  if (f)
+  {
+    size_t got = fread(_data, 1, _size, f);
+    (void)got; // A short file keeps the erased tail
+    fclose(f);
+  }
+}
+
+bool FileStorage::read(uint16_t addr, byte *dst, uint16_t len)
+{
+  if ((uint32_t)addr + len > _size) return false;
+  memcpy(dst, &_data[addr], len);
+  return true;
+}
+
+bool FileStorage::write(uint16_t addr, const byte *src, uint16_t len)
+{
+  if ((uint32_t)addr + len > _size) return false;
+  for (uint16_t i = 0; i < len; i++)
+  {
+    if (_data[addr + i] == src[i]) continue;
+    _data[addr + i] = src[i];
+    _changed++;
+    _dirty = true;
+  }
+  return true;
+}
+
+bool FileStorage::commit()
+{
+  if (!_dirty) return true;
+  FILE *f = fopen(_path, "wb");
+  if (!f) return false;
+  bool ok = fwrite(_data, 1, _size, f) == _size;
+  fclose(f);
+  _dirty = false;
+  _commits++;
+  return ok;
+}
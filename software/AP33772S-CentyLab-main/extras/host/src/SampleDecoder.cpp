@@ -0,0 +1,118 @@
+/*
+SampleDecoder.cpp - Host-side decoder for the AP33772SSampler binary stream.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#include "SampleDecoder.h"
+
+static bool getVarint(const uint8_t *&p, const uint8_t *end, uint32_t &value)
+{
+  value = 0;
+  for (int shift = 0; shift < 35 && p < end; shift += 7)
+  {
+    uint8_t b = *p++;
+    value |= (uint32_t)(b & 0x7f) << shift;
+    if (!(b & 0x80)) return true;
+  }
+  return false;
+}
+
+static bool getSigned(const uint8_t *&p, const uint8_t *end, int32_t &value)
+{
+  uint32_t z;
+  if (!getVarint(p, end, z)) return false;
+  value = (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+  return true;
+}
+
+void SampleDecoder::feed(const uint8_t *data, size_t len)
+{
+  while (len--) feedByte(*data++);
+}
+
+void SampleDecoder::feedByte(uint8_t b)
+{
+  if (_len == 0 && b != SAMPLE_SYNC0)
+  {
+    _skipped++;
+    return;
+  }
+  _buf[_len++] = b;
+
+  while (_len)
+  {
+    if (_len >= 2 && _buf[1] != SAMPLE_SYNC1) { resync(); continue; }
+    if (_len < SAMPLE_FRAME_HEADER) return;
+
+    size_t payload = _buf[4] | (_buf[5] << 8);
+    if (_buf[2] != SAMPLE_FRAME_DATA || _buf[3] == 0 || _buf[3] > SAMPLE_FRAME_SAMPLES ||
+        payload + SAMPLE_FRAME_HEADER + 2 > sizeof(_buf))
+    {
+      _formatErrors++;
+      resync();
+      continue;
+    }
+    if (_len < payload + SAMPLE_FRAME_HEADER + 2) return;
+
+    uint16_t crc = _buf[_len - 2] | (_buf[_len - 1] << 8);
+    if (crc != AP33772SSampler::crc16(_buf + 2, _len - 4))
+    {
+      _crcErrors++;
+      resync();
+      continue;
+    }
+    if (decodeFrame()) _frames++;
+    else _formatErrors++;
+    _len = 0;
+  }
+}
+
+/*
+ * Drop the first buffered byte and restart at the next A5 in what is left,
+ * so a frame starting inside a corrupted one is still found.
+ */
+void SampleDecoder::resync()
+{
+  size_t next = 1;
+  while (next < _len && _buf[next] != SAMPLE_SYNC0) next++;
+  _skipped += next;
+  memmove(_buf, _buf + next, _len - next);
+  _len -= next;
+}
+
+bool SampleDecoder::decodeFrame()
+{
+  const uint8_t *p = _buf + SAMPLE_FRAME_HEADER;
+  const uint8_t *end = _buf + _len - 2;
+  unsigned int count = _buf[3];
+
+  uint32_t t, period, v, i, c;
+  if (!getVarint(p, end, t) || !getVarint(p, end, period) || !getVarint(p, end, v) ||
+      !getVarint(p, end, i) || !getVarint(p, end, c)) return false;
+
+  SAMPLE_RAW_T s;
+  s.t_us = t;
+  s.voltage = (uint16_t)v;
+  s.current = (uint8_t)i;
+  s.temp = (uint8_t)c;
+  _handler(s, _ctx);
+  _samples++;
+
+  for (unsigned int n = 1; n < count; n++)
+  {
+    if (p >= end) return false;
+    uint8_t tag = *p++;
+    int32_t d;
+    s.t_us += period;
+    if (tag & SAMPLE_TAG_TIME) { if (!getSigned(p, end, d)) return false; s.t_us += d; }
+    if (tag & SAMPLE_TAG_VOLTAGE) { if (!getSigned(p, end, d)) return false; s.voltage += d; }
+    if (tag & SAMPLE_TAG_CURRENT) { if (!getSigned(p, end, d)) return false; s.current += d; }
+    if (tag & SAMPLE_TAG_TEMP) { if (!getSigned(p, end, d)) return false; s.temp += d; }
+    _handler(s, _ctx);
+    _samples++;
+  }
+  return p == end;
+}
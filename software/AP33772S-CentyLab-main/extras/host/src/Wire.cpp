@@ -0,0 +1,215 @@
+/*
+Wire.cpp - Host-side TwoWire stand-in.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#include "Wire.h"
+
+TwoWire Wire;
+TwoWire Wire1;
+
+TwoWire::TwoWire()
+{
+  for (int i = 0; i < WIRE_MAX_DEVICES; i++)
+  {
+    _addresses[i] = 0;
+    _devices[i] = nullptr;
+  }
+  resetStats();
+}
+
+void TwoWire::attach(uint8_t address, HostI2CDevice *device)
+{
+  for (int i = 0; i < WIRE_MAX_DEVICES; i++)
+  {
+    if (_devices[i] == nullptr || _addresses[i] == address)
+    {
+      _addresses[i] = address;
+      _devices[i] = device;
+      return;
+    }
+  }
+}
+
+void TwoWire::detach(uint8_t address)
+{
+  for (int i = 0; i < WIRE_MAX_DEVICES; i++)
+  {
+    if (_devices[i] != nullptr && _addresses[i] == address) _devices[i] = nullptr;
+  }
+}
+
+void TwoWire::setWireTimeout(uint32_t timeout_us, bool reset_with_timeout)
+{
+  (void)reset_with_timeout;
+  _timeoutUs = timeout_us;
+  _timeoutFlag = false;
+}
+
+/**
+ * @param count transactions the fault hits, SHORT only counts reads
+ */
+void TwoWire::injectFault(WIRE_FAULT fault, unsigned count)
+{
+  _fault = fault;
+  _faultCount = fault == WIRE_FAULT_NONE ? 0 : count;
+}
+
+void TwoWire::holdSDA(unsigned pulses)
+{
+  pinMode(PIN_WIRE_SCL, INPUT_PULLUP); // Idle bus, SCL high
+  _stuckPulses = pulses;
+  hostHoldLow(PIN_WIRE_SDA, pulses > 0);
+  hostOnPinChange(onPinChange, this);
+}
+
+void TwoWire::onPinChange(void *ctx, uint8_t pin, uint8_t level)
+{
+  TwoWire *wire = (TwoWire *)ctx;
+  if (pin != PIN_WIRE_SCL || level != HIGH || wire->_stuckPulses == 0) return;
+  if (--wire->_stuckPulses == 0) hostHoldLow(PIN_WIRE_SDA, false);
+}
+
+bool TwoWire::takeFault(WIRE_FAULT fault)
+{
+  if (_faultCount == 0 || _fault != fault) return false;
+  if (--_faultCount == 0) _fault = WIRE_FAULT_NONE;
+  return true;
+}
+
+/**
+ * Charge a driver timeout. Without one the real driver would spin forever,
+ * the stand-in reports a bus error instead.
+ * @return endTransmission() code
+ */
+uint8_t TwoWire::timeout()
+{
+  _stats.timeouts++;
+  if (_timeoutUs == 0) return 4;
+  hostAdvanceNanos((uint64_t)_timeoutUs * 1000ULL);
+  _timeoutFlag = true;
+  return 5;
+}
+
+void TwoWire::resetStats()
+{
+  memset(&_stats, 0, sizeof(_stats));
+}
+
+HostI2CDevice *TwoWire::find(uint8_t address)
+{
+  for (int i = 0; i < WIRE_MAX_DEVICES; i++)
+  {
+    if (_devices[i] != nullptr && _addresses[i] == address) return _devices[i];
+  }
+  return nullptr;
+}
+
+/*
+ * Advance the virtual clock by the time the given number of bit slots take at
+ * the configured SCL frequency.
+ */
+void TwoWire::chargeBits(unsigned long bits)
+{
+  unsigned long ns = (unsigned long)((uint64_t)bits * 1000000000ULL / _clockHz);
+  _stats.busNanos += ns;
+  if (_busTiming) hostAdvanceNanos(ns);
+}
+
+void TwoWire::beginTransmission(uint8_t address)
+{
+  _txAddress = address;
+  _txLen = 0;
+  _txActive = true;
+}
+
+size_t TwoWire::write(uint8_t data)
+{
+  if (!_txActive || _txLen >= WIRE_BUFFER_LENGTH) return 0;
+  _txBuf[_txLen++] = data;
+  return 1;
+}
+
+size_t TwoWire::write(const uint8_t *data, size_t len)
+{
+  size_t n = 0;
+  while (n < len && write(data[n])) n++;
+  return n;
+}
+
+/**
+ * @return 0 success, 2 NACK on address, 3 NACK on data, 4 bus error, 5 timeout (Arduino convention)
+ */
+uint8_t TwoWire::endTransmission(bool sendStop)
+{
+  (void)sendStop;
+  _txActive = false;
+  _stats.writeTransactions++;
+
+  if (_stuckPulses > 0 || takeFault(WIRE_FAULT_TIMEOUT)) return timeout();
+  HostI2CDevice *dev = find(_txAddress);
+  if (dev == nullptr || takeFault(WIRE_FAULT_NACK))
+  {
+    chargeBits(2 + 9);  // START, address, NACK, STOP
+    _stats.nacks++;
+    return 2;
+  }
+
+  chargeBits(2 + 9 * (1 + _txLen));
+  _stats.bytesWritten += _txLen;
+  if (!dev->onWrite(_txBuf, _txLen))
+  {
+    _stats.nacks++;
+    return 3;
+  }
+  return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t len, bool sendStop)
+{
+  (void)sendStop;
+  _rxLen = 0;
+  _rxPos = 0;
+  _stats.readTransactions++;
+  if (len > WIRE_BUFFER_LENGTH) len = WIRE_BUFFER_LENGTH;
+
+  if (_stuckPulses > 0 || takeFault(WIRE_FAULT_TIMEOUT))
+  {
+    timeout();
+    return 0;
+  }
+  HostI2CDevice *dev = find(address);
+  if (dev == nullptr || takeFault(WIRE_FAULT_NACK))
+  {
+    chargeBits(2 + 9);
+    _stats.nacks++;
+    return 0;
+  }
+
+  _rxLen = dev->onRead(_rxBuf, len);
+  if (_rxLen > 0 && takeFault(WIRE_FAULT_SHORT)) _rxLen--;
+  chargeBits(2 + 9 * (1 + _rxLen));
+  _stats.bytesRead += _rxLen;
+  if (_rxLen == 0) _stats.nacks++;
+  return (uint8_t)_rxLen;
+}
+
+int TwoWire::available()
+{
+  return (int)(_rxLen - _rxPos);
+}
+
+int TwoWire::read()
+{
+  if (_rxPos >= _rxLen) return -1;
+  return _rxBuf[_rxPos++];
+}
+
+int TwoWire::peek()
+{
+  if (_rxPos >= _rxLen) return -1;
+  return _rxBuf[_rxPos];
+}
@@ -0,0 +1,239 @@
+/*
+bench.cpp - Microbenchmarks of the public AP33772S API against the simulated
+bus. For every operation: I2C calls as counted by the per-register
+instrumentation, wire transactions and bytes, modeled bus time and host CPU
+time per call. Transactions and bytes are deterministic and are checked
+against bench.baseline, so a hot path that starts costing more bus traffic
+fails the run. Host time is reported only, it depends on the machine.
+
+  build/bench            compare against bench.baseline
+  build/bench --update   rewrite bench.baseline from this run
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+#include "AP33772S.h"
+#include "AP33772SSim.h"
+
+#if !AP33772S_BUS_STATS
+#error "bench needs the host build's -DAP33772S_BUS_STATS=1"
+#endif
+
+#define BASELINE_FILE "bench.baseline"
+#define BENCH_RUNS    2000 // Calls per operation for the host time
+
+/*
+ * Bus cost model. Wire charges 9 bit slots per byte plus START and STOP at
+ * the configured clock. The chip stretches SCL on every transaction and the
+ * MCU's Wire driver leaves a gap between transactions; both are per
+ * transaction constants. They are assumed defaults, not measured on a board:
+ * absolute bus times move with them, transaction and byte counts do not.
+ */
+#define MODEL_CLOCK_HZ  400000
+#define MODEL_STRETCH_US 10     // AP33772S clock stretching, charged by the simulator
+#define MODEL_DRIVER_US  25     // Wire driver gap, added to the wire time
+
+static const SIM_PDO_T SOURCE_PDOS[] = {
+  {SIM_PDO_FIXED, 0, 5000, 3000, false},
+  {SIM_PDO_FIXED, 0, 9000, 3000, false},
+  {SIM_PDO_FIXED, 0, 15000, 3000, false},
+  {SIM_PDO_FIXED, 0, 20000, 5000, false},
+  {SIM_PDO_PPS, 3300, 21000, 5000, false},
+  {SIM_PDO_FIXED, 0, 28000, 5000, true},
+  {SIM_PDO_AVS, 15000, 28000, 5000, true},
+};
+
+static const PROTECTION_PROFILE_T PROFILE = {5000, 80, 2000, 4000, 120, 100};
+static const NTC_T NTC = {10000, 4161, 1928, 974};
+
+static AP33772SSim sim;
+static AP33772S usbpd;
+static PROTECTION_PROFILE_T profile;
+static SAMPLE_RAW_T sample;
+static NTC_T ntc;
+
+typedef struct
+{
+  const char *name;
+  void (*setup)();  // Before each call, not measured
+  void (*op)();
+} BENCH_OP_T;
+
+static void none() {}
+static void keepaliveDue() { delay(KEEPALIVE_PERIOD); }
+static void statusPending() { sim.raiseStatus(NEWPDO_MSK); usbpd.handleInterrupt(); }
+
+static const BENCH_OP_T OPS[] = {
+  {"begin() warm", none, [] { usbpd.begin(); }},
+  {"requestPower(12000, 3000)", none, [] { usbpd.requestPower(12000, 3000); }},
+  {"setFixPDO(4, 5000)", none, [] { usbpd.setFixPDO(4, 5000); }},
+  {"setPPSPDO(5, 12000, 3000)", none, [] { usbpd.setPPSPDO(5, 12000, 3000); }},
+  {"poll() idle", none, [] { usbpd.poll(); }},
+  {"poll() keepalive", keepaliveDue, [] { usbpd.poll(); }},
+  {"poll() interrupt", statusPending, [] { usbpd.poll(); }},
+  {"readVoltage()", none, [] { usbpd.readVoltage(); }},
+  {"readCurrent()", none, [] { usbpd.readCurrent(); }},
+  {"readTemp()", none, [] { usbpd.readTemp(); }},
+  {"readSample()", none, [] { usbpd.readSample(sample); }},
+  {"readTelemetry()", none, [] { usbpd.readTelemetry(); }},
+  {"readStatus()", none, [] { usbpd.readStatus(); }},
+  {"readMsgResult()", none, [] { usbpd.readMsgResult(); }},
+  {"setOutput(1)", none, [] { usbpd.setOutput(1); }},
+  {"readOVPTHR()", none, [] { usbpd.readOVPTHR(); }},
+  {"setOVPTHR(2000)", none, [] { usbpd.setOVPTHR(2000); }},
+  {"applyProtection()", none, [] { usbpd.applyProtection(PROFILE); }},
+  {"readProtection()", none, [] { usbpd.readProtection(profile); }},
+  {"setNTC(NTC_T)", none, [] { usbpd.setNTC(NTC); }},
+  {"readNTC()", none, [] { usbpd.readNTC(ntc); }},
+};
+#define OP_COUNT (sizeof(OPS) / sizeof(OPS[0]))
+
+typedef struct
+{
+  unsigned long calls;        // i2c_read() + i2c_write(), from busStats()
+  unsigned long transactions; // On the wire, a read is two
+  unsigned long bytes;        // On the wire, command bytes included
+  double busUs;               // Cost model
+  double hostNs;              // Per call
+} RESULT_T;
+
+typedef struct
+{
+  char name[40];
+  unsigned long transactions;
+  unsigned long bytes;
+} BASELINE_T;
+
+static BASELINE_T baseline[OP_COUNT];
+static int baselineCount = 0;
+
+static RESULT_T measure(const BENCH_OP_T &op)
+{
+  RESULT_T r = {0};
+
+  op.setup();
+  usbpd.busStats().reset();
+  WIRE_STATS_T before = Wire.stats();
+  op.op();
+  const WIRE_STATS_T &after = Wire.stats();
+  BUS_REG_STATS_T t = usbpd.busStats().total();
+
+  r.calls = t.reads + t.writes;
+  r.transactions = after.writeTransactions + after.readTransactions - before.writeTransactions -
+                   before.readTransactions;
+  r.bytes = after.bytesWritten + after.bytesRead - before.bytesWritten - before.bytesRead;
+  r.busUs = (after.busNanos - before.busNanos) / 1000.0 + r.transactions * (MODEL_STRETCH_US + MODEL_DRIVER_US);
+
+  double ns = 0;
+  for (int i = 0; i < BENCH_RUNS; i++)
+  {
+    op.setup();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    op.op();
+    ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  }
+  r.hostNs = ns / BENCH_RUNS;
+  return r;
+}
+
+static void loadBaseline()
+{
+  FILE *f = fopen(BASELINE_FILE, "r");
+  if (f == NULL) return;
+  char line[128];
+  while (baselineCount < (int)OP_COUNT && fgets(line, sizeof(line), f))
+  {
+    BASELINE_T &b = baseline[baselineCount];
+    char *sep = strchr(line, '|');
+    if (line[0] == '#' || sep == NULL) continue;
+    *sep = 0;
+    snprintf(b.name, sizeof(b.name), "%.39s", line);
+    if (sscanf(sep + 1, "%lu %lu", &b.transactions, &b.bytes) == 2) baselineCount++;
+  }
+  fclose(f);
+}
+
+static const BASELINE_T *findBaseline(const char *name)
+{
+  for (int i = 0; i < baselineCount; i++)
+    if (strcmp(baseline[i].name, name) == 0) return &baseline[i];
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  bool update = argc > 1 && strcmp(argv[1], "--update") == 0;
+
+  SIM_TIMING_T timing = sim.timing();
+  timing.accessUs = MODEL_STRETCH_US;
+  sim.setTiming(timing);
+  sim.setSourcePDOs(SOURCE_PDOS, sizeof(SOURCE_PDOS) / sizeof(SOURCE_PDOS[0]));
+  Wire.attach(AP33772S_ADDRESS, &sim);
+  Wire.begin();
+  Wire.setClock(MODEL_CLOCK_HZ);
+  Serial.setEcho(false);
+  sim.powerOn();
+  usbpd.begin();
+  usbpd.requestPower(12000, 3000); // PPS contract, keepalive active
+  delay(100);
+
+  loadBaseline();
+  RESULT_T results[OP_COUNT];
+  bool ok = true;
+
+  printf("%lu Hz, %d us stretch and %d us driver gap per transaction, host time over %d calls\n\n",
+         (unsigned long)Wire.getClock(), MODEL_STRETCH_US, MODEL_DRIVER_US, BENCH_RUNS);
+  printf("%-28s %5s %5s %6s %9s %9s  %s\n", "operation", "calls", "txn", "bytes", "bus_us", "host_ns", "baseline");
+  for (unsigned int i = 0; i < OP_COUNT; i++)
+  {
+    RESULT_T &r = results[i];
+    r = measure(OPS[i]);
+    const BASELINE_T *b = findBaseline(OPS[i].name);
+    const char *verdict = "new";
+    if (b != NULL)
+    {
+      bool worse = r.transactions > b->transactions || r.bytes > b->bytes;
+      bool better = r.transactions < b->transactions || r.bytes < b->bytes;
+      verdict = worse ? "REGRESSED" : better ? "improved" : "ok";
+      if (worse && !update) ok = false;
+    }
+    printf("%-28s %5lu %5lu %6lu %9.1f %9.0f  %s", OPS[i].name, r.calls, r.transactions, r.bytes, r.busUs,
+           r.hostNs, verdict);
+    if (b != NULL && strcmp(verdict, "ok") != 0) printf(" (%lu txn, %lu bytes)", b->transactions, b->bytes);
+    printf("\n");
+  }
+
+  // Where the bus time of a typical loop goes: poll() and readSample() every 10ms for 2s
+  usbpd.busStats().reset();
+  for (int i = 0; i < 200; i++)
+  {
+    usbpd.poll();
+    usbpd.readSample(sample);
+    delay(10);
+  }
+  printf("\nPer register, 2s of poll() + readSample() every 10ms\n");
+  Serial.setEcho(true);
+  usbpd.busStats().print(Serial);
+  Serial.setEcho(false);
+  BUS_REG_STATS_T t = usbpd.busStats().total();
+  ok = ok && t.errors == 0 && t.reads >= 200;
+
+  if (update)
+  {
+    FILE *f = fopen(BASELINE_FILE, "w");
+    if (f == NULL) return 1;
+    fprintf(f, "# operation|transactions bytes, written by build/bench --update\n");
+    for (unsigned int i = 0; i < OP_COUNT; i++)
+      fprintf(f, "%s|%lu %lu\n", OPS[i].name, results[i].transactions, results[i].bytes);
+    fclose(f);
+    printf("\n%s updated\n", BASELINE_FILE);
+  }
+  else printf("\n%s\n", ok ? "ok" : "FAILED: bus traffic above " BASELINE_FILE);
+  return ok ? 0 : 1;
+}
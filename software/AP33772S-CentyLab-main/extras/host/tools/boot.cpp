@@ -0,0 +1,132 @@
+/*
+boot.cpp - Time to first power with the STATUS polling begin() against the
+fixed sleeps it replaces, for chips that announce their source early or late,
+a chip already running when the MCU resets, and no source at all.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#include <stdio.h>
+
+#include "AP33772S.h"
+#include "AP33772SSim.h"
+
+static const SIM_PDO_T SOURCE_PDOS[] = {
+  {SIM_PDO_FIXED, 0, 5000, 3000, false},
+  {SIM_PDO_FIXED, 0, 9000, 3000, false},
+  {SIM_PDO_FIXED, 0, 15000, 3000, false},
+  {SIM_PDO_FIXED, 0, 20000, 5000, false},
+};
+
+static AP33772SSim sim;
+static AP33772S usbpd;
+
+typedef struct
+{
+  unsigned long powerMs;  // Start of boot to the 20V request reported successful, 0 if never
+  int pdos;
+} RESULT_T;
+
+static RESULT_T firstPower(unsigned long start)
+{
+  RESULT_T r = {0, usbpd.bootStats().pdos};
+  if (usbpd.requestPower(20000, 3000) < 0) return r;
+  for (int i = 0; i < 500; i++)
+  {
+    if (usbpd.readMsgResult() == MSGRLT_SUCCESS)
+    {
+      r.powerMs = (micros() - start) / 1000;
+      break;
+    }
+    delay(1);
+  }
+  return r;
+}
+
+// What the examples did: delay(1000) in setup(), then delay(100) and a blind SRCPDO read
+static RESULT_T fixedSleep(unsigned long sleepMs)
+{
+  unsigned long start = micros();
+  delay(sleepMs);
+  usbpd.begin(0); // One STATUS read, then SRCPDO whatever it holds
+  return firstPower(start);
+}
+
+static RESULT_T polled()
+{
+  unsigned long start = micros();
+  usbpd.begin();
+  return firstPower(start);
+}
+
+static void powerOn(unsigned long capsMs, int pdoCount)
+{
+  SIM_TIMING_T timing = sim.timing();
+  timing.capsMs = capsMs;
+  sim.setTiming(timing);
+  sim.setSourcePDOs(SOURCE_PDOS, pdoCount);
+  hostResetClock();
+  sim.powerOn();
+}
+
+static void row(const char *name, const RESULT_T &sleep1100, const RESULT_T &sleep100, const RESULT_T &poll)
+{
+  const BOOT_STATS_T &b = usbpd.bootStats();
+  printf("%-26s %10lu %4d %10lu %4d %7.1f %7.1f %10lu %4d %6u %5s\n", name, sleep1100.powerMs, sleep1100.pdos,
+         sleep100.powerMs, sleep100.pdos, b.ackUs / 1000.0, b.pdoUs / 1000.0, poll.powerMs, poll.pdos,
+         b.polls, b.timedOut ? "yes" : "no");
+}
+
+int main()
+{
+  Wire.attach(AP33772S_ADDRESS, &sim);
+  Wire.begin();
+  Serial.setEcho(false);
+  bool ok = true;
+  const int count = sizeof(SOURCE_PDOS) / sizeof(SOURCE_PDOS[0]);
+
+  printf("Time to first power: boot start to a 20V request reported successful, in ms\n\n");
+  printf("%-26s %15s %15s %40s\n", "", "delay(1000+100)", "delay(100)", "STATUS polling begin()");
+  printf("%-26s %10s %4s %10s %4s %7s %7s %10s %4s %6s %5s\n", "case", "power_ms", "pdos", "power_ms", "pdos",
+         "ack_ms", "pdo_ms", "power_ms", "pdos", "polls", "t/o");
+
+  static const unsigned long CAPS_MS[] = {80, 150, 300};
+  for (unsigned long caps : CAPS_MS)
+  {
+    char name[32];
+    snprintf(name, sizeof(name), "cold, caps after %lums", caps);
+    powerOn(caps, count);
+    RESULT_T a = fixedSleep(1100);
+    powerOn(caps, count);
+    RESULT_T b = fixedSleep(100);
+    powerOn(caps, count);
+    RESULT_T c = polled();
+    row(name, a, b, c);
+    ok = ok && c.pdos == count && c.powerMs > 0 && c.powerMs < a.powerMs;
+    ok = ok && usbpd.bootStats().pdoUs < (caps + BOOT_POLL + 5) * 1000;
+  }
+
+  // MCU reset with the chip left running, STATUS was read clean long ago
+  powerOn(80, count);
+  delay(2000);
+  usbpd.readStatus();
+  RESULT_T a = fixedSleep(1100);
+  RESULT_T b = fixedSleep(100);
+  RESULT_T c = polled();
+  row("warm, MCU reset only", a, b, c);
+  ok = ok && c.pdos == count && usbpd.bootStats().polls == 1;
+
+  // No source yet, the budget bounds the wait
+  powerOn(80, 0);
+  a = fixedSleep(1100);
+  powerOn(80, 0);
+  b = fixedSleep(100);
+  powerOn(80, 0);
+  c = polled();
+  row("no source", a, b, c);
+  ok = ok && c.pdos == 0 && usbpd.bootStats().timedOut;
+
+  return ok ? 0 : 1;
+}
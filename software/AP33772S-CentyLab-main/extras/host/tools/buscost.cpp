@@ -0,0 +1,100 @@
+/*
+buscost.cpp - Report how many I2C transactions and bytes each public
+AP33772S call costs, run against the simulated register file.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#include <stdio.h>
+
+#include "AP33772S.h"
+#include "AP33772SSim.h"
+
+static const SIM_PDO_T SOURCE_PDOS[] = {
+  {SIM_PDO_FIXED, 0, 5000, 3000, false},
+  {SIM_PDO_FIXED, 0, 9000, 3000, false},
+  {SIM_PDO_FIXED, 0, 15000, 3000, false},
+  {SIM_PDO_FIXED, 0, 20000, 5000, false},
+  {SIM_PDO_PPS, 3300, 21000, 5000, false},
+  {SIM_PDO_FIXED, 0, 28000, 5000, true},
+  {SIM_PDO_AVS, 15000, 28000, 5000, true},
+};
+
+static const PROTECTION_PROFILE_T PROFILE = {5000, 80, 2000, 4000, 120, 100};
+static PROTECTION_PROFILE_T profile;
+
+static AP33772SSim sim;
+static AP33772S usbpd;
+
+static WIRE_STATS_T before;
+static unsigned long startUs;
+
+static void beginMeasure()
+{
+  before = Wire.stats();
+  startUs = micros();
+}
+
+static void endMeasure(const char *name)
+{
+  const WIRE_STATS_T &after = Wire.stats();
+  printf("%-28s %6lu %6lu %8lu %8lu %10.1f %12lu\n", name,
+         after.writeTransactions - before.writeTransactions,
+         after.readTransactions - before.readTransactions,
+         after.bytesWritten - before.bytesWritten,
+         after.bytesRead - before.bytesRead,
+         (after.busNanos - before.busNanos) / 1000.0,
+         micros() - startUs);
+}
+
+#define MEASURE(name, call) do { beginMeasure(); call; endMeasure(name); } while (0)
+
+int main()
+{
+  sim.setSourcePDOs(SOURCE_PDOS, sizeof(SOURCE_PDOS) / sizeof(SOURCE_PDOS[0]));
+  Wire.attach(AP33772S_ADDRESS, &sim);
+  Wire.begin();
+  sim.powerOn();
+  Serial.setEcho(false);
+
+  printf("I2C cost per call at %lu Hz\n\n", (unsigned long)Wire.getClock());
+  printf("%-28s %6s %6s %8s %8s %10s %12s\n", "call", "wr", "rd", "bytes_wr", "bytes_rd", "bus_us", "elapsed_us");
+
+  MEASURE("begin()", usbpd.begin());
+  MEASURE("setOutput(1)", usbpd.setOutput(1));
+  MEASURE("setFixPDO(2, 3000)", usbpd.setFixPDO(2, 3000));
+  MEASURE("setPPSPDO(5, 12000, 3000)", usbpd.setPPSPDO(usbpd.getPPSIndex(), 12000, 3000));
+  MEASURE("setAVSPDO(9, 20000, 3000)", usbpd.setAVSPDO(usbpd.getAVSIndex(), 20000, 3000));
+  MEASURE("requestPower(12000, 3000)", usbpd.requestPower(12000, 3000));
+  delay(KEEPALIVE_PERIOD);
+  MEASURE("poll() keepalive resend", usbpd.poll());
+  MEASURE("readVoltage()", usbpd.readVoltage());
+  MEASURE("readCurrent()", usbpd.readCurrent());
+  MEASURE("readTemp()", usbpd.readTemp());
+  MEASURE("readVREQ()", usbpd.readVREQ());
+  MEASURE("readIREQ()", usbpd.readIREQ());
+  MEASURE("5x read VOLTAGE..IREQ", (usbpd.readVoltage(), usbpd.readCurrent(), usbpd.readTemp(),
+                                    usbpd.readVREQ(), usbpd.readIREQ()));
+  MEASURE("readTelemetry()", usbpd.readTelemetry());
+  MEASURE("readOVPTHR()", usbpd.readOVPTHR());
+  MEASURE("setOVPTHR(2000)", usbpd.setOVPTHR(2000));
+  MEASURE("6x set VSELMIN..DRTHR", (usbpd.setVSELMIN(5000), usbpd.setUVPTHR(80), usbpd.setOVPTHR(2000),
+                                    usbpd.setOCPTHR(4000), usbpd.setOTPTHR(120), usbpd.setDRTHR(100)));
+  MEASURE("applyProtection()", usbpd.applyProtection(PROFILE));
+  MEASURE("readProtection()", usbpd.readProtection(profile));
+  MEASURE("setNTC(10000,4161,1928,974)", usbpd.setNTC(10000, 4161, 1928, 974));
+  MEASURE("setNTCAsync(...)", usbpd.setNTCAsync(10000, 4161, 1928, 974));
+  MEASURE("poll() until OP_DONE", while (usbpd.opStatus() == OP_BUSY) { usbpd.poll(); delay(1); });
+
+  usbpd.setConfigCache(true);
+  MEASURE("readOVPTHR() cache fill", usbpd.readOVPTHR());
+  MEASURE("readOVPTHR() cached", usbpd.readOVPTHR());
+  MEASURE("6x read config cached", (usbpd.readVSELMIN(), usbpd.readUVPTHR(), usbpd.readOVPTHR(),
+                                    usbpd.readOCPTHR(), usbpd.readOTPTHR(), usbpd.readDRTHR()));
+  MEASURE("setOVPTHR(2000) cached", usbpd.setOVPTHR(2000));
+  MEASURE("readStatus()", usbpd.readStatus());
+
+  return 0;
+}
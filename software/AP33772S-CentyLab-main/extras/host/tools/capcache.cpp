@@ -0,0 +1,149 @@
+/*
+capcache.cpp - Boot against two simulated chargers with the capability cache
+persisted in a file: misses on first sight, hits after a save, survives a new
+storage object, keeps both chargers, never rewrites an unchanged slot, and
+evicts the least recently saved charger even after the save counter wraps.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#include <stdio.h>
+
+#include "AP33772S.h"
+#include "AP33772S_CapCache.h"
+#include "AP33772SSim.h"
+#include "FileStorage.h"
+
+#define CACHE_FILE "build/capcache.bin"
+#define WRAP_SAVES (0x10000L - 4) // Takes the fourth charger's save counter from 4 to 0x10000
+
+static const SIM_PDO_T CHARGER_A[] = {
+  {SIM_PDO_FIXED, 0, 5000, 3000, false},
+  {SIM_PDO_FIXED, 0, 9000, 3000, false},
+  {SIM_PDO_FIXED, 0, 15000, 3000, false},
+  {SIM_PDO_FIXED, 0, 20000, 5000, false},
+  {SIM_PDO_PPS, 3300, 21000, 5000, false},
+};
+
+static const SIM_PDO_T CHARGER_B[] = {
+  {SIM_PDO_FIXED, 0, 5000, 3000, false},
+  {SIM_PDO_FIXED, 0, 9000, 3000, false},
+  {SIM_PDO_FIXED, 0, 15000, 3000, false},
+  {SIM_PDO_FIXED, 0, 20000, 5000, false},
+  {SIM_PDO_FIXED, 0, 28000, 5000, true},
+  {SIM_PDO_AVS, 15000, 28000, 5000, true},
+};
+
+static AP33772SSim sim;
+static AP33772S usbpd;
+
+// Time from the start of boot until VOLTAGE reaches the setpoint
+static unsigned long waitPower(unsigned long start, int mV)
+{
+  for (int i = 0; i < 1000 && usbpd.readVoltage() < mV - 80; i++) delay(1); // 1 LSB
+  return micros() - start;
+}
+
+// One power cycle. On a miss the application picks its setpoint and saves it.
+static bool boot(const SIM_PDO_T *pdos, int count, int mV, int mA, const char *name)
+{
+  hostResetClock();
+  sim.setSourcePDOs(pdos, count);
+  sim.powerOn();
+
+  FileStorage storage(CACHE_FILE); // Fresh object each boot, state only from the file
+  AP33772SCapCache cache(usbpd, storage);
+  unsigned long start = micros();
+  bool hit = cache.boot();
+  if (!hit) usbpd.requestPower(mV, mA);
+  unsigned long powerUs = waitPower(start, mV);
+  if (!hit) cache.save();
+
+  const CAPCACHE_STATS_T &st = cache.stats();
+  printf("%-24s %08lx %5s %9lu %9lu %9lu %9lu %7lu %8lu\n", name, (unsigned long)st.fingerprint,
+         hit ? "hit" : "miss", st.beginUs, st.lookupUs, st.bootUs, powerUs, (unsigned long)sim.vbus(), storage.bytesChanged());
+  return hit;
+}
+
+int main()
+{
+  Wire.attach(AP33772S_ADDRESS, &sim);
+  Wire.begin();
+  Serial.setEcho(false);
+  remove(CACHE_FILE);
+  bool ok = true;
+
+  const int countA = sizeof(CHARGER_A) / sizeof(CHARGER_A[0]);
+  const int countB = sizeof(CHARGER_B) / sizeof(CHARGER_B[0]);
+
+  printf("%-24s %8s %5s %9s %9s %9s %9s %7s %8s\n", "boot", "pdo_hash", "cache", "begin_us", "lookup_us",
+         "boot_us", "power_us", "vbus", "written");
+  ok = ok && !boot(CHARGER_A, countA, 12000, 3000, "charger A, first");
+  ok = ok && boot(CHARGER_A, countA, 12000, 3000, "charger A, again");
+  ok = ok && usbpd.readVREQ() == 12000;
+  ok = ok && !boot(CHARGER_B, countB, 24000, 5000, "charger B, first");
+  ok = ok && boot(CHARGER_B, countB, 24000, 5000, "charger B, again");
+  ok = ok && usbpd.readVREQ() == 24000;
+  ok = ok && boot(CHARGER_A, countA, 12000, 3000, "charger A, third");
+  ok = ok && usbpd.readVREQ() == 12000;
+
+  // A changed setpoint on a known charger overwrites that charger's slot
+  {
+    FileStorage storage(CACHE_FILE);
+    AP33772SCapCache cache(usbpd, storage);
+    usbpd.requestPower(15000, 3000);
+    delay(300); // Saved once the source accepted it
+    cache.save();
+    cache.save(); // Unchanged, no write
+    ok = ok && cache.stats().saves == 1;
+  }
+  ok = ok && boot(CHARGER_A, countA, 15000, 3000, "charger A, new setpoint");
+  ok = ok && usbpd.readVREQ() == 15000;
+
+  // Full cache, one charger's setpoint changed past the 16-bit save counter, then a new
+  // charger: the least recently saved one goes, not the one whose counter wrapped
+  remove(CACHE_FILE);
+  ok = ok && !boot(CHARGER_A, countA, 12000, 3000, "charger A, oldest");
+  ok = ok && !boot(CHARGER_B, countB, 24000, 5000, "charger B");
+  ok = ok && !boot(CHARGER_A, countA - 1, 20000, 3000, "charger A, no PPS");
+  ok = ok && !boot(CHARGER_A, countA - 2, 9000, 3000, "charger A, 15V max");
+  {
+    FileStorage storage(CACHE_FILE);
+    AP33772SCapCache cache(usbpd, storage);
+    for (long i = 0; i < WRAP_SAVES; i++)
+    {
+      usbpd.requestPower(i % 2 ? 9000 : 5000, 3000);
+      delay(sim.timing().negotiationMs);
+      cache.save();
+    }
+    ok = ok && cache.stats().saves == WRAP_SAVES;
+  }
+  ok = ok && !boot(CHARGER_A, countA - 3, 9000, 3000, "charger A, 9V max");
+  ok = ok && boot(CHARGER_A, countA - 2, 9000, 3000, "charger A, 15V max");
+  ok = ok && !boot(CHARGER_A, countA, 12000, 3000, "charger A, evicted");
+
+  // A request the source rejects is not remembered, the contract it kept is
+  remove(CACHE_FILE);
+  hostResetClock();
+  sim.setSourcePDOs(CHARGER_A, countA);
+  sim.powerOn();
+  {
+    FileStorage storage(CACHE_FILE);
+    AP33772SCapCache cache(usbpd, storage);
+    cache.boot();
+    usbpd.requestPower(9000, 3000);
+    delay(300);
+    cache.save();
+    sim.setSourcePDOs(CHARGER_A, 2); // 20V withdrawn without a new capability message
+    usbpd.requestPower(20000, 3000);
+    delay(300);
+    ok = ok && cache.save() && cache.stats().saves == 1 && usbpd.getLastRDO() != usbpd.getAcceptedRDO();
+  }
+  ok = ok && boot(CHARGER_A, countA, 9000, 3000, "charger A, 20V rejected");
+  ok = ok && usbpd.readVREQ() == 9000;
+
+  printf("\n%d slots of %d bytes, %s\n", CAPCACHE_SLOTS, CAPCACHE_RECORD, ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
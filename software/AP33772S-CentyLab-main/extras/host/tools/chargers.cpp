@@ -0,0 +1,364 @@
+/*
+chargers.cpp - Replay every charger profile in profiles/ and benchmark the
+library against each: boot to a decoded PDO table, request to accept,
+PDO selection, an AP33772SRamp sweep over the first PPS (or AVS) PDO, and
+a programmable contract held with and without the keepalive.
+
+Everything runs on the virtual clock, so the times are deterministic and are
+checked against chargers.baseline: a run fails when one grows. The shipped
+profiles are modeled, so the baseline guards the library's behaviour against
+them, not how closely they match the chargers they are named after.
+
+  build/chargers            compare against chargers.baseline
+  build/chargers --update   rewrite chargers.baseline from this run
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#include <chrono>
+#include <glob.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "AP33772S.h"
+#include "AP33772S_Ramp.h"
+#include "AP33772SSim.h"
+#include "ChargerProfile.h"
+
+#define PROFILE_GLOB  "profiles/*.profile"
+#define BASELINE_FILE "chargers.baseline"
+#define MAX_PROFILES  16
+#define SELECT_RUNS   2000 // selectPDO() calls per target for the host time
+
+typedef struct
+{
+  int target_mV;
+  int max_mA;
+} TARGET_T;
+
+// Requests timed from PD_REQMSG to PD_MSGRLT, fixed and programmable mixed
+static const TARGET_T ACCEPT_TARGETS[] = {
+  {9000, 3000}, {20000, 3000}, {12000, 3000}, {5000, 3000}, {15000, 3000}, {11000, 2000},
+  {20000, 5000}, {9000, 2000}, {16500, 3000}, {5000, 2000}, {28000, 5000}, {20000, 3000},
+};
+
+// Selection cases, some with no fixed match, some nothing covers
+static const TARGET_T SELECT_TARGETS[] = {
+  {5000, 3000}, {9000, 3000}, {12000, 3000}, {15000, 3000}, {20000, 5000}, {28000, 5000},
+  {3300, 2000}, {7400, 3000}, {11000, 4000}, {16500, 3000}, {21000, 3000}, {24000, 5000},
+  {30000, 3000}, {20000, 6000},
+};
+
+#define COUNT(a) (sizeof(a) / sizeof(a[0]))
+
+static AP33772SSim sim;
+
+typedef struct
+{
+  char name[PROFILE_NAME_MAX];
+  int pdos;
+  unsigned long bootMs;      // begin() to SRCPDO decoded
+  unsigned long acceptAvgMs;
+  unsigned long acceptMaxMs;
+  int requests;              // Sent, targets no PDO covers are skipped
+  int accepted;
+  int selected;              // Targets some PDO covers
+  int selectValid;           // Of those, answered with a covering PDO, fixed where one matches
+  double selectNs;
+  char rampKind[4];
+  unsigned long rampMs;
+  unsigned int rampSteps;
+  bool rampDone;
+  unsigned long keepaliveReqs; // Requests the keepalive sent to hold the contract
+  unsigned long heldMs;
+  unsigned long drops;         // Dropouts with the keepalive running, must be 0
+  unsigned long lapseMs;       // Last request to the source dropping the contract, keepalive off
+  unsigned long recoverMs;     // Dropout to VBUS back at 5V
+} RESULT_T;
+
+typedef struct
+{
+  char name[PROFILE_NAME_MAX];
+  unsigned long bootMs, acceptMaxMs, rampMs, keepaliveReqs;
+} BASELINE_T;
+
+static BASELINE_T baseline[MAX_PROFILES];
+static int baselineCount = 0;
+
+static bool covers(const PDO_CAP_T &cap, const TARGET_T &t)
+{
+  return t.target_mV >= cap.min_mV && t.target_mV <= cap.max_mV && t.max_mA <= cap.max_mA;
+}
+
+// Request and wait for PD_MSGRLT, polling every ms as a sketch would. -2 if no PDO fits
+static long timeRequest(AP33772S &usbpd, const TARGET_T &t)
+{
+  unsigned long start = micros();
+  if (usbpd.requestPower(t.target_mV, t.max_mA) < 0) return -2;
+  for (int i = 0; i < 1000; i++)
+  {
+    byte result = usbpd.readMsgResult();
+    if (result == MSGRLT_SUCCESS) return (micros() - start) / 1000;
+    if (result != MSGRLT_BUSY) return -1;
+    delay(1);
+  }
+  return -1;
+}
+
+static void settle(AP33772S &usbpd, unsigned long ms)
+{
+  for (unsigned long t = 0; t < ms; t += 10)
+  {
+    usbpd.poll();
+    delay(10);
+  }
+}
+
+static void benchAccept(AP33772S &usbpd, RESULT_T &r)
+{
+  unsigned long sum = 0;
+  for (const TARGET_T &t : ACCEPT_TARGETS)
+  {
+    long ms = timeRequest(usbpd, t);
+    settle(usbpd, 200);
+    if (ms == -2) continue;
+    r.requests++;
+    if (ms < 0) continue;
+    r.accepted++;
+    sum += ms;
+    if ((unsigned long)ms > r.acceptMaxMs) r.acceptMaxMs = ms;
+  }
+  r.acceptAvgMs = r.accepted ? sum / r.accepted : 0;
+}
+
+static void benchSelect(AP33772S &usbpd, RESULT_T &r)
+{
+  for (const TARGET_T &t : SELECT_TARGETS)
+  {
+    bool anyCovers = false, fixedCovers = false;
+    for (int i = 1; i <= MAX_PDO_ENTRIES; i++)
+    {
+      const PDO_CAP_T *cap = usbpd.getPDOCap(i);
+      if (cap == NULL || !covers(*cap, t)) continue;
+      anyCovers = true;
+      if (cap->kind == PDO_FIXED) fixedCovers = true;
+    }
+
+    unsigned long txn = Wire.stats().writeTransactions + Wire.stats().readTransactions;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    int index = 0;
+    for (int i = 0; i < SELECT_RUNS; i++) index = usbpd.selectPDO(t.target_mV, t.max_mA);
+    r.selectNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    bool noBus = Wire.stats().writeTransactions + Wire.stats().readTransactions == txn;
+
+    const PDO_CAP_T *cap = usbpd.getPDOCap(index);
+    if (anyCovers) r.selected++;
+    bool valid = anyCovers ? cap != NULL && covers(*cap, t) && (!fixedCovers || cap->kind == PDO_FIXED)
+                           : index < 0;
+    if (valid && noBus && anyCovers) r.selectValid++;
+    if (!valid || !noBus) r.selectValid = -100; // Shows as a failure whatever the rest does
+  }
+  r.selectNs /= COUNT(SELECT_TARGETS) * SELECT_RUNS;
+}
+
+// First PPS PDO, else the AVS one, over its whole range up to 20V (PPS) or 28V (AVS)
+static void benchRamp(AP33772S &usbpd, RESULT_T &r)
+{
+  int index = usbpd.getPPSIndex() > 0 ? usbpd.getPPSIndex() : usbpd.getAVSIndex();
+  const PDO_CAP_T *cap = usbpd.getPDOCap(index);
+  if (cap == NULL) return;
+  snprintf(r.rampKind, sizeof(r.rampKind), "%s", cap->kind == PDO_PPS ? "PPS" : "AVS");
+  int from = cap->kind == PDO_PPS ? 5000 : cap->min_mV;
+  int limit = cap->kind == PDO_PPS ? 20000 : 28000; // AVS above 28V is out of the AP33772S's reach
+  int to = cap->max_mV > limit ? limit : cap->max_mV;
+
+  timeRequest(usbpd, {from, 3000});
+  settle(usbpd, 1000);
+  AP33772SRamp ramp(usbpd);
+  ramp.start(from, to, 3000, 1000);
+  while (ramp.busy())
+  {
+    usbpd.poll();
+    ramp.poll();
+    delay(1);
+  }
+  r.rampMs = ramp.elapsed();
+  r.rampSteps = ramp.steps();
+  r.rampDone = ramp.state() == RAMP_DONE;
+}
+
+// Hold a programmable contract for three source timeouts, then let it lapse
+static void benchKeepalive(AP33772S &usbpd, RESULT_T &r)
+{
+  int index = usbpd.getPPSIndex() > 0 ? usbpd.getPPSIndex() : usbpd.getAVSIndex();
+  const PDO_CAP_T *cap = usbpd.getPDOCap(index);
+  if (cap == NULL) return;
+  int mV = cap->kind == PDO_PPS ? 11000 : 18000;
+  if (cap->kind == PDO_PPS) usbpd.setPPSPDO(index, mV, 3000);
+  else usbpd.setAVSPDO(index, mV, 3000);
+  settle(usbpd, 500);
+
+  unsigned long timeout = sim.timing().keepaliveMs;
+  r.heldMs = timeout ? 3 * timeout : 30000;
+  unsigned long requests = sim.requestCount();
+  unsigned long drops = sim.dropoutCount();
+  settle(usbpd, r.heldMs);
+  r.keepaliveReqs = sim.requestCount() - requests;
+  r.drops = sim.dropoutCount() - drops;
+  if (timeout == 0) return;
+
+  // Keepalive off: the contract holds until the source gives up on it
+  usbpd.setKeepalive(0);
+  unsigned long lastRequest = sim.lastRequestMs();
+  bool dropped = false;
+  for (unsigned long t = 0; t < 2 * timeout + 5000; t += 10)
+  {
+    int vbus = usbpd.readVoltage();
+    if (!dropped && sim.dropoutCount() > drops + r.drops)
+    {
+      dropped = true;
+      r.lapseMs = sim.lastDropoutMs() - lastRequest;
+    }
+    if (!dropped) lastRequest = sim.lastRequestMs(); // A keepalive may still have been in flight
+    if (dropped && vbus >= 4500 && vbus <= 5500)
+    {
+      r.recoverMs = millis() - sim.lastDropoutMs();
+      break;
+    }
+    delay(10);
+  }
+  usbpd.setKeepalive(KEEPALIVE_PERIOD);
+}
+
+static RESULT_T run(const ChargerProfile &profile)
+{
+  RESULT_T r;
+  memset(&r, 0, sizeof(r));
+  snprintf(r.name, sizeof(r.name), "%s", profile.name());
+  snprintf(r.rampKind, sizeof(r.rampKind), "-");
+
+  hostResetClock();
+  profile.apply(sim);
+  sim.powerOn();
+  AP33772S usbpd;
+  usbpd.begin();
+  r.pdos = usbpd.getNumPDO();
+  r.bootMs = usbpd.bootStats().pdoUs / 1000;
+
+  benchAccept(usbpd, r);
+  benchSelect(usbpd, r);
+  benchRamp(usbpd, r);
+  benchKeepalive(usbpd, r);
+  return r;
+}
+
+static void loadBaseline()
+{
+  FILE *f = fopen(BASELINE_FILE, "r");
+  if (f == NULL) return;
+  char line[128];
+  while (baselineCount < MAX_PROFILES && fgets(line, sizeof(line), f))
+  {
+    BASELINE_T &b = baseline[baselineCount];
+    char *sep = strchr(line, '|');
+    if (line[0] == '#' || sep == NULL) continue;
+    *sep = 0;
+    snprintf(b.name, sizeof(b.name), "%.39s", line);
+    if (sscanf(sep + 1, "%lu %lu %lu %lu", &b.bootMs, &b.acceptMaxMs, &b.rampMs, &b.keepaliveReqs) == 4)
+      baselineCount++;
+  }
+  fclose(f);
+}
+
+static const BASELINE_T *findBaseline(const char *name)
+{
+  for (int i = 0; i < baselineCount; i++)
+    if (strcmp(baseline[i].name, name) == 0) return &baseline[i];
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  bool update = argc > 1 && strcmp(argv[1], "--update") == 0;
+
+  Wire.attach(AP33772S_ADDRESS, &sim);
+  Wire.begin();
+  Serial.setEcho(false);
+
+  glob_t files;
+  if (glob(PROFILE_GLOB, 0, NULL, &files) != 0 || files.gl_pathc == 0)
+  {
+    printf("No charger profiles in " PROFILE_GLOB "\n");
+    return 1;
+  }
+
+  loadBaseline();
+  static RESULT_T results[MAX_PROFILES];
+  int count = 0;
+  bool ok = true;
+
+  printf("%-20s %4s %7s %7s %7s %5s %7s %4s %7s %5s %6s %5s %7s %7s  %s\n", "charger", "pdos", "boot_ms",
+         "acc_avg", "acc_max", "sel", "sel_ns", "ramp", "ramp_ms", "steps", "ka_req", "drops", "lapse", "recover",
+         "baseline");
+  for (size_t i = 0; i < files.gl_pathc && count < MAX_PROFILES; i++)
+  {
+    ChargerProfile profile;
+    if (!profile.load(files.gl_pathv[i]))
+    {
+      printf("%s: parse error at line %d\n", files.gl_pathv[i], profile.errorLine());
+      ok = false;
+      continue;
+    }
+    RESULT_T &r = results[count++] = run(profile);
+
+    bool pass = r.pdos == profile.pdoCount() && r.accepted == r.requests &&
+                r.selectValid == r.selected && r.drops == 0;
+    if (strcmp(r.rampKind, "-") != 0) pass = pass && r.rampDone;
+    if (profile.timing().keepaliveMs) pass = pass && r.lapseMs > 0 && r.recoverMs > 0;
+
+    const BASELINE_T *b = findBaseline(r.name);
+    const char *verdict = pass ? "new" : "FAILED";
+    if (pass && b != NULL)
+    {
+      bool worse = r.bootMs > b->bootMs || r.acceptMaxMs > b->acceptMaxMs || r.rampMs > b->rampMs ||
+                   r.keepaliveReqs > b->keepaliveReqs;
+      bool better = r.bootMs < b->bootMs || r.acceptMaxMs < b->acceptMaxMs || r.rampMs < b->rampMs ||
+                    r.keepaliveReqs < b->keepaliveReqs;
+      verdict = worse ? "REGRESSED" : better ? "improved" : "ok";
+      if (worse && !update) ok = false;
+    }
+    ok = ok && pass;
+
+    char sel[24];
+    snprintf(sel, sizeof(sel), "%d/%d", r.selectValid < 0 ? 0 : r.selectValid, r.selected);
+    printf("%-20.20s %4d %7lu %7lu %7lu %5s %7.0f %4s %7lu %5u %6lu %5lu %7lu %7lu  %s", r.name, r.pdos, r.bootMs,
+           r.acceptAvgMs, r.acceptMaxMs, sel, r.selectNs, r.rampKind, r.rampMs, r.rampSteps, r.keepaliveReqs,
+           r.drops, r.lapseMs, r.recoverMs, verdict);
+    if (b != NULL && strcmp(verdict, "ok") != 0 && pass)
+      printf(" (%lu boot, %lu accept, %lu ramp, %lu keepalive)", b->bootMs, b->acceptMaxMs, b->rampMs,
+             b->keepaliveReqs);
+    printf("\n");
+  }
+  globfree(&files);
+
+  printf("\nacc_*: request to PD_MSGRLT over %d targets. sel: targets answered with a covering PDO, fixed\n"
+         "first. ka_req: keepalive requests holding a PPS/AVS contract for 3 source timeouts. lapse: the\n"
+         "source dropping it with the keepalive off. recover: dropout to VBUS back at 5V.\n",
+         (int)COUNT(ACCEPT_TARGETS));
+
+  if (update)
+  {
+    FILE *f = fopen(BASELINE_FILE, "w");
+    if (f == NULL) return 1;
+    fprintf(f, "# charger|boot_ms accept_max_ms ramp_ms keepalive_requests from profiles/, written by build/chargers --update\n");
+    for (int i = 0; i < count; i++)
+      fprintf(f, "%s|%lu %lu %lu %lu\n", results[i].name, results[i].bootMs, results[i].acceptMaxMs,
+              results[i].rampMs, results[i].keepaliveReqs);
+    fclose(f);
+    printf("\n%s updated\n", BASELINE_FILE);
+  }
+  else printf("\n%s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
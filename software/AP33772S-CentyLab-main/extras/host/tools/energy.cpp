@@ -0,0 +1,138 @@
+/*
+energy.cpp - Account energy and charge over two output sessions from the
+sampler's reads, against a floating point reference integrated from the
+simulated registers every 1ms, and check that accounting adds no I2C traffic.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#include <stdio.h>
+
+#include "AP33772S.h"
+#include "AP33772S_Energy.h"
+#include "AP33772S_Sampler.h"
+#include "AP33772SSim.h"
+
+#define SAMPLE_PERIOD_US 10000
+
+static const SIM_PDO_T SOURCE_PDOS[] = {
+  {SIM_PDO_FIXED, 0, 5000, 3000, false},
+  {SIM_PDO_FIXED, 0, 9000, 3000, false},
+  {SIM_PDO_FIXED, 0, 15000, 3000, false},
+  {SIM_PDO_FIXED, 0, 20000, 5000, false},
+};
+
+static AP33772SSim sim;
+static AP33772S usbpd;
+static AP33772SSampler sampler(usbpd);
+static AP33772SEnergy energy(usbpd);
+
+static double refMWh = 0;
+static double refMAh = 0;
+
+// Application loop with a 1ms tick, the reference reads the simulator directly
+// and holds the value over the real length of the tick, bus time included
+static void run(unsigned long ms)
+{
+  unsigned long start = millis();
+  while (millis() - start < ms)
+  {
+    unsigned long from = micros();
+    double mV = (sim.reg(CMD_VOLTAGE) | (sim.reg(CMD_VOLTAGE, 1) << 8)) * 80.0;
+    double mA = sim.reg(CMD_CURRENT) * 24.0;
+    bool on = usbpd.getOutput();
+    usbpd.poll();
+    sampler.poll();
+    sampler.clear();
+    delay(1);
+    if (on)
+    {
+      double hours = (micros() - from) / 3.6e9;
+      refMWh += mV * mA / 1e3 * hours;
+      refMAh += mA * hours;
+    }
+  }
+}
+
+// Two sessions: 20V 2A then 3.5A for 30s each, off 5s, 15V 1A for 20s
+static unsigned long scenario()
+{
+  hostResetClock();
+  sim.powerOn();
+  usbpd.begin();
+  Wire.resetStats();
+  usbpd.setFixPDO(4, 5000);
+  sampler.start(SAMPLE_PERIOD_US);
+  run(100);
+  usbpd.setOutput(1);
+  sim.setLoadCurrent(2000);
+  run(30000);
+  sim.setLoadCurrent(3500);
+  run(30000);
+  usbpd.setOutput(0);
+  sim.setLoadCurrent(0);
+  run(5000);
+  usbpd.setFixPDO(3, 3000);
+  usbpd.setOutput(1);
+  sim.setLoadCurrent(1000);
+  run(20000);
+  sampler.stop();
+  return Wire.stats().writeTransactions + Wire.stats().readTransactions;
+}
+
+static void print(const char *name, const ENERGY_T &e)
+{
+  printf("%-10s %6lu.%03u %6lu.%03u %8lu %9lu %8lu %5lu\n", name,
+         (unsigned long)e.energy_mWh, e.energy_uWh, (unsigned long)e.charge_mAh, e.charge_uAh,
+         (unsigned long)e.peak_mW, (unsigned long)e.onTimeMs, (unsigned long)e.samples, (unsigned long)e.gaps);
+}
+
+int main()
+{
+  sim.setSourcePDOs(SOURCE_PDOS, sizeof(SOURCE_PDOS) / sizeof(SOURCE_PDOS[0]));
+  Wire.attach(AP33772S_ADDRESS, &sim);
+  Wire.begin();
+  Serial.setEcho(false);
+  bool ok = true;
+
+  scenario(); // Both measured runs start from the state a run leaves behind
+  unsigned long plain = scenario();
+
+  refMWh = 0;
+  refMAh = 0;
+  energy.attach();
+  unsigned long accounted = scenario();
+
+  printf("%d ms samples, two output sessions\n\n", SAMPLE_PERIOD_US / 1000);
+  printf("%-10s %10s %10s %8s %9s %8s %5s\n", "", "mWh", "mAh", "peak_mW", "on_ms", "samples", "gaps");
+  ENERGY_T total = energy.total();
+  print("session 2", energy.session());
+  print("total", total);
+
+  double mWh = total.energy_mWh + total.energy_uWh / 1000.0;
+  double mAh = total.charge_mAh + total.charge_uAh / 1000.0;
+  printf("reference  %10.3f %10.3f\n", refMWh, refMAh);
+  printf("\nerror %.3f%% energy, %.3f%% charge, %lu sessions\n",
+         (mWh - refMWh) * 100 / refMWh, (mAh - refMAh) * 100 / refMAh, energy.sessions());
+  printf("I2C transactions: %lu without accounting, %lu with\n", plain, accounted);
+
+  ok = ok && energy.sessions() == 2 && accounted == plain;
+  ok = ok && mWh > refMWh * 0.995 && mWh < refMWh * 1.005;
+  ok = ok && mAh > refMAh * 0.995 && mAh < refMAh * 1.005;
+
+  // Overflow: a day at the register maxima, in 1s steps, against exact integer math
+  AP33772SEnergy worst(usbpd);
+  SAMPLE_RAW_T s = {0, 0xffff, 0xff, 25};
+  for (unsigned long i = 0; i <= 86400; i++)
+  {
+    s.t_us = i * 1000000UL;
+    worst.add(s);
+  }
+  unsigned long long exact = 65535ULL * 255 * 2 * 86400000000ULL / ENERGY_UNIT_MWH;
+  printf("one day at 65535 x 255 raw: %lu mWh, exact %llu\n", (unsigned long)worst.total().energy_mWh, exact);
+  ok = ok && worst.total().energy_mWh == exact;
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,177 @@
+/*
+events.cpp - Compare how quickly an OCP trip and a negotiation result reach
+the application, and what the bus costs while nothing happens, with STATUS
+polling and with the INT pin driving service(), also when the STATUS read an
+interrupt triggers fails. A lost event fails the run instead of hanging it.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#include <stdio.h>
+
+#include "AP33772S.h"
+#include "AP33772SSim.h"
+
+#define INT_PIN   2
+#define IDLE_MS   1000
+#define TRIALS    10
+#define WAIT_MS   1000 // Virtual time an event may take before the mode fails
+
+static const SIM_PDO_T SOURCE_PDOS[] = {
+  {SIM_PDO_FIXED, 0, 5000, 3000, false},
+  {SIM_PDO_FIXED, 0, 9000, 3000, false},
+  {SIM_PDO_FIXED, 0, 15000, 3000, false},
+  {SIM_PDO_FIXED, 0, 20000, 5000, false},
+};
+
+static AP33772SSim sim;
+static AP33772S usbpd;
+
+static void onInt()
+{
+  usbpd.handleInterrupt();
+}
+
+typedef enum
+{
+  MODE_POLL_1MS = 0,
+  MODE_POLL_10MS,
+  MODE_INT_PIN,
+  MODE_ISR,
+  MODE_ISR_NACK  // The STATUS read after each OCP is NACKed through every retry
+} MODE;
+
+static const char *MODE_NAME[] = {"readStatus() every 1ms", "readStatus() every 10ms",
+                                  "setIntPin(), poll() every 1ms", "attachInterrupt(), poll() every 1ms",
+                                  "attachInterrupt(), STATUS read NACKed"};
+
+static void setup(MODE mode)
+{
+  hostResetClock();
+  sim.powerOn();
+  usbpd.begin();
+  detachInterrupt(digitalPinToInterrupt(INT_PIN));
+  usbpd.setIntPin(INT_PIN_NONE);
+  if (mode != MODE_POLL_1MS && mode != MODE_POLL_10MS)
+  {
+    sim.setIntPin(INT_PIN);
+    usbpd.setMask((AP33772_MASK)(READY_MSK | OCP_MSK));
+    if (mode == MODE_INT_PIN) usbpd.setIntPin(INT_PIN);
+    else attachInterrupt(digitalPinToInterrupt(INT_PIN), onInt, RISING);
+  }
+  usbpd.readStatus(); // Drop the power-on STARTED/NEWPDO
+  AP33772S_EVENT event;
+  while (usbpd.getEvent(event)) {}
+  usbpd.getEventFlags();
+}
+
+/*
+ * One application tick: the polling modes read STATUS themselves on their
+ * period, the interrupt modes leave that to poll(). Returns the status bits seen.
+ */
+static byte tick(MODE mode, unsigned long &lastPoll)
+{
+  byte seen = 0;
+  unsigned long now = millis();
+  if (mode == MODE_POLL_1MS || mode == MODE_POLL_10MS)
+  {
+    unsigned long period = mode == MODE_POLL_1MS ? 1 : 10;
+    if (now - lastPoll >= period)
+    {
+      lastPoll = now;
+      seen = usbpd.readStatus();
+      if ((seen & READY_MSK) && usbpd.readMsgResult() == MSGRLT_SUCCESS) seen |= 0x80;
+    }
+  }
+  else
+  {
+    usbpd.poll();
+    AP33772S_EVENT event;
+    while (usbpd.getEvent(event))
+    {
+      if (event == EVENT_OCP) seen |= OCP_MSK;
+      if (event == EVENT_NEGO_SUCCESS) seen |= 0x80;
+    }
+  }
+  delay(1);
+  return seen;
+}
+
+// Tick until one of the bits is seen, 0 if WAIT_MS pass first
+static bool waitFor(MODE mode, unsigned long &lastPoll, byte bits)
+{
+  unsigned long start = millis();
+  while (!(tick(mode, lastPoll) & bits))
+    if (millis() - start > WAIT_MS) return false;
+  return true;
+}
+
+static bool run(MODE mode)
+{
+  bool ok = true;
+  setup(mode);
+  unsigned long lastPoll = millis();
+
+  // Idle: nothing raised, count what watching costs
+  Wire.resetStats();
+  unsigned long start = millis();
+  while (millis() - start < IDLE_MS) tick(mode, lastPoll);
+  const WIRE_STATS_T idle = Wire.stats();
+
+  // OCP raised at staggered offsets, latency to the application seeing it
+  uint64_t ocpTotal = 0;
+  for (int i = 0; i < TRIALS; i++)
+  {
+    delay(3);
+    hostAdvanceNanos(i * 937000ULL); // Spread the trip across the poll period
+    uint64_t raised = hostNanos();
+    sim.raiseStatus(OCP_MSK);
+    if (mode == MODE_ISR_NACK) Wire.injectFault(WIRE_FAULT_NACK, BUS_RETRIES + 1);
+    if (!waitFor(mode, lastPoll, OCP_MSK))
+    {
+      ok = false;
+      break;
+    }
+    ocpTotal += hostNanos() - raised;
+  }
+
+  // Request to accepted contract, latency after the source answers
+  uint64_t negoTotal = 0;
+  for (int i = 0; i < TRIALS; i++)
+  {
+    usbpd.requestPower(i & 1 ? 9000 : 15000, 3000);
+    uint64_t requested = hostNanos();
+    if (!waitFor(mode, lastPoll, 0x80))
+    {
+      ok = false;
+      break;
+    }
+    negoTotal += hostNanos() - requested - sim.timing().negotiationMs * 1000000ULL;
+    delay(5);
+  }
+
+  printf("%-38s %8lu %8lu %10.1f %10.3f %10.3f  %s\n", MODE_NAME[mode],
+         idle.writeTransactions + idle.readTransactions, idle.bytesWritten + idle.bytesRead,
+         idle.busNanos / 1000.0 / IDLE_MS,
+         ocpTotal / 1e6 / TRIALS, negoTotal / 1e6 / TRIALS, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+int main()
+{
+  sim.setSourcePDOs(SOURCE_PDOS, sizeof(SOURCE_PDOS) / sizeof(SOURCE_PDOS[0]));
+  Wire.attach(AP33772S_ADDRESS, &sim);
+  Wire.begin();
+  Serial.setEcho(false);
+
+  printf("STATUS notification, %d ms idle, %d trials, source answers in %lu ms\n\n",
+         IDLE_MS, TRIALS, sim.timing().negotiationMs);
+  printf("%-38s %8s %8s %10s %10s %10s\n", "method", "idle_tx", "idle_b", "bus_us/ms", "ocp_ms", "nego_ms");
+  bool ok = true;
+  for (int mode = MODE_POLL_1MS; mode <= MODE_ISR_NACK; mode++) ok = run((MODE)mode) && ok;
+
+  printf("\n%s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
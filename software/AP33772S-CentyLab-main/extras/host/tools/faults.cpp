@@ -0,0 +1,220 @@
+/*
+faults.cpp - The I2C transport under injected bus faults: NACKs, short reads,
+driver timeouts and a peripheral holding SDA low. Checks that a failed
+transfer is reported instead of decoded as zeros, that retries and the SCL
+recovery get the bus back, and that no call outlasts busWorstCaseUs(). Then
+the engines: a ramp step and an interrupt's STATUS read that the bus refuses
+are tried again, not dropped.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#include <stdio.h>
+
+#include "AP33772S.h"
+#include "AP33772S_Ramp.h"
+#include "AP33772SSim.h"
+
+#define INT_PIN 2
+
+static const SIM_PDO_T SOURCE_PDOS[] = {
+  {SIM_PDO_FIXED, 0, 5000, 3000, false},
+  {SIM_PDO_FIXED, 0, 9000, 3000, false},
+  {SIM_PDO_FIXED, 0, 20000, 5000, false},
+  {SIM_PDO_PPS, 3300, 21000, 5000, false},
+};
+
+static const char *const STATUS_NAMES[] = {"ok", "too long", "nack addr", "nack data", "bus error", "timeout",
+                                           "short read"};
+
+static AP33772SSim sim;
+static AP33772S usbpd;
+static bool ok = true;
+
+static void row(const char *name, long result, unsigned long elapsedUs, unsigned long boundUs, bool pass)
+{
+  const BUS_HEALTH_T &h = usbpd.busHealth();
+  printf("%-30s %8ld %-11s %7lu %10lu %8lu %8lu  %s\n", name, result, STATUS_NAMES[h.last], h.retries, h.recoveries,
+         elapsedUs, boundUs, pass ? "ok" : "FAILED");
+  ok = ok && pass && elapsedUs <= boundUs;
+}
+
+// One readVoltage() with a fault armed, the chip sits at 20V
+static void readCase(const char *name, WIRE_FAULT fault, unsigned count, bool expectOk)
+{
+  usbpd.resetBusHealth();
+  Wire.injectFault(fault, count);
+  unsigned long start = micros();
+  int mV = usbpd.readVoltage();
+  unsigned long elapsed = micros() - start;
+  Wire.injectFault(WIRE_FAULT_NONE);
+  bool pass = expectOk ? mV > 19000 : mV == -1; // Never 0
+  row(name, mV, elapsed, usbpd.busWorstCaseUs(2), pass);
+}
+
+static void stuckCase(const char *name, unsigned pulses, bool expectOk)
+{
+  usbpd.resetBusHealth();
+  Wire.holdSDA(pulses);
+  unsigned long start = micros();
+  int mV = usbpd.readVoltage();
+  unsigned long elapsed = micros() - start;
+  bool freed = !Wire.sdaHeld();
+  Wire.holdSDA(0);
+  bool pass = expectOk ? mV > 19000 && freed && usbpd.busHealth().recoveries >= 1 : mV == -1;
+  row(name, mV, elapsed, usbpd.busWorstCaseUs(2), pass);
+}
+
+/*
+ * A control loop reading samples while one transaction in `every` fails,
+ * alternating NACK, short read and timeout.
+ * @return samples the loop could not use
+ */
+static unsigned long controlLoop(byte retries, unsigned every, unsigned long &zeros, unsigned long &worstUs)
+{
+  BUS_POLICY_T policy = usbpd.busPolicy();
+  policy.retries = retries;
+  usbpd.setBusPolicy(policy);
+  usbpd.resetBusHealth();
+
+  static const WIRE_FAULT KINDS[] = {WIRE_FAULT_NACK, WIRE_FAULT_SHORT, WIRE_FAULT_TIMEOUT};
+  uint32_t lcg = 12345;
+  unsigned long lost = 0;
+  zeros = 0;
+  for (int i = 0; i < 2000; i++)
+  {
+    lcg = lcg * 1103515245UL + 12345UL;
+    if ((lcg >> 16) % every == 0) Wire.injectFault(KINDS[(lcg >> 8) % 3]);
+    SAMPLE_RAW_T sample = {0, 0xffff, 0xff, 0xff}; // Left as is on a failed read
+    if (!usbpd.readSample(sample)) lost++;
+    else if (sample.voltage == 0) zeros++;
+    Wire.injectFault(WIRE_FAULT_NONE);
+    delay(1);
+  }
+  worstUs = usbpd.busHealth().worstUs;
+  return lost;
+}
+
+static void onInt()
+{
+  usbpd.handleInterrupt();
+}
+
+// A ramp whose first step request is NACKed through every retry
+static void rampCase()
+{
+  usbpd.requestPower(5000, 3000);
+  delay(300);
+  AP33772SRamp ramp(usbpd);
+  usbpd.resetBusHealth();
+  ramp.start(5000, 12000, 3000, 1000);
+  Wire.injectFault(WIRE_FAULT_NACK, BUS_RETRIES + 1);
+  unsigned long start = millis();
+  while (ramp.busy() && millis() - start < 5000)
+  {
+    ramp.poll();
+    delay(1);
+  }
+  int mV = usbpd.readVoltage();
+  printf("%-30s %8d %-11s %7lu %10s %8lu\n", "ramp 5V->12V, step 1 NACKed", mV,
+         ramp.state() == RAMP_DONE ? "done" : "error", usbpd.busHealth().retries, "-", ramp.elapsed());
+  ok = ok && ramp.state() == RAMP_DONE && ramp.steps() == 7 && mV > 11700;
+}
+
+// OCP raised with the ISR attached, the STATUS read it triggers NACKed through every retry
+static void interruptCase()
+{
+  sim.setIntPin(INT_PIN);
+  usbpd.setMask(OCP_MSK);
+  attachInterrupt(digitalPinToInterrupt(INT_PIN), onInt, RISING);
+  usbpd.readStatus();
+  AP33772S_EVENT event;
+  while (usbpd.getEvent(event)) {}
+
+  sim.raiseStatus(OCP_MSK);
+  Wire.injectFault(WIRE_FAULT_NACK, BUS_RETRIES + 1);
+  bool seen = false;
+  unsigned long start = millis();
+  while (!seen && millis() - start < 100)
+  {
+    usbpd.poll();
+    while (usbpd.getEvent(event)) seen = seen || event == EVENT_OCP;
+    delay(1);
+  }
+  detachInterrupt(digitalPinToInterrupt(INT_PIN));
+  printf("%-30s %8s %-11s %7lu %10s %8lu\n", "OCP interrupt, STATUS NACKed", seen ? "seen" : "lost", "-",
+         usbpd.busHealth().retries, "-", millis() - start);
+  ok = ok && seen;
+}
+
+int main()
+{
+  sim.setSourcePDOs(SOURCE_PDOS, sizeof(SOURCE_PDOS) / sizeof(SOURCE_PDOS[0]));
+  Wire.attach(AP33772S_ADDRESS, &sim);
+  Wire.begin();
+  Serial.setEcho(false);
+  sim.powerOn();
+  usbpd.begin();
+  usbpd.requestPower(20000, 3000);
+  delay(1000);
+
+  const BUS_POLICY_T &p = usbpd.busPolicy();
+  printf("Policy: %lu us timeout, %u retries, %u us first backoff\n\n", p.timeoutUs, p.retries, p.backoffUs);
+  printf("%-30s %8s %-11s %7s %10s %8s %8s\n", "case", "result", "status", "retries", "recoveries", "us", "bound");
+
+  readCase("readVoltage(), no fault", WIRE_FAULT_NONE, 0, true);
+  readCase("readVoltage(), 1 NACK", WIRE_FAULT_NACK, 1, true);
+  readCase("readVoltage(), 3 NACKs", WIRE_FAULT_NACK, 3, false);
+  readCase("readVoltage(), 1 short read", WIRE_FAULT_SHORT, 1, true);
+  readCase("readVoltage(), 3 short reads", WIRE_FAULT_SHORT, 3, false);
+  readCase("readVoltage(), 1 timeout", WIRE_FAULT_TIMEOUT, 1, true);
+  readCase("readVoltage(), 6 timeouts", WIRE_FAULT_TIMEOUT, 6, false);
+  stuckCase("readVoltage(), SDA held 5 SCL", 5, true);
+  stuckCase("readVoltage(), SDA never freed", 1000, false);
+
+  // Setters report the failure and leave the shadow cache as the chip has it
+  usbpd.setConfigCache(true);
+  usbpd.setOVPTHR(2000);
+  usbpd.resetBusHealth();
+  Wire.injectFault(WIRE_FAULT_NACK, 3);
+  unsigned long start = micros();
+  bool set = usbpd.setOVPTHR(1200);
+  unsigned long elapsed = micros() - start;
+  Wire.injectFault(WIRE_FAULT_NONE);
+  row("setOVPTHR(1200), 3 NACKs", set, elapsed, usbpd.busWorstCaseUs(1), !set);
+  ok = ok && usbpd.readOVPTHR() == 2000;
+  usbpd.setConfigCache(false);
+
+  uint16_t rdo = usbpd.getLastRDO();
+  usbpd.resetBusHealth();
+  Wire.injectFault(WIRE_FAULT_NACK, 3);
+  start = micros();
+  int index = usbpd.requestPower(9000, 3000);
+  elapsed = micros() - start;
+  Wire.injectFault(WIRE_FAULT_NONE);
+  row("requestPower(9000), 3 NACKs", index, elapsed, usbpd.busWorstCaseUs(2),
+      index == -1 && usbpd.getLastRDO() == rdo);
+
+  printf("\nControl loop, 2000 readSample() with 1 transaction in 20 failing\n");
+  printf("%-8s %6s %6s %10s %8s\n", "retries", "lost", "zeros", "worst_us", "bound");
+  for (byte retries = 0; retries <= BUS_RETRIES; retries += BUS_RETRIES)
+  {
+    unsigned long zeros, worst;
+    unsigned long lost = controlLoop(retries, 20, zeros, worst);
+    unsigned long bound = usbpd.busWorstCaseUs(SAMPLE_LENGTH);
+    printf("%-8u %6lu %6lu %10lu %8lu\n", retries, lost, zeros, worst, bound);
+    ok = ok && zeros == 0 && worst <= bound;
+    if (retries == 0) ok = ok && lost > 0;
+    else ok = ok && lost == 0;
+  }
+
+  printf("\nEngines after a refused transfer\n");
+  printf("%-30s %8s %-11s %7s %10s %8s\n", "case", "result", "state", "retries", "", "ms");
+  rampCase();
+  interruptCase();
+
+  printf("\n%s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,134 @@
+/*
+ntc.cpp - NTC tables computed at compile time from Beta and Steinhart-Hart
+coefficients, and the cost of programming them as four separate writes
+against one burst.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "AP33772S.h"
+#include "AP33772S_NTC.h"
+#include "AP33772SSim.h"
+
+// Chip default, datasheet table of the 10k thermistor on the reference design
+static const NTC_T DATASHEET = {10000, 4161, 1928, 974};
+
+// Folded by the compiler, static_assert only accepts constant expressions
+constexpr NTC_T BETA_3380 = ntcFromBeta(10000, 3380);
+constexpr NTC_T BETA_3435 = ntcFromBeta(10000, 3435);
+constexpr NTC_T BETA_3950 = ntcFromBeta(10000, 3950);
+constexpr NTC_T BETA_4250_47K = ntcFromBeta(47000, 4250);
+constexpr NTC_T SH_3950 = ntcFromSteinhartHart(1.009249522e-03, 2.378405444e-04, 2.019202697e-07);
+
+static_assert(BETA_3380.tr25 == 10000, "Beta model must return R25 at 25C");
+static_assert(BETA_3380.tr50 > 4150 && BETA_3380.tr50 < 4170, "Beta 3380 at 50C");
+// The published coefficients are a fit over a wider range and give 9877 Ohm at 25C
+static_assert(SH_3950.tr25 > 9800 && SH_3950.tr25 < 10200, "Steinhart-Hart 10k/3950 at 25C");
+
+typedef struct
+{
+  const char *name;
+  NTC_T ntc;
+} PART_T;
+
+static const PART_T PARTS[] = {
+  {"datasheet default", DATASHEET},
+  {"Beta 10k/3380", BETA_3380},
+  {"Beta 10k/3435", BETA_3435},
+  {"Beta 10k/3950", BETA_3950},
+  {"Beta 47k/4250", BETA_4250_47K},
+  {"Steinhart-Hart 10k/3950", SH_3950},
+};
+
+static AP33772SSim sim;
+static AP33772S usbpd;
+
+static WIRE_STATS_T before;
+static unsigned long startUs;
+
+static void beginMeasure()
+{
+  before = Wire.stats();
+  startUs = micros();
+}
+
+static void endMeasure(const char *name)
+{
+  const WIRE_STATS_T &after = Wire.stats();
+  printf("%-28s %6lu %6lu %8lu %8lu %10.1f %12lu\n", name,
+         after.writeTransactions - before.writeTransactions,
+         after.readTransactions - before.readTransactions,
+         after.bytesWritten - before.bytesWritten,
+         after.bytesRead - before.bytesRead,
+         (after.busNanos - before.busNanos) / 1000.0,
+         micros() - startUs);
+}
+
+#define MEASURE(name, call) do { beginMeasure(); call; endMeasure(name); } while (0)
+
+static bool same(const NTC_T &a, const NTC_T &b)
+{
+  return a.tr25 == b.tr25 && a.tr50 == b.tr50 && a.tr75 == b.tr75 && a.tr100 == b.tr100;
+}
+
+// Poll until the asynchronous operation is over
+static void finishOp()
+{
+  while (usbpd.opStatus() == OP_BUSY)
+  {
+    usbpd.poll();
+    delay(1);
+  }
+}
+
+int main()
+{
+  Wire.attach(AP33772S_ADDRESS, &sim);
+  Wire.begin();
+  Serial.setEcho(false);
+  sim.powerOn();
+  usbpd.begin();
+
+  printf("%-28s %8s %8s %8s %8s\n", "part", "TR25", "TR50", "TR75", "TR100");
+  for (size_t i = 0; i < sizeof(PARTS) / sizeof(PARTS[0]); i++)
+  {
+    const NTC_T &n = PARTS[i].ntc;
+    printf("%-28s %8u %8u %8u %8u\n", PARTS[i].name, n.tr25, n.tr50, n.tr75, n.tr100);
+  }
+
+  printf("\n%-28s %6s %6s %8s %8s %10s %12s\n", "call", "wr", "rd", "bytes_wr", "bytes_rd", "bus_us", "elapsed_us");
+
+  // What setNTC() did before: one register per transaction, 5ms apart
+  MEASURE("4x TRxx write, 5ms gaps", (usbpd.write<R_TR25>(OHM_T(BETA_3950.tr25)), delay(5),
+                                      usbpd.write<R_TR50>(OHM_T(BETA_3950.tr50)), delay(5),
+                                      usbpd.write<R_TR75>(OHM_T(BETA_3950.tr75)), delay(5),
+                                      usbpd.write<R_TR100>(OHM_T(BETA_3950.tr100))));
+  bool ok = true;
+  MEASURE("setNTC(NTC_T) burst", ok = usbpd.setNTC(SH_3950));
+  NTC_T check;
+  MEASURE("readNTC()", ok = ok && usbpd.readNTC(check));
+  ok = ok && same(check, SH_3950);
+
+  MEASURE("setNTCAsync() + poll()", (usbpd.setNTCAsync(DATASHEET.tr25, DATASHEET.tr50, DATASHEET.tr75, DATASHEET.tr100),
+                                     usbpd.poll()));
+  ok = ok && usbpd.opStatus() == OP_DONE && usbpd.readNTC(check) && same(check, DATASHEET);
+
+  // Burst refused, the per-register fallback runs from poll() and is read back like setNTC()
+  Wire.injectFault(WIRE_FAULT_NACK, BUS_RETRIES + 1);
+  MEASURE("setNTCAsync(), burst NACKed", (usbpd.setNTCAsync(BETA_3435.tr25, BETA_3435.tr50, BETA_3435.tr75,
+                                                            BETA_3435.tr100), finishOp()));
+  ok = ok && usbpd.opStatus() == OP_DONE && usbpd.readNTC(check) && same(check, BETA_3435);
+
+  // Out of range resistances are refused before any write, not wrapped to 16 bits
+  Wire.resetStats();
+  ok = ok && !usbpd.setNTC(-1, 4161, 1928, 974) && !usbpd.setNTC(70000, 4161, 1928, 974);
+  ok = ok && Wire.stats().writeTransactions == 0 && usbpd.readNTC(check) && same(check, BETA_3435);
+
+  printf("\nread-back %s\n", ok ? "matches" : "MISMATCH");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,89 @@
+/*
+ramp.cpp - Time a 3.3V to 20V PPS sweep with the fixed-delay loop from the
+PPScycle example and with AP33772SRamp, on the simulated charger.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#include <stdio.h>
+
+#include "AP33772S.h"
+#include "AP33772S_Ramp.h"
+#include "AP33772SSim.h"
+
+static const SIM_PDO_T SOURCE_PDOS[] = {
+  {SIM_PDO_FIXED, 0, 5000, 3000, false},
+  {SIM_PDO_FIXED, 0, 9000, 3000, false},
+  {SIM_PDO_FIXED, 0, 15000, 3000, false},
+  {SIM_PDO_FIXED, 0, 20000, 5000, false},
+  {SIM_PDO_PPS, 3300, 21000, 5000, false},
+};
+
+static AP33772SSim sim;
+static AP33772S usbpd;
+static bool ok = true;
+
+static void boot()
+{
+  sim.powerOn();
+  usbpd.begin();
+  usbpd.requestPower(3300, 3000);
+  delay(500);
+  Wire.resetStats();
+}
+
+static void report(const char *name, unsigned long ms, unsigned int steps)
+{
+  const WIRE_STATS_T &st = Wire.stats();
+  printf("%-34s %10lu %6u %8lu %8lu %6d\n", name, ms, steps,
+         st.writeTransactions + st.readTransactions, st.bytesWritten + st.bytesRead, usbpd.readVoltage());
+}
+
+static void fixedDelay()
+{
+  boot();
+  unsigned long start = millis();
+  unsigned int steps = 0;
+  for (int mV = 3400; mV <= 20000; mV += 100, steps++)
+  {
+    usbpd.setPPSPDO(usbpd.getPPSIndex(), mV, 3000);
+    delay(600);
+  }
+  report("setPPSPDO + delay(600), 100mV", millis() - start, steps);
+}
+
+static void ramp(const char *name, int step, unsigned long slew)
+{
+  boot();
+  AP33772SRamp r(usbpd);
+  r.start(3300, 20000, 3000, step, slew);
+  while (r.busy())
+  {
+    r.poll();
+    delay(1);
+  }
+  report(name, r.elapsed(), r.steps());
+  if (r.state() != RAMP_DONE) printf("  ramp failed at %dmV\n", r.voltage());
+  int mV = usbpd.readVoltage();
+  ok = ok && r.state() == RAMP_DONE && mV >= 20000 - RAMP_TOLERANCE && mV <= 20000 + RAMP_TOLERANCE;
+}
+
+int main()
+{
+  sim.setSourcePDOs(SOURCE_PDOS, sizeof(SOURCE_PDOS) / sizeof(SOURCE_PDOS[0]));
+  Wire.attach(AP33772S_ADDRESS, &sim);
+  Serial.setEcho(false);
+
+  printf("3.3V -> 20V PPS sweep, source accepts in %lums, slews %lumV/ms\n\n",
+         sim.timing().negotiationMs, sim.timing().slewMvPerMs);
+  printf("%-34s %10s %6s %8s %8s %6s\n", "method", "ms", "steps", "txns", "bytes", "mV");
+  fixedDelay();
+  ramp("AP33772SRamp, 100mV", 100, 0);
+  ramp("AP33772SRamp, 1000mV", 1000, 0);
+  ramp("AP33772SRamp, 1000mV, 5V/s slew", 1000, 5000);
+
+  printf("\n%s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
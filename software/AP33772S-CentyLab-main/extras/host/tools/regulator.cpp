@@ -0,0 +1,120 @@
+/*
+regulator.cpp - Run AP33772SRegulator against the simulated charger: CV
+through a lossy cable with a load step, CC into a resistive load, and the
+loop period traded against I2C bus load.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#include <stdio.h>
+
+#include "AP33772S.h"
+#include "AP33772S_Regulator.h"
+#include "AP33772SSim.h"
+
+#define CABLE_MOHM 150
+
+static const SIM_PDO_T SOURCE_PDOS[] = {
+  {SIM_PDO_FIXED, 0, 5000, 3000, false},
+  {SIM_PDO_FIXED, 0, 9000, 3000, false},
+  {SIM_PDO_FIXED, 0, 15000, 3000, false},
+  {SIM_PDO_FIXED, 0, 20000, 5000, false},
+  {SIM_PDO_PPS, 3300, 21000, 5000, false},
+};
+
+static AP33772SSim sim;
+static AP33772S usbpd;
+
+static void boot()
+{
+  hostResetClock();
+  sim.powerOn();
+  usbpd.begin();
+  usbpd.setOutput(1);
+  sim.setCableResistance(CABLE_MOHM);
+}
+
+// Application loop with a 1ms tick, the regulator runs from poll()
+static void run(AP33772SRegulator &reg, unsigned long ms)
+{
+  unsigned long start = millis();
+  while (millis() - start < ms)
+  {
+    usbpd.poll();
+    reg.poll();
+    delay(1);
+  }
+}
+
+int main()
+{
+  sim.setSourcePDOs(SOURCE_PDOS, sizeof(SOURCE_PDOS) / sizeof(SOURCE_PDOS[0]));
+  Wire.attach(AP33772S_ADDRESS, &sim);
+  Wire.begin();
+  Serial.setEcho(false);
+  bool ok = true;
+
+  printf("12V CV through %d mOhm, load 0.5A -> 3A\n\n", CABLE_MOHM);
+
+  boot();
+  sim.setLoadCurrent(500);
+  usbpd.setPPSPDO(usbpd.getPPSIndex(), 12000, 3000);
+  delay(500);
+  sim.setLoadCurrent(3000);
+  delay(500);
+  printf("open loop setPPSPDO(12000): %d mV at 3A\n", usbpd.readVoltage());
+
+  AP33772SRegulator reg(usbpd);
+  boot();
+  sim.setLoadCurrent(500);
+  reg.startCV(12000, 3000);
+  run(reg, 1000);
+  sim.setLoadCurrent(3000);
+  reg.setTarget(12000);
+  run(reg, 1000);
+  const REG_STATS_T &cv = reg.stats();
+  printf("CV regulator:               %d mV at 3A, request %d mV, settled in %lu ms after the step\n",
+         reg.voltage(), reg.output(), cv.settleMs);
+  ok = ok && cv.settled && reg.voltage() >= 12000 - REG_CV_TOLERANCE;
+
+  printf("\n2A CC into 4 ohm, 20V compliance\n\n");
+  boot();
+  sim.setLoadResistance(4000);
+  reg.startCC(2000, 20000);
+  run(reg, 2000);
+  const REG_STATS_T &cc = reg.stats();
+  printf("CC regulator: %d mA at %d mV, settled in %lu ms, %lu requests\n",
+         reg.current(), reg.voltage(), cc.settleMs, cc.requests);
+  ok = ok && cc.settled && reg.current() >= 2000 - REG_CC_TOLERANCE && reg.current() <= 2000 + REG_CC_TOLERANCE;
+
+  printf("\nCV load step against loop period, 1ms application tick, 100kHz I2C\n\n");
+  printf("%-10s %8s %10s %10s %10s %9s %8s %10s\n", "period_ms", "rate_hz", "jit_max_us", "jit_avg_us",
+         "settle_ms", "requests", "i2c_tx/s", "bus_load_%");
+  static const unsigned long PERIODS[] = {10, 20, 50, 100};
+  for (unsigned long period : PERIODS)
+  {
+    boot();
+    sim.setLoadCurrent(500);
+    reg.setPeriod(period);
+    reg.startCV(12000, 3000);
+    run(reg, 1000);
+    sim.setLoadCurrent(3000);
+    reg.setTarget(12000);
+    Wire.resetStats();
+    unsigned long start = micros();
+    run(reg, 2000);
+    const REG_STATS_T &st = reg.stats();
+    const WIRE_STATS_T &bus = Wire.stats();
+    double secs = (micros() - start) / 1e6;
+    char settle[16];
+    if (st.settled) snprintf(settle, sizeof(settle), "%lu", st.settleMs);
+    else snprintf(settle, sizeof(settle), "-");
+    printf("%-10lu %8lu %10lu %10lu %10s %9lu %8.0f %10.2f\n", period, reg.loopRate(), st.jitterMaxUs,
+           st.loops > 1 ? st.jitterSumUs / (st.loops - 1) : 0, settle, st.requests,
+           (bus.writeTransactions + bus.readTransactions) / secs, bus.busNanos / 1e7 / secs);
+  }
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,162 @@
+/*
+sampler.cpp - Capture a load transient with AP33772SSampler on the simulated
+charger and compare the binary stream with printing decimal text.
+
+  build/sampler              run the comparison
+  build/sampler capture.bin  decode a stream captured from a board to CSV
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#include <stdio.h>
+#include <vector>
+
+#include "AP33772S.h"
+#include "AP33772S_Sampler.h"
+#include "AP33772SSim.h"
+#include "SampleDecoder.h"
+
+#define SERIAL_BAUD  115200
+#define PERIOD_US    500
+#define CAPTURE_MS   2000
+
+static const SIM_PDO_T SOURCE_PDOS[] = {
+  {SIM_PDO_FIXED, 0, 5000, 3000, false},
+  {SIM_PDO_FIXED, 0, 20000, 5000, false},
+};
+
+static AP33772SSim sim;
+static AP33772S usbpd;
+
+// Collects whatever the sampler streams, in place of Serial
+class Capture : public Print
+{
+public:
+  size_t write(uint8_t c) override { data.push_back(c); return 1; }
+  size_t write(const uint8_t *buffer, size_t size) override
+  {
+    data.insert(data.end(), buffer, buffer + size);
+    return size;
+  }
+  using Print::write;
+  std::vector<uint8_t> data;
+};
+
+// Counts what the same samples cost as Serial.print() text
+class Counter : public Print
+{
+public:
+  size_t write(uint8_t) override { bytes++; return 1; }
+  unsigned long bytes = 0;
+};
+
+static void printCsv(const SAMPLE_RAW_T &s, void *)
+{
+  printf("%lu,%d,%d,%d\n", (unsigned long)s.t_us, s.voltage * 80, s.current * 24, s.temp);
+}
+
+static void collect(const SAMPLE_RAW_T &s, void *ctx)
+{
+  ((std::vector<SAMPLE_RAW_T> *)ctx)->push_back(s);
+}
+
+static int decodeFile(const char *path)
+{
+  FILE *f = fopen(path, "rb");
+  if (!f)
+  {
+    perror(path);
+    return 1;
+  }
+  SampleDecoder decoder(printCsv);
+  uint8_t buf[512];
+  size_t n;
+  printf("t_us,mV,mA,C\n");
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) decoder.feed(buf, n);
+  fclose(f);
+  fprintf(stderr, "%lu frames, %lu samples, %lu CRC errors, %lu bytes skipped\n",
+          decoder.frames(), decoder.samples(), decoder.crcErrors(), decoder.skipped());
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc > 1) return decodeFile(argv[1]);
+
+  sim.setSourcePDOs(SOURCE_PDOS, sizeof(SOURCE_PDOS) / sizeof(SOURCE_PDOS[0]));
+  sim.setCableResistance(150);
+  Wire.attach(AP33772S_ADDRESS, &sim);
+  Wire.begin();
+  Wire.setClock(400000);
+  Serial.setEcho(false);
+
+  sim.powerOn();
+  usbpd.begin();
+  usbpd.requestPower(20000, 5000);
+  delay(200);
+  usbpd.setOutput(1);
+
+  // 2kHz capture of a load stepping 0.5A <-> 4A every 20ms, with slow heating
+  AP33772SSampler sampler(usbpd);
+  Capture capture;
+  sampler.start(PERIOD_US);
+  unsigned long start = millis();
+  while (millis() - start < CAPTURE_MS)
+  {
+    unsigned long t = millis() - start;
+    sim.setLoadCurrent((t / 20) & 1 ? 4000 : 500);
+    sim.setTemperature(30 + t / 250);
+    sampler.poll();
+    if (sampler.available() >= SAMPLE_FRAME_SAMPLES) sampler.stream(capture);
+    delayMicroseconds(50);
+  }
+  sampler.stop();
+  while (sampler.stream(capture)) {}
+
+  // Decode and check the round trip
+  std::vector<SAMPLE_RAW_T> got;
+  SampleDecoder decoder(collect, &got);
+  decoder.feed(capture.data.data(), capture.data.size());
+
+  Counter text;
+  for (const SAMPLE_RAW_T &s : got)
+  {
+    text.print((unsigned long)s.t_us);
+    text.print(',');
+    text.print(s.voltage * 80);
+    text.print(',');
+    text.print(s.current * 24);
+    text.print(',');
+    text.println(s.temp);
+  }
+
+  unsigned long samples = got.size();
+  double binPer = (double)capture.data.size() / samples;
+  double textPer = (double)text.bytes / samples;
+  double bytesPerSec = SERIAL_BAUD / 10.0;
+
+  printf("%lu samples at %dus, %lu dropped, %lu frames, %lu CRC errors\n\n", samples, PERIOD_US,
+         sampler.dropped(), decoder.frames(), decoder.crcErrors());
+  printf("%-24s %10s %12s %14s\n", "format", "bytes", "bytes/sample", "samples/s@115k2");
+  printf("%-24s %10lu %12.2f %14.0f\n", "decimal text", text.bytes, textPer, bytesPerSec / textPer);
+  printf("%-24s %10lu %12.2f %14.0f\n", "AP33772SSampler frames", (unsigned long)capture.data.size(),
+         binPer, bytesPerSec / binPer);
+  printf("\nthroughput gain %.1fx\n", textPer / binPer);
+
+  bool ok = samples == sampler.taken() && decoder.crcErrors() == 0 && !got.empty();
+
+  // A corrupted byte costs one frame, the decoder picks up again at the next
+  std::vector<uint8_t> bad = capture.data;
+  bad[bad.size() / 2] ^= 0x10;
+  got.clear();
+  SampleDecoder resync(collect, &got);
+  resync.feed(bad.data(), bad.size());
+  unsigned long rejected = resync.crcErrors() + resync.formatErrors();
+  printf("one flipped bit: %lu frame rejected, %lu of %lu samples recovered\n",
+         rejected, (unsigned long)got.size(), samples);
+  ok = ok && rejected == 1 && got.size() >= samples - SAMPLE_FRAME_SAMPLES;
+
+  return ok ? 0 : 1;
+}
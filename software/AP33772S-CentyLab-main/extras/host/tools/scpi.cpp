@@ -0,0 +1,204 @@
+/*
+scpi.cpp - Drive AP33772SSCPI on the simulated charger, one command per line
+against batched lines, and check that parsing never touches the heap.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+
+#include "AP33772S.h"
+#include "AP33772S_SCPI.h"
+#include "AP33772SSim.h"
+
+#define SERIAL_BAUD    115200
+#define ROUND_TRIP_US  1000   // USB full-speed frame, best case for a CDC serial port
+#define SETPOINTS      10
+
+static unsigned long heapAllocs = 0;
+
+void *operator new(size_t size)
+{
+  heapAllocs++;
+  void *p = malloc(size);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept
+{
+  free(p);
+}
+
+static const SIM_PDO_T SOURCE_PDOS[] = {
+  {SIM_PDO_FIXED, 0, 5000, 3000, false},
+  {SIM_PDO_FIXED, 0, 9000, 3000, false},
+  {SIM_PDO_FIXED, 0, 15000, 3000, false},
+  {SIM_PDO_FIXED, 0, 20000, 5000, false},
+  {SIM_PDO_PPS, 3300, 21000, 5000, false},
+};
+
+static AP33772SSim sim;
+static AP33772S usbpd;
+
+// Keeps the last answer line and counts what went back to the host
+class Reply : public Print
+{
+public:
+  size_t write(uint8_t c) override
+  {
+    bytes++;
+    if (c == '\n') lines++;
+    else if (c != '\r' && len < sizeof(line) - 1)
+    {
+      line[len++] = c;
+      line[len] = '\0';
+    }
+    return 1;
+  }
+  void clear() { len = 0; line[0] = '\0'; }
+  char line[256] = {0};
+  size_t len = 0;
+  unsigned long bytes = 0;
+  unsigned long lines = 0;
+};
+
+static Reply reply;
+static AP33772SSCPI scpi(usbpd, reply);
+
+typedef struct
+{
+  unsigned long roundTrips;
+  unsigned long bytesOut;
+  unsigned long deviceUs;
+  unsigned long requests;
+  unsigned long transactions;
+} RESULT_T;
+
+static void send(const char *line, RESULT_T &r)
+{
+  unsigned long start = micros();
+  scpi.feed(line);
+  scpi.feed('\n');
+  r.deviceUs += micros() - start;
+  r.bytesOut += strlen(line) + 1;
+  r.roundTrips++;
+}
+
+static void setpoint(int i, char *volt, char *curr)
+{
+  snprintf(volt, 16, "%d.%d", 5 + i, (i * 3) % 10);
+  snprintf(curr, 16, "%d.%d", 1 + i % 3, (i * 7) % 10);
+}
+
+static void report(const char *name, const RESULT_T &r)
+{
+  double serialUs = (r.bytesOut + reply.bytes) * 1e6 / (SERIAL_BAUD / 10.0);
+  double totalMs = (r.roundTrips * (double)ROUND_TRIP_US + serialUs + r.deviceUs) / 1000.0;
+  printf("%-28s %6lu %8lu %8lu %8lu %8lu %10.1f\n", name, r.roundTrips, r.bytesOut + reply.bytes,
+         r.requests, r.transactions, r.deviceUs, totalMs);
+}
+
+static void begin(RESULT_T &r)
+{
+  memset(&r, 0, sizeof(r));
+  reply.bytes = 0;
+  reply.lines = 0;
+  sim.powerOn();
+  usbpd.begin();
+  scpi.feed("*RST\n");
+  Wire.resetStats();
+  r.requests = sim.requestCount();
+}
+
+static void end(RESULT_T &r)
+{
+  r.requests = sim.requestCount() - r.requests;
+  r.transactions = Wire.stats().writeTransactions + Wire.stats().readTransactions;
+}
+
+int main()
+{
+  sim.setSourcePDOs(SOURCE_PDOS, sizeof(SOURCE_PDOS) / sizeof(SOURCE_PDOS[0]));
+  sim.setLoadCurrent(800);
+  Wire.attach(AP33772S_ADDRESS, &sim);
+  Wire.begin();
+  Serial.setEcho(false);
+
+  printf("%d setpoints of VOLT, CURR, OUTP ON, MEAS:VOLT?, MEAS:CURR?, MEAS:TEMP?\n", SETPOINTS);
+  printf("%d us per serial round trip, %d baud\n\n", ROUND_TRIP_US, SERIAL_BAUD);
+  printf("%-28s %6s %8s %8s %8s %8s %10s\n", "method", "trips", "bytes", "rdo", "i2c_tx", "dev_us", "total_ms");
+
+  char volt[16], curr[16], line[SCPI_LINE_LENGTH];
+  unsigned long heapBefore = heapAllocs;
+  bool ok = true;
+
+  RESULT_T single;
+  begin(single);
+  for (int i = 0; i < SETPOINTS; i++)
+  {
+    setpoint(i, volt, curr);
+    snprintf(line, sizeof(line), "VOLT %s", volt);
+    send(line, single);
+    snprintf(line, sizeof(line), "CURR %s", curr);
+    send(line, single);
+    send("OUTP ON", single);
+    send("MEAS:VOLT?", single);
+    send("MEAS:CURR?", single);
+    send("MEAS:TEMP?", single);
+  }
+  end(single);
+  report("one command per line", single);
+
+  RESULT_T batch;
+  begin(batch);
+  for (int i = 0; i < SETPOINTS; i++)
+  {
+    setpoint(i, volt, curr);
+    snprintf(line, sizeof(line), "VOLT %s;CURR %s;OUTP ON;MEAS:VOLT?;MEAS:CURR?;MEAS:TEMP?", volt, curr);
+    reply.clear();
+    send(line, batch);
+    ok = ok && strchr(reply.line, ';') && strchr(strchr(reply.line, ';') + 1, ';');
+  }
+  end(batch);
+  report("batched per setpoint", batch);
+
+  ok = ok && heapAllocs == heapBefore;
+  printf("\nheap allocations while parsing: %lu\n", heapAllocs - heapBefore);
+
+  // Header forms, batching of answers and the error queue
+  reply.clear();
+  scpi.feed(":syst:pdo:coun?;SYSTEM:PDO? 5;volt 9000mV;VOLT?;outp?;BOGUS;VOLT 99;SYST:ERR?;SYST:ERR?;SYST:ERR?\n");
+  printf("%s\n", reply.line);
+  ok = ok && !strcmp(reply.line, "5;5,PPS,3.300,21.000,5.000;9.000;1;-113,\"Undefined header\";"
+                                  "-222,\"Data out of range\";0,\"No error\"");
+
+  // Numbers too long for 32 bits and units that do not belong to the command, setpoint kept
+  reply.clear();
+  scpi.feed("VOLT 4294972;VOLT 12A;CURR 2mV;VOLT 12 mV;VOLT?;SYST:ERR?;SYST:ERR?;SYST:ERR?;SYST:ERR?\n");
+  printf("%s\n", reply.line);
+  ok = ok && !strcmp(reply.line, "9.000;-222,\"Data out of range\";-131,\"Invalid suffix\";"
+                                  "-131,\"Invalid suffix\";-222,\"Data out of range\"");
+
+  // A setpoint no PDO covers falls back to the one in place, OUTP ON keeps that contract
+  reply.clear();
+  scpi.feed("VOLT 24;CURR 5\n");
+  scpi.feed("VOLT?;CURR?;OUTP ON;SYST:ERR?;SYST:ERR?\n");
+  printf("%s\n", reply.line);
+  ok = ok && !strcmp(reply.line, "9.000;1.300;-221,\"Settings conflict\";0,\"No error\"");
+
+  // A request the bus refused stays pending and goes out with the next OUTP ON
+  Wire.injectFault(WIRE_FAULT_NACK, BUS_RETRIES + 1);
+  scpi.feed("VOLT 12\n");
+  reply.clear();
+  scpi.feed("OUTP ON;SYST:ERR?;SYST:ERR?\n");
+  delay(500);
+  printf("%s, VREQ %dmV\n", reply.line, usbpd.readVREQ());
+  ok = ok && !strcmp(reply.line, "-240,\"Hardware error\";0,\"No error\"") && usbpd.readVREQ() == 12000;
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,200 @@
+/*
+sequence.cpp - Step timing of a (mV, mA, dwell) stress profile run as the
+PPScycle example does it, setPPSPDO() then delay() in the loop, against
+AP33772SSequence, while the rest of the sketch takes a random 0-3ms per
+loop. Then the telemetry triggers, ending steps early and stopping on
+overcurrent into a resistive load.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#include <stdio.h>
+
+#include "AP33772S.h"
+#include "AP33772S_Sequence.h"
+#include "AP33772SSim.h"
+
+#define LOOPS     20
+#define WORK_MAX  3000 // us the rest of the sketch takes per loop, at most
+
+static const SIM_PDO_T SOURCE_PDOS[] = {
+  {SIM_PDO_FIXED, 0, 5000, 3000, false},
+  {SIM_PDO_FIXED, 0, 9000, 3000, false},
+  {SIM_PDO_FIXED, 0, 15000, 3000, false},
+  {SIM_PDO_FIXED, 0, 20000, 5000, false},
+  {SIM_PDO_PPS, 3300, 21000, 5000, false},
+};
+
+static const SEQ_STEP_T PROFILE[] = {
+  {5000, 3000, 50}, {12000, 3000, 100}, {20000, 3000, 50}, {9000, 3000, 80},
+  {16000, 3000, 120}, {3300, 3000, 40}, {11000, 3000, 60}, {7500, 3000, 100},
+};
+#define STEP_COUNT (sizeof(PROFILE) / sizeof(PROFILE[0]))
+
+static AP33772SSim sim;
+static AP33772S usbpd;
+static uint32_t lcg = 1;
+static bool ok = true;
+
+// The rest of the sketch: Serial, a display, other sensors
+static void work()
+{
+  lcg = lcg * 1103515245UL + 12345UL;
+  delayMicroseconds((lcg >> 8) % WORK_MAX);
+}
+
+static unsigned long profileMs()
+{
+  unsigned long ms = 0;
+  for (const SEQ_STEP_T &s : PROFILE) ms += s.dwell_ms;
+  return ms;
+}
+
+static void boot()
+{
+  hostResetClock();
+  sim.powerOn();
+  usbpd.begin();
+  usbpd.requestPower(5000, 3000);
+  delay(200);
+  lcg = 1;
+}
+
+static void row(const char *name, unsigned long steps, double meanUs, unsigned long maxUs, long driftUs,
+                unsigned long txn, unsigned long bytes)
+{
+  printf("%-30s %6lu %9.0f %9lu %10ld %8.2f %8.2f\n", name, steps, meanUs, maxUs, driftUs,
+         (double)txn / steps, (double)bytes / steps);
+}
+
+// PPScycle: request, then delay() for the dwell. Every step starts after the
+// previous one's dwell plus its request and the loop's other work.
+static long delayLoop()
+{
+  boot();
+  Wire.resetStats();
+  int pps = usbpd.getPPSIndex();
+  unsigned long start = micros();
+  unsigned long scheduled = 0, lateMax = 0, lateSum = 0, steps = 0;
+  for (int loop = 0; loop < LOOPS; loop++)
+  {
+    for (const SEQ_STEP_T &s : PROFILE)
+    {
+      unsigned long late = micros() - start - scheduled;
+      if (late > lateMax) lateMax = late;
+      lateSum += late;
+      steps++;
+      usbpd.setPPSPDO(pps, s.mV, s.mA);
+      work();
+      delay(s.dwell_ms);
+      scheduled += s.dwell_ms * 1000UL;
+    }
+  }
+  long drift = (long)(micros() - start - scheduled);
+  const WIRE_STATS_T &st = Wire.stats();
+  row("setPPSPDO() + delay()", steps, (double)lateSum / steps, lateMax, drift,
+      st.writeTransactions + st.readTransactions, st.bytesWritten + st.bytesRead);
+  return drift;
+}
+
+static void sequenceLoop()
+{
+  boot();
+  AP33772SSequence seq(usbpd);
+  ok = ok && seq.load(PROFILE, STEP_COUNT);
+  Wire.resetStats();
+  seq.start(LOOPS);
+  while (seq.busy())
+  {
+    seq.poll();
+    usbpd.poll();
+    work();
+  }
+  const SEQ_STATS_T &st = seq.stats();
+  long drift = (long)st.elapsedUs - (long)(profileMs() * 1000UL * LOOPS);
+  const WIRE_STATS_T &w = Wire.stats();
+  row("AP33772SSequence", st.steps, (double)st.lateSumUs / st.steps, st.lateMaxUs, drift,
+      w.writeTransactions + w.readTransactions, w.bytesWritten + w.bytesRead);
+
+  // Late by at most one loop of other work, never an accumulating drift, one 2-byte write per step
+  ok = ok && seq.state() == SEQ_DONE && st.steps == STEP_COUNT * LOOPS && st.loops == LOOPS;
+  ok = ok && st.overruns == 0 && st.errors == 0 && st.lateMaxUs < WORK_MAX + 500;
+  ok = ok && drift >= 0 && drift < WORK_MAX + 500;
+  ok = ok && w.writeTransactions == st.steps && w.readTransactions == 0;
+}
+
+static void triggers()
+{
+  printf("\nTriggers, 4 ohm load, 5V to 20V in 3V steps of 1s\n");
+  static const SEQ_STEP_T STAIRS[] = {
+    {5000, 3000, 1000}, {8000, 3000, 1000}, {11000, 3000, 1000},
+    {14000, 3000, 1000}, {17000, 3000, 1000}, {20000, 3000, 1000},
+  };
+  sim.setLoadResistance(4000);
+  AP33772SSequence seq(usbpd);
+
+  // Next step as soon as the load draws more than 2.2A
+  boot();
+  seq.load(STAIRS, 6);
+  seq.setTrigger(SEQ_TRIG_CURRENT_ABOVE, 2200, SEQ_NEXT);
+  seq.start();
+  while (seq.busy())
+  {
+    seq.poll();
+    delay(1);
+  }
+  const SEQ_STATS_T &st = seq.stats();
+  printf("%-30s %6lu trips, %lums instead of 6000ms\n", "CURRENT_ABOVE 2200mA, next", st.trips,
+         st.elapsedUs / 1000);
+  ok = ok && seq.state() == SEQ_DONE && st.trips == 4 && st.elapsedUs < 3000000UL;
+
+  // Stop at the first step that overloads
+  boot();
+  seq.load(STAIRS, 6);
+  seq.setTrigger(SEQ_TRIG_CURRENT_ABOVE, 2800, SEQ_STOP);
+  seq.start();
+  while (seq.busy())
+  {
+    seq.poll();
+    delay(1);
+  }
+  printf("%-30s %6s at step %d, %dmA, %lums\n", "CURRENT_ABOVE 2800mA, stop",
+         seq.state() == SEQ_TRIPPED ? "tripped" : "missed", seq.step(), seq.tripValue(),
+         seq.stats().elapsedUs / 1000);
+  ok = ok && seq.state() == SEQ_TRIPPED && seq.step() == 3 && seq.tripValue() > 2800;
+  sim.setLoadCurrent(0);
+
+  // A step no PDO covers is refused when the table is loaded, not mid-run
+  static const SEQ_STEP_T BAD[] = {{5000, 3000, 100}, {25000, 3000, 100}};
+  bool loaded = seq.load(BAD, 2);
+  printf("%-30s %6s, step %d\n", "25V on a 21V source", loaded ? "loaded" : "refused", seq.failedStep());
+  ok = ok && !loaded && seq.failedStep() == 1 && !seq.start();
+
+  // So is a dwell the us timeline cannot hold
+  static const SEQ_STEP_T LONG[] = {{5000, 3000, SEQ_MAX_DWELL}, {9000, 3000, SEQ_MAX_DWELL + 1}};
+  loaded = seq.load(LONG, 2);
+  printf("%-30s %6s, step %d\n", "dwell over SEQ_MAX_DWELL", loaded ? "loaded" : "refused", seq.failedStep());
+  ok = ok && !loaded && seq.failedStep() == 1 && seq.load(LONG, 1);
+}
+
+int main()
+{
+  sim.setSourcePDOs(SOURCE_PDOS, sizeof(SOURCE_PDOS) / sizeof(SOURCE_PDOS[0]));
+  Wire.attach(AP33772S_ADDRESS, &sim);
+  Wire.begin();
+  Serial.setEcho(false);
+
+  printf("%u-step profile of %lums, %d loops, 0-%dus of other work per loop\n\n", (unsigned)STEP_COUNT,
+         profileMs(), LOOPS, WORK_MAX);
+  printf("%-30s %6s %9s %9s %10s %8s %8s\n", "method", "steps", "late_us", "max_us", "drift_us", "txn/step",
+         "B/step");
+  long naive = delayLoop();
+  sequenceLoop();
+  ok = ok && naive > WORK_MAX * (long)LOOPS; // The delay() loop does drift
+  triggers();
+
+  printf("\n%s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,132 @@
+/*
+thermal.cpp - Sustained 5A load on a board that overheats at full current:
+no derating (OTP trips and the output cycles), current derating on AVS, and
+voltage derating on PPS into a resistive load. The board temperature follows
+a first-order model of I^2 heating fed back into the simulated TEMP register.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the version 3 GNU General Public License as
+published by the Free Software Foundation.
+*/
+
+#include <stdio.h>
+
+#include "AP33772S.h"
+#include "AP33772S_Thermal.h"
+#include "AP33772SSim.h"
+
+#define RUN_S        600
+#define TICK_MS      10
+#define AMBIENT      25.0
+#define RISE_PER_A2  4.4   // C per A^2 at steady state, 5A settles at 135C
+#define TAU_S        30.0
+#define RECOVER_C    90    // Application turns the output back on below this after OTP
+
+static const SIM_PDO_T SOURCE_PDOS[] = {
+  {SIM_PDO_FIXED, 0, 5000, 3000, false},
+  {SIM_PDO_FIXED, 0, 9000, 3000, false},
+  {SIM_PDO_FIXED, 0, 15000, 3000, false},
+  {SIM_PDO_FIXED, 0, 20000, 5000, false},
+  {SIM_PDO_PPS, 3300, 21000, 5000, false},
+  {SIM_PDO_FIXED, 0, 28000, 5000, true},
+  {SIM_PDO_AVS, 15000, 28000, 5000, true},
+};
+
+static AP33772SSim sim;
+static AP33772S usbpd;
+
+typedef struct
+{
+  unsigned long trips;
+  unsigned long offMs;
+  double wh;
+  double peakC;
+  double endA;
+} RESULT_T;
+
+static RESULT_T run(AP33772SThermal *thermal)
+{
+  RESULT_T r = {0, 0, 0, 0, 0};
+  double temp = AMBIENT;
+  bool wasOn = true;
+
+  for (unsigned long t = 0; t < RUN_S * 1000UL; t += TICK_MS)
+  {
+    usbpd.poll();
+    if (thermal) thermal->poll();
+
+    double mV = (sim.reg(CMD_VOLTAGE) | (sim.reg(CMD_VOLTAGE, 1) << 8)) * 80.0;
+    double amps = sim.reg(CMD_CURRENT) * 24.0 / 1000;
+    temp += (AMBIENT + RISE_PER_A2 * amps * amps - temp) * (TICK_MS / 1000.0) / TAU_S;
+    sim.setTemperature((int)temp);
+    if (temp > r.peakC) r.peakC = temp;
+    r.wh += mV / 1000 * amps * TICK_MS / 3.6e6;
+    r.endA = amps;
+
+    if (!sim.outputOn())
+    {
+      if (wasOn) r.trips++;
+      r.offMs += TICK_MS;
+      if (temp < RECOVER_C) usbpd.setOutput(1);
+    }
+    wasOn = sim.outputOn();
+    delay(TICK_MS);
+  }
+  return r;
+}
+
+static void boot(int celsius)
+{
+  hostResetClock();
+  sim.setTemperature(celsius);
+  sim.powerOn();
+  usbpd.begin();
+  usbpd.setOutput(1);
+}
+
+static void report(const char *name, const RESULT_T &r, AP33772SThermal *thermal)
+{
+  printf("%-30s %6lu %8lu %8.1f %8.0f %6.2f", name, r.trips, r.offMs / 1000, r.wh, r.peakC, r.endA);
+  if (thermal) printf(" %8u %9lu", thermal->stats().minPercent, thermal->stats().requests);
+  printf("\n");
+}
+
+int main()
+{
+  sim.setSourcePDOs(SOURCE_PDOS, sizeof(SOURCE_PDOS) / sizeof(SOURCE_PDOS[0]));
+  Wire.attach(AP33772S_ADDRESS, &sim);
+  Wire.begin();
+  Serial.setEcho(false);
+  bool ok = true;
+
+  AP33772SThermal thermal(usbpd);
+  printf("%d s at 5A, DRTHR 100C, OTPTHR 120C, board settles at %.0fC with 5A\n\n", RUN_S,
+         AMBIENT + RISE_PER_A2 * 25);
+  printf("%-30s %6s %8s %8s %8s %6s %8s %9s\n", "", "trips", "off_s", "Wh", "peak_C", "end_A", "min_%", "requests");
+
+  boot(25);
+  sim.setLoadCurrent(5000);
+  usbpd.requestPower(24000, 5000);
+  RESULT_T none = run(NULL);
+  report("no derating, AVS 24V", none, NULL);
+
+  boot(25);
+  sim.setLoadCurrent(5000);
+  ok = ok && thermal.start(24000, 5000, THERMAL_CURRENT);
+  RESULT_T current = run(&thermal);
+  report("current derating, AVS 24V", current, &thermal);
+  thermal.stop();
+
+  boot(25);
+  sim.setLoadResistance(4000);
+  ok = ok && thermal.start(19000, 5000, THERMAL_VOLTAGE);
+  RESULT_T voltage = run(&thermal);
+  report("voltage derating, PPS 19V 4R", voltage, &thermal);
+  thermal.stop();
+
+  // Without derating the board sits at OTPTHR and every keepalive turns the output back on
+  // into another trip. Derated, it holds a steady reduced current below DRTHR.
+  ok = ok && none.trips > 0 && current.trips == 0 && voltage.trips == 0;
+  ok = ok && current.offMs == 0 && voltage.offMs == 0 && current.peakC < 100 && voltage.peakC < 100;
+  return ok ? 0 : 1;
+}